@@ -0,0 +1,232 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+#include "HostTarget.h"
+#include <stdlib.h>
+#include <ctype.h>
+
+//Split so that cycle * rate does not overflow on long runs
+uint64_t hostSampleIndex(uint64_t cycle, uint32_t rate)
+{
+    return cycle / HOST_CORE_CLOCK * rate + cycle % HOST_CORE_CLOCK * rate / HOST_CORE_CLOCK;
+}
+
+FileInput::FileInput(FILE *f, uint32_t r)
+{
+    file = f;
+    rate = r;
+    first = 0;
+    filled = 0;
+
+    fseek(file, 0, SEEK_END);
+    length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+}
+
+FileInput::~FileInput()
+{
+    fclose(file);
+}
+
+//Only one block is kept, the reads move forward through the file
+uint32_t FileInput::read(uint64_t cycle)
+{
+    if(length == 0)
+        return 0;
+
+    uint64_t index = hostSampleIndex(cycle, rate) % length;
+
+    if(index < first || index >= first + filled) {
+        first = index;
+        fseek(file, first, SEEK_SET);
+        filled = fread(block, 1, sizeof(block), file);
+        if(filled == 0)
+            return 0;
+    }
+    return block[index - first];
+}
+
+CounterInput::CounterInput(uint32_t r)
+{
+    rate = r;
+}
+
+uint32_t CounterInput::read(uint64_t cycle)
+{
+    return hostSampleIndex(cycle, rate) & 0xFF;
+}
+
+VcdInput::VcdInput(FILE *f, uint32_t r, const std::map<std::string, int> &mapping)
+{
+    file = f;
+    rate = r;
+    scale = 1;
+    units = 1000000000;
+    next = 0;
+    finished = false;
+    state = 0;
+
+    header(mapping);
+}
+
+VcdInput::~VcdInput()
+{
+    fclose(file);
+}
+
+//Whitespace separated, as VCD is
+bool VcdInput::token()
+{
+    int c;
+
+    text.clear();
+    while((c = getc_unlocked(file)) != EOF && isspace(c));
+
+    while(c != EOF && !isspace(c)) {
+        text += (char) c;
+        c = getc_unlocked(file);
+    }
+    return !text.empty();
+}
+
+void VcdInput::skipDeclaration()
+{
+    while(token() && text != "$end");
+}
+
+void VcdInput::header(const std::map<std::string, int> &mapping)
+{
+    int nextBit = 0;
+
+    while(token() && text != "$enddefinitions") {
+        if(text == "$timescale") {
+            std::string ts;
+            while(token() && text != "$end")
+                ts += text;
+
+            char *unit;
+            uint64_t v = strtoul(ts.c_str(), &unit, 10);
+            static const char *names[] = {"s", "ms", "us", "ns", "ps", "fs"};
+
+            scale = v ? v : 1;
+            units = 0;
+            for(uint64_t i = 0, e = 1; i < 6; i++, e *= 1000) {
+                if(!strcmp(unit, names[i]))
+                    units = e;
+            }
+            if(units == 0) {
+                fprintf(stderr, "Unknown timescale %s, assuming 1ns\n", ts.c_str());
+                scale = 1;
+                units = 1000000000;
+            }
+        }else if(text == "$var") {
+            std::string width, id, name;
+            token();
+            token();
+            width = text;
+            token();
+            id = text;
+            token();
+            name = text;
+            skipDeclaration();
+
+            Signal s;
+            s.width = atoi(width.c_str());
+            s.bit = -1;
+
+            if(mapping.empty()) {
+                s.bit = nextBit;
+                nextBit += s.width;
+            }else if(mapping.count(name)) {
+                s.bit = mapping.find(name)->second;
+            }
+
+            if(s.bit >= 16)
+                s.bit = -1;
+            if(s.bit >= 0)
+                fprintf(stderr, "%s -> PB%d%s\n", name.c_str(), s.bit, s.width > 1 ? "+" : "");
+            signals[id] = s;
+        }else if(text[0] == '$' && text != "$end") {
+            skipDeclaration();
+        }
+    }
+    skipDeclaration();
+}
+
+void VcdInput::change(char value, const std::string &id)
+{
+    std::map<std::string, Signal>::const_iterator s = signals.find(id);
+    if(s == signals.end() || s->second.bit < 0)
+        return;
+
+    if(value == '1')
+        state |= 1 << s->second.bit;
+    else
+        state &= ~(1 << s->second.bit);
+}
+
+//Vector values are MSB first and may be shorter than the width
+void VcdInput::change(const std::string &value, const std::string &id)
+{
+    std::map<std::string, Signal>::const_iterator s = signals.find(id);
+    if(s == signals.end() || s->second.bit < 0)
+        return;
+
+    for(int i = 0; i < s->second.width && s->second.bit + i < 16; i++) {
+        int pos = (int) value.size() - 1 - i;
+        uint32_t mask = 1 << (s->second.bit + i);
+
+        if(pos >= 0 && value[pos] == '1')
+            state |= mask;
+        else
+            state &= ~mask;
+    }
+}
+
+//Applies the changes at `next`, up to the following timestamp
+void VcdInput::step()
+{
+    while(token()) {
+        char kind = text[0];
+
+        if(kind == '#') {
+            next = strtoull(text.c_str() + 1, NULL, 10);
+            return;
+        }else if(kind == '$') {
+            if(text == "$comment")
+                skipDeclaration();
+        }else if(kind == 'b' || kind == 'B') {
+            std::string value = text.substr(1);
+            if(token())
+                change(value, text);
+        }else if(kind == 'r' || kind == 'R') {
+            token();
+        }else {
+            change(kind, text.substr(1));
+        }
+    }
+    finished = true;
+}
+
+/* Samples before a timestamp see the state before its changes. Sample
+   index / rate is compared with next * scale / units exactly, as a
+   rounded time would move some changes by one sample. */
+uint32_t VcdInput::read(uint64_t cycle)
+{
+    unsigned __int128 t = (unsigned __int128) hostSampleIndex(cycle, rate) * units;
+
+    while(!finished && (unsigned __int128) next * scale * rate <= t)
+        step();
+    return state;
+}
@@ -0,0 +1,657 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+/*
+ Runs the firmware on the host, with the serial port on a pseudo
+ terminal that PulseView, sigrok-cli or the tools can open.
+
+   nucleosim [-i file] [-r rate] [-m name=bit]... [-w] [-u baud] [-l link] [-b]
+
+   -i file   input samples, one byte per sample, or a VCD file (.vcd, or
+             - for a VCD on stdin); the default is a binary counter
+   -r rate   input sample rate in Hz (default 1000000)
+   -m n=b    maps VCD signal n to PB<b> (default: declaration order)
+   -w        wires the pattern generator output (PC0-PC7) to PB0-PB7
+   -u baud   UART rate of the timing model, instead of the firmware one
+   -l link   symlink to the pty, for clients that want a fixed name
+   -b        benchmark: runs a client on the pty, prints the throughput
+             of the command path and the uploads, and exits
+
+ The RX interrupt runs on the thread that reads the pty, and only while
+ the firmware has interrupts enabled. The UART timing is modelled on
+ the virtual clock (a byte every 10 bits), the bytes themselves go to
+ the pty as fast as the client reads them. The activity monitor DMA and
+ the frequency counter timers are not simulated.
+*/
+
+#include "HostTarget.h"
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pty.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//termios.h has its own CR1 and CR2, the timer registers are meant here
+#undef CR1
+#undef CR2
+
+#undef main
+int firmwareMain();
+
+#define HOST_COUNTER_READ_CYCLES 1  // LDR of DWT->CYCCNT
+#define HOST_UART_POLL_CYCLES 8     // Status read and branch of a busy UART
+#define HOST_OUTPUT_BLOCK 4096
+#define HOST_WRITE_TIMEOUT 1000     // ms, the bytes are dropped when nobody reads
+#define HOST_PWM_CHANNELS 8
+
+uint32_t SystemCoreClock = HOST_CORE_CLOCK;
+
+GPIO_TypeDef hostGPIOB, hostGPIOC;
+TIM_TypeDef hostTIM1, hostTIM2, hostTIM3, hostTIM4;
+DMA_Stream_TypeDef hostDMA2_Stream1, hostDMA2_Stream5;
+DMA_TypeDef hostDMA2;
+RCC_TypeDef hostRCC;
+FLASH_TypeDef hostFLASH;
+CRC_TypeDef hostCRC;
+USART_TypeDef hostUSART2;
+DWT_Type hostDWT;
+
+//Virtual time, only moved by the firmware thread
+static uint64_t cycles;
+static uint64_t counterBase;
+
+static HostInput *input;
+static bool inputStarted;
+static uint64_t inputOrigin;    // Time of the first port read
+static bool wired;
+
+struct PwmChannel{
+    bool active;
+    uint64_t start;
+    uint64_t period;
+    float duty;
+};
+
+static PwmChannel pwm[HOST_PWM_CHANNELS];
+
+uint64_t hostNow()
+{
+    return cycles;
+}
+
+void hostAdvance(uint64_t c)
+{
+    cycles += c;
+}
+
+void hostSetInput(HostInput *in)
+{
+    input = in;
+}
+
+uint32_t HAL_RCC_GetPCLK2Freq()
+{
+    return HOST_CORE_CLOCK;
+}
+
+HostCycleCounter::operator uint32_t() const volatile
+{
+    cycles += HOST_COUNTER_READ_CYCLES;
+    return cycles - counterBase;
+}
+
+void HostCycleCounter::operator=(uint32_t v) volatile
+{
+    counterBase = cycles - v;
+}
+
+//CRC unit: CRC-32 (0x04C11DB7), MSB first, one word at a time
+static uint32_t crc;
+
+HostCrcData::operator uint32_t() const volatile
+{
+    return crc;
+}
+
+void HostCrcData::operator=(uint32_t v) volatile
+{
+    crc ^= v;
+    for(int i = 0; i < 32; i++)
+        crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+}
+
+void HostCrcControl::operator=(uint32_t v) volatile
+{
+    if(v & CRC_CR_RESET)
+        crc = 0xFFFFFFFF;
+}
+
+void HostDmaControl::operator=(uint32_t v) volatile
+{
+    if((v & DMA_SxCR_EN) && !(value & DMA_SxCR_EN))
+        enabledAt = cycles;
+    value = v;
+}
+
+/* Value of the pattern DMA target at time t: TIM1 requests a transfer
+   at every update, the first one a whole period after the enable. */
+static uint32_t patternTarget(volatile uint32_t *target, uint64_t t)
+{
+    DMA_Stream_TypeDef *s = DMA2_Stream5;
+
+    if(!(s->CR & DMA_SxCR_EN) || !(TIM1->CR1 & TIM_CR1_CEN) || !(TIM1->DIER & TIM_DIER_UDE) || s->NDTR == 0)
+        return *target;
+
+    uint64_t period = (uint64_t) (TIM1->PSC + 1) * (TIM1->ARR + 1);
+    uint64_t transfers = (t - s->CR.enabledAt) / period;
+    if(transfers == 0)
+        return *target;
+
+    uint64_t index = transfers - 1;
+    if(s->CR & DMA_SxCR_CIRC)
+        index %= s->NDTR;
+    else
+        index = min(index, (uint64_t) s->NDTR - 1);
+
+    return (*target & ~0xFF) | ((const uint8_t *) s->M0AR)[index];
+}
+
+static bool isPatternTarget(volatile uint32_t *port)
+{
+    return (uintptr_t) port == DMA2_Stream5->PAR && (DMA2_Stream5->CR & DMA_SxCR_EN);
+}
+
+//Input levels, the pattern output when wired, and the test signal PWMs on top
+static uint32_t inputLevels(uint64_t t)
+{
+    if(!inputStarted) {
+        inputStarted = true;
+        inputOrigin = t;
+    }
+
+    uint32_t v = input ? input->read(t - inputOrigin) : 0;
+
+    if(wired) {
+        volatile uint32_t *odr = &GPIOC->ODR;
+        uint32_t out = isPatternTarget(odr) ? patternTarget(odr, t) : *odr;
+        v = (v & ~0xFF) | (out & 0xFF);
+    }
+
+    for(int c = 0; c < HOST_PWM_CHANNELS; c++) {
+        const PwmChannel &p = pwm[c];
+        if(!p.active)
+            continue;
+
+        bool high = (t - p.start) % p.period < p.duty * p.period;
+        v = high ? v | (1 << c) : v & ~(1 << c);
+    }
+    return v;
+}
+
+uint32_t hostReadPort(volatile uint32_t *port, uint32_t c)
+{
+    uint32_t v;
+
+    if(port == &GPIOB->IDR)
+        v = GPIOB->IDR = inputLevels(cycles);
+    else if(isPatternTarget(port))
+        v = patternTarget(port, cycles);
+    else
+        v = *port;
+
+    cycles += c;
+    return v;
+}
+
+/* Interrupts. The RX interrupt runs on the pty thread with the cpu lock
+   held, which is also taken to mask it. A byte that arrives while masked
+   stays pending until __enable_irq, which runs the handler itself, as
+   the core takes a pending interrupt as soon as it is unmasked. */
+static std::mutex cpu;
+static std::condition_variable received;
+static bool masked;
+static std::deque<uint8_t> rxPending;
+static void (*rxHandler)();
+
+static void deliver()
+{
+    if(!masked && rxHandler && !rxPending.empty())
+        rxHandler();
+}
+
+void __disable_irq()
+{
+    std::lock_guard<std::mutex> lock(cpu);
+    masked = true;
+}
+
+void __enable_irq()
+{
+    std::lock_guard<std::mutex> lock(cpu);
+    masked = false;
+    deliver();
+}
+
+//Only read from the RX handler, which holds the cpu lock
+HostUsartStatus::operator uint32_t() const volatile
+{
+    return rxPending.empty() ? 0 : USART_SR_RXNE;
+}
+
+HostUsartData::operator uint32_t() const volatile
+{
+    if(rxPending.empty())
+        return 0;
+
+    uint8_t v = rxPending.front();
+    rxPending.pop_front();
+    return v;
+}
+
+//Serial port: the pty, and the UART timing on the virtual clock
+static int pty = -1;
+static std::vector<uint8_t> output;
+static uint64_t byteCycles = HOST_CORE_CLOCK / 11520;
+static uint32_t forcedBaud;
+static uint64_t dataFree;       // The data register takes the next byte
+static uint64_t shiftEnd;       // The last byte has left the pin
+
+static void flush()
+{
+    size_t done = 0;
+
+    while(done < output.size()) {
+        ssize_t n = write(pty, &output[done], output.size() - done);
+        if(n > 0) {
+            done += n;
+            continue;
+        }
+        if(n < 0 && errno != EAGAIN && errno != EINTR)
+            break;
+
+        pollfd p = {pty, POLLOUT, 0};
+        if(poll(&p, 1, HOST_WRITE_TIMEOUT) == 0)
+            break;
+    }
+    output.clear();
+}
+
+void __WFI()
+{
+    flush();
+
+    std::unique_lock<std::mutex> lock(cpu);
+    while(rxPending.empty())
+        received.wait(lock);
+}
+
+static void receive()
+{
+    uint8_t b[256];
+
+    while(true) {
+        ssize_t n = read(pty, b, sizeof(b));
+        if(n <= 0) {
+            if(n < 0 && errno == EAGAIN) {
+                pollfd p = {pty, POLLIN, 0};
+                poll(&p, 1, -1);
+            }
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(cpu);
+        rxPending.insert(rxPending.end(), b, b + n);
+        received.notify_all();
+        deliver();
+    }
+}
+
+Serial::Serial(PinName, PinName)
+{
+}
+
+void Serial::baud(int b)
+{
+    byteCycles = 10ULL * HOST_CORE_CLOCK / (forcedBaud ? forcedBaud : b);
+}
+
+int Serial::putc(int c)
+{
+    uint64_t start = max(cycles, shiftEnd);
+    shiftEnd = start + byteCycles;
+    dataFree = start;
+
+    output.push_back(c);
+    if(output.size() >= HOST_OUTPUT_BLOCK)
+        flush();
+    return c;
+}
+
+int Serial::writeable()
+{
+    if(cycles >= dataFree)
+        return 1;
+
+    cycles += HOST_UART_POLL_CYCLES;
+    return 0;
+}
+
+int Serial::readable()
+{
+    std::lock_guard<std::mutex> lock(cpu);
+    return !rxPending.empty();
+}
+
+int Serial::getc()
+{
+    flush();
+
+    std::unique_lock<std::mutex> lock(cpu);
+    while(rxPending.empty())
+        received.wait(lock);
+
+    uint8_t v = rxPending.front();
+    rxPending.pop_front();
+    return v;
+}
+
+int Serial::printf(const char *format, ...)
+{
+    char text[256];
+    va_list args;
+
+    va_start(args, format);
+    int n = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    for(int i = 0; i < n && i < (int) sizeof(text) - 1; i++) {
+        while(!writeable());
+        putc(text[i]);
+    }
+    return n;
+}
+
+void Serial::attach(void (*handler)(), IrqType)
+{
+    std::lock_guard<std::mutex> lock(cpu);
+    rxHandler = handler;
+    deliver();
+}
+
+//PWM outputs of the test signal, on PB0-PB7
+PwmOut::PwmOut(PinName pin)
+{
+    channel = (pin - PB_0) % HOST_PWM_CHANNELS;
+
+    PwmChannel &p = pwm[channel];
+    p.active = true;
+    p.start = cycles;
+    p.period = HOST_CORE_CLOCK / 50;
+    p.duty = 0;
+}
+
+PwmOut::~PwmOut()
+{
+    pwm[channel].active = false;
+}
+
+void PwmOut::period_us(int us)
+{
+    pwm[channel].period = max((uint64_t) 1, (uint64_t) us * (HOST_CORE_CLOCK / 1000000));
+    pwm[channel].start = cycles;
+}
+
+void PwmOut::period_ms(int ms)
+{
+    period_us(ms * 1000);
+}
+
+void PwmOut::write(float duty)
+{
+    pwm[channel].duty = min(1.0f, max(0.0f, duty));
+}
+
+void wait(float s)
+{
+    cycles += (uint64_t) (s * HOST_CORE_CLOCK);
+}
+
+void wait_ms(int ms)
+{
+    cycles += (uint64_t) ms * (HOST_CORE_CLOCK / 1000);
+}
+
+void wait_us(int us)
+{
+    cycles += (uint64_t) us * (HOST_CORE_CLOCK / 1000000);
+}
+
+/* Benchmark client: ID queries for the command path, then captures and
+   window readbacks of the full buffer for the upload path. */
+#define BENCH_QUERIES 2000
+#define BENCH_CAPTURES 16
+#define BENCH_SAMPLES 32768
+#define BENCH_TIMEOUT 10000
+
+static double seconds()
+{
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void send(int fd, const uint8_t *b, size_t n)
+{
+    if(write(fd, b, n) != (ssize_t) n) {
+        perror("benchmark write");
+        exit(2);
+    }
+}
+
+static void command(int fd, uint8_t op, uint32_t parameter)
+{
+    uint8_t b[5] = {op, (uint8_t) parameter, (uint8_t) (parameter >> 8), (uint8_t) (parameter >> 16),
+                    (uint8_t) (parameter >> 24)};
+    send(fd, b, 5);
+}
+
+static void receiveAll(int fd, uint8_t *b, size_t n)
+{
+    size_t done = 0;
+
+    while(done < n) {
+        pollfd p = {fd, POLLIN, 0};
+        if(poll(&p, 1, BENCH_TIMEOUT) <= 0) {
+            fprintf(stderr, "benchmark: timeout, %zu of %zu bytes\n", done, n);
+            exit(2);
+        }
+        ssize_t r = read(fd, b + done, n - done);
+        if(r > 0)
+            done += r;
+    }
+}
+
+static uint32_t receiveSize(int fd)
+{
+    uint8_t b[4];
+    receiveAll(fd, b, 4);
+    return (b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+static void report(const char *label, uint32_t count, double t, uint64_t bytes, uint64_t virtualCycles)
+{
+    printf("%-14s %6u %9.3f s %10.0f /s %8.2f MB/s  (board %.2f s)\n", label, count, t, count / t,
+           bytes / t / 1e6, (double) virtualCycles / HOST_CORE_CLOCK);
+}
+
+static void benchmark(const char *name)
+{
+    //Bytes sent before the firmware is up are flushed, as on the board
+    usleep(200000);
+
+    int fd = open(name, O_RDWR | O_NOCTTY);
+    if(fd < 0) {
+        perror(name);
+        exit(1);
+    }
+
+    termios tio;
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(fd, TCSANOW, &tio);
+
+    static uint8_t reset[5] = {0, 0, 0, 0, 0};
+    send(fd, reset, 5);
+
+    uint8_t id[4];
+    uint64_t c0 = cycles;
+    double t0 = seconds();
+    for(int i = 0; i < BENCH_QUERIES; i++) {
+        static const uint8_t query = 0x02;
+        send(fd, &query, 1);
+        receiveAll(fd, id, 4);
+        if(memcmp(id, "1ALS", 4)) {
+            fprintf(stderr, "benchmark: bad ID reply\n");
+            exit(2);
+        }
+    }
+    report("id queries", BENCH_QUERIES, seconds() - t0, 4 * BENCH_QUERIES, cycles - c0);
+
+    //10Mhz, so the fastest kernel
+    command(fd, 0x80, 9);
+    command(fd, 0x81, ((BENCH_SAMPLES / 4 - 1) << 16) | (BENCH_SAMPLES / 4 - 1));
+
+    static uint8_t samples[BENCH_SAMPLES];
+    c0 = cycles;
+    t0 = seconds();
+    for(int i = 0; i < BENCH_CAPTURES; i++) {
+        static const uint8_t arm = 0x01;
+        send(fd, &arm, 1);
+        receiveAll(fd, samples, BENCH_SAMPLES);
+    }
+    report("captures", BENCH_CAPTURES, seconds() - t0, (uint64_t) BENCH_CAPTURES * BENCH_SAMPLES, cycles - c0);
+
+    static const char *modes[] = {"window raw", "window rle", "window lz"};
+    command(fd, 0xA8, 0);
+    for(uint8_t mode = 0; mode < 3; mode++) {
+        std::vector<uint8_t> payload;
+        c0 = cycles;
+        t0 = seconds();
+        for(int i = 0; i < BENCH_CAPTURES; i++) {
+            command(fd, 0xA9, mode << 16);
+            payload.resize(receiveSize(fd));
+            receiveAll(fd, payload.data(), payload.size());
+        }
+        report(modes[mode], BENCH_CAPTURES, seconds() - t0, (uint64_t) BENCH_CAPTURES * BENCH_SAMPLES, cycles - c0);
+    }
+
+    exit(0);
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: nucleosim [-i file] [-r rate] [-m name=bit]... [-w] [-u baud] [-l link] [-b]\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *file = NULL;
+    const char *link = NULL;
+    uint32_t rate = 1000000;
+    bool bench = false;
+    std::map<std::string, int> mapping;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-i") && i + 1 < argc)
+            file = argv[++i];
+        else if(!strcmp(argv[i], "-r") && i + 1 < argc)
+            rate = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-m") && i + 1 < argc) {
+            const char *eq = strchr(argv[++i], '=');
+            if(eq == NULL)
+                usage();
+            mapping[std::string(argv[i], eq - argv[i])] = atoi(eq + 1);
+        } else if(!strcmp(argv[i], "-w"))
+            wired = true;
+        else if(!strcmp(argv[i], "-u") && i + 1 < argc)
+            forcedBaud = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-l") && i + 1 < argc)
+            link = argv[++i];
+        else if(!strcmp(argv[i], "-b"))
+            bench = true;
+        else
+            usage();
+    }
+
+    if(rate == 0)
+        usage();
+
+    size_t n = file ? strlen(file) : 0;
+    bool vcd = file && (!strcmp(file, "-") || (n > 4 && !strcmp(file + n - 4, ".vcd")));
+
+    if(file) {
+        FILE *f = strcmp(file, "-") ? fopen(file, "rb") : stdin;
+        if(f == NULL) {
+            perror(file);
+            return 1;
+        }
+        if(vcd)
+            hostSetInput(new VcdInput(f, rate, mapping));
+        else
+            hostSetInput(new FileInput(f, rate));
+    } else
+        hostSetInput(new CounterInput(rate));
+
+    //The slave stays open here, so that the master never reads EIO between clients
+    int slave;
+    char name[128];
+    if(openpty(&pty, &slave, name, NULL, NULL) != 0) {
+        perror("openpty");
+        return 1;
+    }
+
+    termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    fcntl(pty, F_SETFL, fcntl(pty, F_GETFL) | O_NONBLOCK);
+
+    if(link) {
+        unlink(link);
+        if(symlink(name, link) != 0) {
+            perror(link);
+            return 1;
+        }
+    }
+
+    if(bench) {
+        std::thread(benchmark, name).detach();
+    } else {
+        printf("%s\n", link ? link : name);
+        fflush(stdout);
+    }
+
+    std::thread(receive).detach();
+    return firmwareMain();
+}
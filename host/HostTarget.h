@@ -0,0 +1,102 @@
+#ifndef HOSTTARGET_H
+#define HOSTTARGET_H
+#include "mbed.h"
+#include <string>
+#include <map>
+
+/* Host simulation of the board (make host).
+
+   Time is virtual: a core cycle counter that only moves when the
+   firmware reads the port, the cycle counter or the UART status, or
+   waits. Captures are therefore the same on every run for the same
+   input, whatever the load of the host. The input port (GPIOB->IDR) is
+   sampled from a HostInput at the virtual time of each read, counted
+   from the first read. */
+
+//Virtual time, in core cycles
+uint64_t hostNow();
+void hostAdvance(uint64_t cycles);
+
+//Port read of the firmware, then `cycles` pass (see PORT_READ)
+uint32_t hostReadPort(volatile uint32_t *port, uint32_t cycles);
+
+//Levels of PB0-PB15, asked for at non decreasing times
+class HostInput{
+
+public:
+    virtual ~HostInput() {}
+    virtual uint32_t read(uint64_t cycle) = 0;
+};
+
+//Raw file, one byte per sample at a fixed rate, looped at the end
+class FileInput : public HostInput{
+
+public:
+    FileInput(FILE *, uint32_t rate);
+    ~FileInput();
+
+    uint32_t read(uint64_t cycle);
+
+private:
+    FILE *file;
+    uint32_t rate;
+    uint64_t length;
+    uint64_t first;         // Index of block[0] in the file
+    uint32_t filled;
+    uint8_t block[4096];
+};
+
+//Binary counter at a fixed rate: channel n toggles every 2^n samples
+class CounterInput : public HostInput{
+
+public:
+    CounterInput(uint32_t rate);
+
+    uint32_t read(uint64_t cycle);
+
+private:
+    uint32_t rate;
+};
+
+/* Value changes of a VCD file, sampled at a fixed rate. The file is
+   parsed as the time advances, so a dump of any length takes the same
+   memory, and it can be a pipe (sigrok-cli -O vcd). The last state holds
+   after the end. Signals go to PB0-PB15 in declaration order, or to the
+   bits given in the mapping. */
+class VcdInput : public HostInput{
+
+public:
+    VcdInput(FILE *, uint32_t rate, const std::map<std::string, int> &mapping);
+    ~VcdInput();
+
+    uint32_t read(uint64_t cycle);
+
+private:
+    struct Signal{
+        int bit;
+        int width;
+    };
+
+    bool token();
+    void skipDeclaration();
+    void header(const std::map<std::string, int> &mapping);
+    void step();
+    void change(char value, const std::string &id);
+    void change(const std::string &value, const std::string &id);
+
+    FILE *file;
+    uint32_t rate;
+    uint64_t scale;         // Timescale, in 1 / units seconds
+    uint64_t units;
+    uint64_t next;          // Timestamp of the changes not applied yet
+    bool finished;
+    uint32_t state;
+    std::map<std::string, Signal> signals;
+    std::string text;       // Last token
+};
+
+//Sample index at the given time, for inputs at a fixed rate
+uint64_t hostSampleIndex(uint64_t cycle, uint32_t rate);
+
+void hostSetInput(HostInput *);
+#endif
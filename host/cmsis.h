@@ -0,0 +1,34 @@
+#ifndef HOST_CMSIS_H
+#define HOST_CMSIS_H
+#include <stdint.h>
+
+/* Cortex-M intrinsics used by the firmware, for the host build. Masking
+   interrupts holds back the simulated RX interrupt, and WFI sleeps until
+   a byte arrives from the serial port. */
+
+void __disable_irq();
+void __enable_irq();
+void __WFI();
+
+inline uint32_t __CLZ(uint32_t v)
+{
+    return v ? __builtin_clz(v) : 32;
+}
+
+inline uint32_t __UADD8(uint32_t a, uint32_t b)
+{
+    uint32_t r = 0;
+    for(int i = 0; i < 32; i += 8)
+        r |= ((((a >> i) & 0xFF) + ((b >> i) & 0xFF)) & 0xFF) << i;
+    return r;
+}
+
+inline uint32_t __USADA8(uint32_t a, uint32_t b, uint32_t c)
+{
+    for(int i = 0; i < 32; i += 8) {
+        int d = (int) ((a >> i) & 0xFF) - (int) ((b >> i) & 0xFF);
+        c += d < 0 ? -d : d;
+    }
+    return c;
+}
+#endif
@@ -0,0 +1,251 @@
+#ifndef HOST_MBED_H
+#define HOST_MBED_H
+
+/* The part of mbed and of the STM32F4 CMSIS headers used by the firmware,
+   for the host build (make host). Peripherals are plain register blocks,
+   except for the few that the simulation needs to see: the cycle counter,
+   the CRC unit, USART2 and the DMA enables. The input port is read
+   through PORT_READ (SampleKernel.h), which samples host/HostTarget.cpp. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "cmsis.h"
+
+using namespace std;
+
+#define HOST_CORE_CLOCK 84000000
+
+extern uint32_t SystemCoreClock;
+
+//Simulated registers
+struct HostCycleCounter{
+    operator uint32_t() const volatile;
+    void operator=(uint32_t) volatile;
+};
+
+struct HostCrcData{
+    operator uint32_t() const volatile;
+    void operator=(uint32_t) volatile;
+};
+
+struct HostCrcControl{
+    void operator=(uint32_t) volatile;
+};
+
+struct HostUsartStatus{
+    operator uint32_t() const volatile;
+};
+
+struct HostUsartData{
+    operator uint32_t() const volatile;
+};
+
+//Tracks when a stream gets enabled, the pattern DMA is replayed from there
+struct HostDmaControl{
+    uint32_t value;
+    uint64_t enabledAt;
+
+    operator uint32_t() const volatile { return value; }
+    void operator=(uint32_t) volatile;
+    void operator|=(uint32_t v) volatile { *this = value | v; }
+    void operator&=(uint32_t v) volatile { *this = value & v; }
+};
+
+//Register blocks
+typedef struct {
+    volatile uint32_t MODER, OTYPER, OSPEEDR, PUPDR, IDR, ODR, BSRR, LCKR, AFR[2];
+} GPIO_TypeDef;
+
+typedef struct {
+    volatile uint32_t CR1, CR2, SMCR, DIER, SR, EGR, CCMR1, CCMR2, CCER, CNT, PSC, ARR, RCR, CCR1, CCR2, CCR3, CCR4;
+} TIM_TypeDef;
+
+typedef struct {
+    HostDmaControl CR;
+    volatile uint32_t NDTR;
+    volatile uintptr_t PAR, M0AR, M1AR;
+    volatile uint32_t FCR;
+} DMA_Stream_TypeDef;
+
+typedef struct {
+    volatile uint32_t LISR, HISR, LIFCR, HIFCR;
+} DMA_TypeDef;
+
+typedef struct {
+    volatile uint32_t AHB1ENR, APB1ENR, APB2ENR, CFGR;
+} RCC_TypeDef;
+
+typedef struct {
+    volatile uint32_t ACR;
+} FLASH_TypeDef;
+
+typedef struct {
+    HostCrcData DR;
+    HostCrcControl CR;
+} CRC_TypeDef;
+
+typedef struct {
+    HostUsartStatus SR;
+    HostUsartData DR;
+} USART_TypeDef;
+
+typedef struct {
+    volatile uint32_t CTRL;
+    HostCycleCounter CYCCNT;
+} DWT_Type;
+
+extern GPIO_TypeDef hostGPIOB, hostGPIOC;
+extern TIM_TypeDef hostTIM1, hostTIM2, hostTIM3, hostTIM4;
+extern DMA_Stream_TypeDef hostDMA2_Stream1, hostDMA2_Stream5;
+extern DMA_TypeDef hostDMA2;
+extern RCC_TypeDef hostRCC;
+extern FLASH_TypeDef hostFLASH;
+extern CRC_TypeDef hostCRC;
+extern USART_TypeDef hostUSART2;
+extern DWT_Type hostDWT;
+
+#define GPIOB (&hostGPIOB)
+#define GPIOC (&hostGPIOC)
+#define TIM1 (&hostTIM1)
+#define TIM2 (&hostTIM2)
+#define TIM3 (&hostTIM3)
+#define TIM4 (&hostTIM4)
+#define DMA2 (&hostDMA2)
+#define DMA2_Stream1 (&hostDMA2_Stream1)
+#define DMA2_Stream5 (&hostDMA2_Stream5)
+#define RCC (&hostRCC)
+#define FLASH (&hostFLASH)
+#define CRC (&hostCRC)
+#define USART2 (&hostUSART2)
+#define DWT (&hostDWT)
+
+#define SET_BIT(REG, BIT) ((REG) |= (BIT))
+#define CLEAR_BIT(REG, BIT) ((REG) &= ~(BIT))
+#define READ_BIT(REG, BIT) ((REG) & (BIT))
+
+//Register bits, values from stm32f401xe.h
+#define CRC_CR_RESET ((uint32_t)0x01)
+
+#define DMA_HIFCR_CFEIF5 ((uint32_t)0x00000040)
+#define DMA_HIFCR_CDMEIF5 ((uint32_t)0x00000100)
+#define DMA_HIFCR_CTEIF5 ((uint32_t)0x00000200)
+#define DMA_HIFCR_CHTIF5 ((uint32_t)0x00000400)
+#define DMA_HIFCR_CTCIF5 ((uint32_t)0x00000800)
+#define DMA_LIFCR_CFEIF1 ((uint32_t)0x00000040)
+#define DMA_LIFCR_CDMEIF1 ((uint32_t)0x00000100)
+#define DMA_LIFCR_CTEIF1 ((uint32_t)0x00000200)
+#define DMA_LIFCR_CHTIF1 ((uint32_t)0x00000400)
+#define DMA_LIFCR_CTCIF1 ((uint32_t)0x00000800)
+#define DMA_LISR_HTIF1 ((uint32_t)0x00000400)
+#define DMA_LISR_TCIF1 ((uint32_t)0x00000800)
+
+#define DMA_SxCR_EN ((uint32_t)0x00000001)
+#define DMA_SxCR_HTIE ((uint32_t)0x00000008)
+#define DMA_SxCR_TCIE ((uint32_t)0x00000010)
+#define DMA_SxCR_DIR_0 ((uint32_t)0x00000040)
+#define DMA_SxCR_CIRC ((uint32_t)0x00000100)
+#define DMA_SxCR_MINC ((uint32_t)0x00000400)
+#define DMA_SxCR_PL ((uint32_t)0x00030000)
+#define DMA_SxCR_CHSEL_0 ((uint32_t)0x02000000)
+
+#define FLASH_ACR_ICEN ((uint32_t)0x00000200)
+#define FLASH_ACR_ICRST ((uint32_t)0x00000800)
+
+#define RCC_AHB1ENR_GPIOBEN ((uint32_t)0x00000002)
+#define RCC_AHB1ENR_GPIOCEN ((uint32_t)0x00000004)
+#define RCC_AHB1ENR_CRCEN ((uint32_t)0x00001000)
+#define RCC_AHB1ENR_DMA2EN ((uint32_t)0x00400000)
+#define RCC_APB1ENR_TIM2EN ((uint32_t)0x00000001)
+#define RCC_APB1ENR_TIM3EN ((uint32_t)0x00000002)
+#define RCC_APB1ENR_TIM4EN ((uint32_t)0x00000004)
+#define RCC_APB2ENR_TIM1EN ((uint32_t)0x00000001)
+#define RCC_CFGR_PPRE2_2 ((uint32_t)0x00008000)
+
+#define TIM_CR1_CEN ((uint32_t)0x0001)
+#define TIM_CR1_URS ((uint32_t)0x0004)
+#define TIM_CCMR1_CC1S_0 ((uint32_t)0x0001)
+#define TIM_CCMR1_CC2S_0 ((uint32_t)0x0100)
+#define TIM_DIER_UDE ((uint32_t)0x0100)
+#define TIM_DIER_CC1DE ((uint32_t)0x0200)
+#define TIM_EGR_UG ((uint32_t)0x01)
+#define TIM_SMCR_SMS ((uint32_t)0x0007)
+#define TIM_SMCR_TS ((uint32_t)0x0070)
+#define TIM_SMCR_TS_0 ((uint32_t)0x0010)
+#define TIM_SMCR_TS_1 ((uint32_t)0x0020)
+#define TIM_SMCR_TS_2 ((uint32_t)0x0040)
+
+#define USART_SR_RXNE ((uint32_t)0x0020)
+
+typedef enum {
+    DMA1_Stream5_IRQn = 16,
+    USART2_IRQn = 38,
+    DMA2_Stream1_IRQn = 57
+} IRQn_Type;
+
+//Only the simulated peripherals raise interrupts, the others are left alone
+inline void NVIC_SetVector(IRQn_Type, uintptr_t) {}
+inline void NVIC_EnableIRQ(IRQn_Type) {}
+inline void NVIC_DisableIRQ(IRQn_Type) {}
+
+uint32_t HAL_RCC_GetPCLK2Freq();
+
+//mbed API
+typedef enum {
+    PB_0 = 0x10, PB_1, PB_2, PB_3, PB_4, PB_5, PB_6, PB_7,
+    LED2 = 0x05,
+    USBTX = 0x02,
+    USBRX = 0x03
+} PinName;
+
+class Serial{
+public:
+    enum IrqType { RxIrq = 0, TxIrq };
+
+    Serial(PinName, PinName);
+
+    void baud(int);
+    int putc(int);
+    int getc();
+    int readable();
+    int writeable();
+    int printf(const char *, ...);
+    void attach(void (*)(), IrqType = RxIrq);
+};
+
+class DigitalOut{
+public:
+    DigitalOut(PinName) : value(0) {}
+
+    DigitalOut &operator=(int v) { value = v; return *this; }
+    operator int() { return value; }
+
+private:
+    int value;
+};
+
+//Drives its bit of the input port, as the wires of the test signal do
+class PwmOut{
+public:
+    PwmOut(PinName);
+    ~PwmOut();
+
+    void period_us(int);
+    void period_ms(int);
+    void write(float);
+
+private:
+    uint8_t channel;
+};
+
+void wait(float);
+void wait_ms(int);
+void wait_us(int);
+
+//The firmware main runs from the host main, after the options
+#define main firmwareMain
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+#include "mbed.h"
+#include "ActivityMonitor.h"
+#include <algorithm>
+
+#define MONITOR_DMA_CHANNEL 6    // TIM1_CH1 on DMA2 Stream1
+
+#define SUMP_ORIGINAL_FREQ  (100000000)
+
+__attribute__((aligned(4))) uint8_t monitor_buffer[MONITOR_BUFFER_SIZE];
+
+static ActivityMonitor *activeMonitor = NULL;
+
+ActivityMonitor::ActivityMonitor(volatile uint32_t *p)
+{
+    port = p;
+    frequency = 0;
+    overruns = 0;
+    activeMonitor = this;
+
+    SET_BIT(RCC->AHB1ENR, RCC_AHB1ENR_GPIOBEN | RCC_AHB1ENR_DMA2EN);
+    SET_BIT(RCC->APB2ENR, RCC_APB2ENR_TIM1EN);
+
+    NVIC_SetVector(DMA2_Stream1_IRQn, (uintptr_t) &ActivityMonitor::irq);
+}
+
+bool ActivityMonitor::isRunning()
+{
+    return (DMA2_Stream1->CR & DMA_SxCR_EN) != 0;
+}
+
+uint32_t ActivityMonitor::getFrequency()
+{
+    return frequency;
+}
+
+uint32_t ActivityMonitor::getOverruns()
+{
+    return overruns;
+}
+
+//Same meaning as the SUMP divider: rate = 100Mhz / (divider + 1)
+void ActivityMonitor::start(uint32_t divider)
+{
+    stop();
+
+    uint32_t clock = HAL_RCC_GetPCLK2Freq();
+
+    //Timers run at twice the APB clock when it is divided
+    if(RCC->CFGR & RCC_CFGR_PPRE2_2)
+        clock *= 2;
+
+    uint64_t cycles = ((uint64_t) clock * (divider + 1)) / SUMP_ORIGINAL_FREQ;
+    uint64_t minCycles = clock / MONITOR_MAX_FREQUENCY;
+
+    if(cycles < minCycles)
+        cycles = minCycles;
+
+    uint64_t psc = (cycles - 1) / 65536;
+    if(psc > 0xFFFF)
+        psc = 0xFFFF;
+    uint32_t reload = min((uint64_t) 65536, cycles / (psc + 1));
+
+    frequency = clock / ((psc + 1) * reload);
+    overruns = 0;
+    position = 0;
+    previous = 0;
+
+    for(uint8_t c = 0; c < MONITOR_CHANNELS; c++) {
+        ChannelActivity &ch = channels[c];
+        ch.edges = 0;
+        ch.highSamples = 0;
+        ch.lastEdge = 0;
+        ch.minHigh = ch.minLow = 0xFFFFFFFF;
+        ch.maxHigh = ch.maxLow = 0;
+    }
+
+    TIM1->CR1 = TIM_CR1_URS;
+    TIM1->PSC = psc;
+    TIM1->ARR = reload - 1;
+    TIM1->CCMR1 = 0;
+    TIM1->CCR1 = 0;
+    TIM1->EGR = TIM_EGR_UG;
+    TIM1->SR = 0;
+
+    DMA2->LIFCR = DMA_LIFCR_CTCIF1 | DMA_LIFCR_CHTIF1 | DMA_LIFCR_CTEIF1 | DMA_LIFCR_CDMEIF1 | DMA_LIFCR_CFEIF1;
+    DMA2_Stream1->PAR = (uintptr_t) port;
+    DMA2_Stream1->M0AR = (uintptr_t) monitor_buffer;
+    DMA2_Stream1->NDTR = MONITOR_BUFFER_SIZE;
+    DMA2_Stream1->FCR = 0;      // Direct mode, byte to byte
+    DMA2_Stream1->CR = (MONITOR_DMA_CHANNEL * DMA_SxCR_CHSEL_0) | DMA_SxCR_MINC | DMA_SxCR_CIRC | DMA_SxCR_HTIE | DMA_SxCR_TCIE;
+    DMA2_Stream1->CR |= DMA_SxCR_EN;
+
+    NVIC_EnableIRQ(DMA2_Stream1_IRQn);
+
+    TIM1->DIER = TIM_DIER_CC1DE;
+    TIM1->CR1 |= TIM_CR1_CEN;
+}
+
+void ActivityMonitor::stop()
+{
+    if(!isRunning())
+        return;
+
+    TIM1->CR1 &= ~TIM_CR1_CEN;
+    TIM1->DIER = 0;
+
+    DMA2_Stream1->CR &= ~DMA_SxCR_EN;
+    while(DMA2_Stream1->CR & DMA_SxCR_EN);
+
+    NVIC_DisableIRQ(DMA2_Stream1_IRQn);
+}
+
+void ActivityMonitor::getStatistics(ChannelActivity *out, uint64_t &samples)
+{
+    __disable_irq();
+    for(uint8_t c = 0; c < MONITOR_CHANNELS; c++)
+        out[c] = channels[c];
+    samples = position;
+    __enable_irq();
+}
+
+//Both flags set means a half was overwritten before being processed
+void ActivityMonitor::irq()
+{
+    uint32_t status = DMA2->LISR;
+    DMA2->LIFCR = DMA_LIFCR_CTCIF1 | DMA_LIFCR_CHTIF1 | DMA_LIFCR_CTEIF1 | DMA_LIFCR_CDMEIF1 | DMA_LIFCR_CFEIF1;
+
+    const uint32_t *half = (const uint32_t *) monitor_buffer;
+    uint32_t words = MONITOR_BUFFER_SIZE / 8;
+
+    if((status & DMA_LISR_HTIF1) && (status & DMA_LISR_TCIF1))
+        activeMonitor->overruns++;
+
+    if(status & DMA_LISR_HTIF1)
+        activeMonitor->process(half, words);
+    if(status & DMA_LISR_TCIF1)
+        activeMonitor->process(half + words, words);
+}
+
+/* Four samples per word, oldest in the low byte. XOR with the word
+   shifted by one sample leaves bit c set in the byte of every edge of
+   channel c. High time is summed four samples at a time in byte lanes
+   (UADD8) and folded (USADA8) before a lane can overflow. Only words with
+   edges are walked sample by sample, so idle lines cost a few cycles per
+   word. */
+void ActivityMonitor::process(const uint32_t *samples, uint32_t words)
+{
+    //The very first sample is compared with itself
+    if(position == 0)
+        previous = samples[0] << 24;
+
+    while(words > 0) {
+        uint32_t n = min(words, (uint32_t) 255);
+        uint32_t lanes[MONITOR_CHANNELS] = {0};
+
+        for(uint32_t i = 0; i < n; i++, position += 4) {
+            uint32_t w = samples[i];
+            uint32_t t = w ^ ((w << 8) | (previous >> 24));
+            previous = w;
+
+            for(uint8_t c = 0; c < MONITOR_CHANNELS; c++)
+                lanes[c] = __UADD8(lanes[c], (w >> c) & 0x01010101);
+
+            if(t == 0)
+                continue;
+
+            for(uint8_t b = 0; b < 4; b++) {
+                uint8_t changed = t >> (b * 8);
+                uint8_t level = w >> (b * 8);
+                uint64_t at = position + b;
+
+                while(changed) {
+                    uint8_t c = __builtin_ctz(changed);
+                    changed &= changed - 1;
+
+                    ChannelActivity &ch = channels[c];
+
+                    //The pulse before the first edge started before the capture
+                    if(ch.edges > 0) {
+                        uint32_t width = min(at - ch.lastEdge, (uint64_t) 0xFFFFFFFF);
+
+                        if(level & (1 << c)) {
+                            ch.minLow = min(ch.minLow, width);
+                            ch.maxLow = max(ch.maxLow, width);
+                        }else {
+                            ch.minHigh = min(ch.minHigh, width);
+                            ch.maxHigh = max(ch.maxHigh, width);
+                        }
+                    }
+
+                    ch.lastEdge = at;
+                    ch.edges++;
+                }
+            }
+        }
+
+        for(uint8_t c = 0; c < MONITOR_CHANNELS; c++)
+            channels[c].highSamples = __USADA8(lanes[c], 0, 0) + channels[c].highSamples;
+
+        samples += n;
+        words -= n;
+    }
+}
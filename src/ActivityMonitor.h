@@ -0,0 +1,57 @@
+#ifndef ACTIVITYMONITOR_H
+#define ACTIVITYMONITOR_H
+#include "mbed.h"
+
+#define MONITOR_CHANNELS 8
+#define MONITOR_MAX_FREQUENCY 1000000
+
+//Circular capture buffer, processed one half at a time
+#define MONITOR_BUFFER_SIZE 4096
+
+struct ChannelActivity{
+    uint64_t edges;
+    uint64_t highSamples;
+    uint64_t lastEdge;      // Sample index of the last edge
+    uint32_t minHigh;       // Pulse widths, in samples
+    uint32_t maxHigh;
+    uint32_t minLow;
+    uint32_t maxLow;
+};
+
+/* Background statistics of the 8 channels over long periods.
+
+   GPIOB is captured continuously into a circular buffer by DMA2 Stream1,
+   requested by TIM1 compare 1 events. Each half of the buffer is reduced
+   in the DMA interrupt while the other half is being filled, so the
+   statistics can be read at any time without stopping the capture.
+   TIM1 is shared with the pattern generator, so only one of them can
+   run at a time. */
+class ActivityMonitor{
+
+public:
+
+    ActivityMonitor(volatile uint32_t *port);
+
+    void start(uint32_t divider);
+    void stop();
+    bool isRunning();
+
+    //Consistent copy of the statistics, taken with interrupts off
+    void getStatistics(ChannelActivity *channels, uint64_t &samples);
+
+    uint32_t getFrequency();
+    uint32_t getOverruns();
+
+private:
+    static void irq();
+    void process(const uint32_t *samples, uint32_t words);
+
+    volatile uint32_t *port;
+    uint32_t frequency;
+    uint32_t overruns;
+
+    uint64_t position;
+    uint32_t previous;
+    ChannelActivity channels[MONITOR_CHANNELS];
+};
+#endif
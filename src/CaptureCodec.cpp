@@ -0,0 +1,186 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+#include "CaptureCodec.h"
+
+#define EMPTY 0xFFFF
+
+CaptureCodec::CaptureCodec()
+{
+    for(uint32_t i = 0; i < CODEC_HASH_SIZE; i++)
+        table[i] = EMPTY;
+}
+
+static inline uint8_t delta(const uint8_t *samples, uint32_t i, uint32_t step)
+{
+    return i ? samples[i * step] ^ samples[(i - 1) * step] : samples[0];
+}
+
+static inline uint32_t hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - CODEC_HASH_BITS);
+}
+
+//Returns the coded size
+static uint32_t literals(const uint8_t *samples, uint32_t from, uint32_t to, uint32_t step, CodecOutput out, void *context)
+{
+    uint32_t size = 0;
+
+    while(from < to) {
+        uint32_t n = to - from < CODEC_MAX_LITERALS ? to - from : CODEC_MAX_LITERALS;
+
+        out(context, n - 1);
+        for(uint32_t i = from; i < from + n; i++)
+            out(context, delta(samples, i, step));
+        from += n;
+        size += n + 1;
+    }
+    return size;
+}
+
+uint32_t CaptureCodec::encode(const uint8_t *samples, uint32_t count, uint32_t step, CodecOutput out, void *context)
+{
+    uint32_t size = 0;
+    uint32_t pending = 0;
+    uint32_t i = 0;
+
+    //Positions are uint16, EMPTY is never a valid one
+    if(count > EMPTY)
+        count = EMPTY;
+
+    for(uint32_t h = 0; h < CODEC_HASH_SIZE; h++)
+        table[h] = EMPTY;
+
+    while(i < count) {
+        uint32_t length = 0;
+        uint32_t candidate = EMPTY;
+
+        if(i + CODEC_MIN_MATCH <= count) {
+            uint32_t key = delta(samples, i, step) | (delta(samples, i + 1, step) << 8) | (delta(samples, i + 2, step) << 16);
+            uint32_t h = hash(key);
+            candidate = table[h];
+            table[h] = i;
+
+            if(candidate != EMPTY && i - candidate <= CODEC_MAX_DISTANCE)
+                while(i + length < count && length < CODEC_MAX_MATCH &&
+                      delta(samples, candidate + length, step) == delta(samples, i + length, step))
+                    length++;
+        }
+
+        //An edge and the steady samples after it, the RLE case
+        uint32_t hold = 0;
+        while(i + 1 + hold < count && hold < CODEC_MAX_MATCH && delta(samples, i + 1 + hold, step) == 0)
+            hold++;
+
+        //Steady samples past a hold token continue as a distance 1 match
+        if(i > 0 && delta(samples, i, step) == 0 && delta(samples, i - 1, step) == 0 && hold + 1 > length) {
+            length = hold + 1 < CODEC_MAX_MATCH ? hold + 1 : CODEC_MAX_MATCH;
+            candidate = i - 1;
+        }
+        if(hold > CODEC_MAX_HOLD)
+            hold = CODEC_MAX_HOLD;
+
+        if(length >= CODEC_MIN_MATCH && length > hold + 2) {
+            size += literals(samples, pending, i, step, out, context);
+
+            uint32_t l = length - CODEC_MIN_MATCH;
+            uint32_t distance = i - candidate;
+            if(l < 0x20) {
+                out(context, 0xC0 | l);
+                size += 3;
+            }else {
+                out(context, 0xE0 | (l >> 8));
+                out(context, l & 0xFF);
+                size += 4;
+            }
+            out(context, distance & 0xFF);
+            out(context, distance >> 8);
+
+            i += length;
+            pending = i;
+        }else if(hold > 0) {
+            size += literals(samples, pending, i, step, out, context);
+
+            if(hold < 0x3F) {
+                out(context, 0x80 | hold);
+                size += 2;
+            }else {
+                out(context, 0xBF);
+                out(context, hold - 0x3F);
+                size += 3;
+            }
+            out(context, delta(samples, i, step));
+
+            i += hold + 1;
+            pending = i;
+        }else
+            i++;
+    }
+
+    return size + literals(samples, pending, count, step, out, context);
+}
+
+uint32_t CaptureCodec::decode(const uint8_t *in, uint32_t length, uint8_t *out, uint32_t capacity)
+{
+    uint32_t p = 0;
+    uint32_t o = 0;
+
+    while(p < length) {
+        uint8_t c = in[p++];
+
+        if(c < 0x80) {
+            uint32_t n = c + 1;
+            if(p + n > length || o + n > capacity)
+                break;
+            for(uint32_t k = 0; k < n; k++)
+                out[o++] = in[p++];
+            continue;
+        }
+
+        if((c & 0x40) == 0) {
+            uint32_t n = (c & 0x3F) + 1;
+            if(n == 0x40 && p < length)
+                n += in[p++];
+            if(p >= length || o + n > capacity)
+                break;
+            out[o++] = in[p++];
+            for(uint32_t k = 1; k < n; k++)
+                out[o++] = 0;
+            continue;
+        }
+
+        uint32_t l = c & 0x1F;
+        if(c & 0x20) {
+            if(p >= length)
+                break;
+            l = (l << 8) | in[p++];
+        }
+        if(p + 2 > length)
+            break;
+
+        uint32_t n = l + CODEC_MIN_MATCH;
+        uint32_t distance = in[p] | (in[p + 1] << 8);
+        p += 2;
+
+        if(distance == 0 || distance > o || o + n > capacity)
+            break;
+        for(uint32_t k = 0; k < n; k++, o++)
+            out[o] = out[o - distance];
+    }
+
+    //Back from deltas to samples
+    for(uint32_t i = 1; i < o; i++)
+        out[i] ^= out[i - 1];
+    return o;
+}
@@ -0,0 +1,48 @@
+#ifndef CAPTURECODEC_H
+#define CAPTURECODEC_H
+#include <stdint.h>
+
+#define CODEC_MIN_MATCH 3
+#define CODEC_MAX_MATCH (CODEC_MIN_MATCH + 0x1FFF)
+#define CODEC_MAX_HOLD (0x3F + 0xFF)
+#define CODEC_MAX_LITERALS 128
+#define CODEC_MAX_DISTANCE 0xFFFF
+
+//Match finder, 2 bytes per entry
+#define CODEC_HASH_BITS 10
+#define CODEC_HASH_SIZE (1 << CODEC_HASH_BITS)
+
+typedef void (*CodecOutput)(void *context, uint8_t);
+
+/* Delta + LZ codec for the capture upload.
+
+   Every sample is replaced by its XOR with the previous one (the first
+   with 0), so steady lines become zeros and a toggling clock a constant,
+   and the deltas are coded as:
+
+     0nnnnnnn                 n + 1 literal deltas follow
+     10hhhhhh v               delta v, then h zero deltas (an RLE run)
+     10111111 h v             delta v, then h + 63 zero deltas
+     110lllll d d             match of l + 3 deltas, distance (uint16)
+     111lllll l d d           match of l + 3 deltas, 13 bit length
+
+   Matches may overlap their source, a distance 1 match is a run. The
+   only state is a hash table of the last position of every 3 delta
+   sequence, CODEC_HASH_SIZE entries. Plain C++ without mbed, so that the
+   host tools can build it too. */
+class CaptureCodec{
+
+public:
+
+    CaptureCodec();
+
+    //Codes samples[0], samples[step], ... below count, returns the coded size
+    uint32_t encode(const uint8_t *samples, uint32_t count, uint32_t step, CodecOutput out, void *context);
+
+    //Returns the number of samples decoded, stops at the first malformed token
+    static uint32_t decode(const uint8_t *in, uint32_t length, uint8_t *out, uint32_t capacity);
+
+private:
+    uint16_t table[CODEC_HASH_SIZE];
+};
+#endif
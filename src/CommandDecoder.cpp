@@ -0,0 +1,71 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+#include "CommandDecoder.h"
+
+CommandDecoder::CommandDecoder(const CommandEntry *t, uint8_t entries)
+{
+    table = t;
+
+    for(uint32_t op = 0; op < 256; op++)
+        lookup[op] = 0;
+
+    for(uint8_t i = 0; i <= COMMAND_MAX_ENTRIES; i++)
+        counts[i] = 0;
+
+    for(uint8_t i = 0; i < entries && i < COMMAND_MAX_ENTRIES; i++)
+        lookup[table[i].opcode] = i + 1;
+}
+
+const CommandEntry *CommandDecoder::find(uint8_t opcode)
+{
+    return lookup[opcode] ? &table[lookup[opcode] - 1] : 0;
+}
+
+uint8_t CommandDecoder::length(uint8_t opcode)
+{
+    const CommandEntry *e = find(opcode);
+    return e ? e->length : CommandReader::length(opcode);
+}
+
+uint32_t CommandDecoder::getUnknown()
+{
+    return counts[0];
+}
+
+uint32_t CommandDecoder::getCount(uint8_t opcode)
+{
+    return lookup[opcode] ? counts[lookup[opcode]] : 0;
+}
+
+uint32_t CommandDecoder::decode(const uint8_t *buffer, uint32_t count, uint8_t required)
+{
+    uint32_t p = 0;
+
+    while(p < count) {
+        const CommandEntry *e = find(buffer[p]);
+        uint8_t len = e ? e->length : CommandReader::length(buffer[p]);
+
+        //Unknown opcodes have no flags either
+        if(p + len > count || (required && (!e || (e->flags & required) != required)))
+            break;
+
+        counts[lookup[buffer[p]]]++;
+        if(e)
+            e->handler(buffer + p + 1);
+
+        p += len;
+    }
+    return p;
+}
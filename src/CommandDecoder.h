@@ -0,0 +1,66 @@
+#ifndef COMMANDDECODER_H
+#define COMMANDDECODER_H
+#include <stdint.h>
+#include "CommandReader.h"
+
+//Entry flags
+#define COMMAND_CONFIGURATION 0x01  // Only changes settings, sends nothing
+
+//Table entries that get a command counter, the others are not decoded
+#define COMMAND_MAX_ENTRIES 48
+
+//Handlers get the 4 parameter bytes of long commands (unaligned)
+typedef void (*CommandHandler)(const uint8_t *parameters);
+
+struct CommandEntry {
+    uint8_t opcode;
+    uint8_t length;     // 1 or COMMAND_LONG_LENGTH
+    CommandHandler handler;
+    uint8_t flags;
+};
+
+//Little endian parameters, byte loads work at any alignment
+inline uint16_t loadUInt16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+inline uint32_t loadUInt32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/* Table driven SUMP command decoder.
+
+   The table lists opcode, length and handler of every command, and is
+   indexed by opcode once, at construction. decode() runs every whole
+   command of a buffer in one pass, so a batch of configuration commands
+   costs one call. Unknown opcodes are skipped with the SUMP length rule
+   (bit 7 set for long commands) so that the framing is kept. With
+   required flags, decoding stops at the first command without them,
+   unknown opcodes included. Commands are counted per table entry, the
+   unknown ones together; a table can have up to COMMAND_MAX_ENTRIES
+   entries. Plain C++ without mbed, so that the host tools can build it
+   too. */
+class CommandDecoder{
+
+public:
+
+    CommandDecoder(const CommandEntry *table, uint8_t entries);
+
+    //Runs the whole commands in buffer, returns the bytes used
+    uint32_t decode(const uint8_t *buffer, uint32_t length, uint8_t required = 0);
+
+    const CommandEntry *find(uint8_t opcode);
+    uint8_t length(uint8_t opcode);
+
+    //Getters and Setters
+    uint32_t getUnknown();
+    uint32_t getCount(uint8_t opcode);  // Commands received, 0 for unknown opcodes
+
+private:
+    const CommandEntry *table;
+    uint8_t lookup[256];    // Table index + 1, 0 for unknown opcodes
+    uint32_t counts[COMMAND_MAX_ENTRIES + 1];  // By lookup value, unknown first
+};
+#endif
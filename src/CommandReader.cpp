@@ -0,0 +1,112 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+#include "CommandReader.h"
+
+CommandReader::CommandReader()
+{
+    writer = 0;
+    pushed = 0;
+    taken = 0;
+    index = 0;
+    overruns = 0;
+}
+
+uint8_t CommandReader::length(uint8_t opcode)
+{
+    return (opcode & 0x80) ? COMMAND_LONG_LENGTH : 1;
+}
+
+uint32_t CommandReader::written()
+{
+    return writer ? writer() : pushed;
+}
+
+//The ring would overwrite its oldest byte, which breaks the framing
+void CommandReader::push(uint8_t v)
+{
+    if(pushed - taken >= COMMAND_RX_SIZE) {
+        overruns++;
+        return;
+    }
+    ring[pushed % COMMAND_RX_SIZE] = v;
+    pushed++;
+}
+
+void CommandReader::overrun()
+{
+    overruns++;
+}
+
+//A DMA cannot hold back, bytes it wrote over are skipped and counted
+bool CommandReader::read(uint8_t &v)
+{
+    COMMAND_LOCK();
+    uint32_t head = written();
+    if(head - taken > COMMAND_RX_SIZE) {
+        overruns += head - taken - COMMAND_RX_SIZE;
+        taken = head - COMMAND_RX_SIZE;
+    }
+    bool ok = head != taken;
+    if(ok)
+        v = ring[taken++ % COMMAND_RX_SIZE];
+    COMMAND_UNLOCK();
+    return ok;
+}
+
+bool CommandReader::empty()
+{
+    return written() == taken;
+}
+
+uint8_t *CommandReader::getBuffer()
+{
+    return ring;
+}
+
+uint32_t CommandReader::getOverruns()
+{
+    return overruns;
+}
+
+void CommandReader::setWriter(CommandWriter w)
+{
+    writer = w;
+}
+
+//Partial commands are kept until the rest arrives
+bool CommandReader::next(uint8_t *command)
+{
+    uint8_t v;
+
+    while(read(v)) {
+        frame[index++] = v;
+        if(index < length(frame[0]))
+            continue;
+
+        for(uint8_t i = 0; i < COMMAND_LONG_LENGTH; i++)
+            command[i] = i < index ? frame[i] : 0;
+
+        index = 0;
+        return true;
+    }
+    return false;
+}
+
+uint8_t CommandReader::getc()
+{
+    uint8_t v;
+    while(!read(v));
+    return v;
+}
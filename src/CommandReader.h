@@ -0,0 +1,62 @@
+#ifndef COMMANDREADER_H
+#define COMMANDREADER_H
+#include <stdint.h>
+
+//Receive ring, holds the back to back sessions of a retrying client
+#define COMMAND_RX_SIZE 1024
+#define COMMAND_LONG_LENGTH 5
+
+//Total bytes a DMA has written into the ring, wrapping at 2^32
+typedef uint32_t (*CommandWriter)();
+
+//The consumer side runs with the RX interrupt masked
+#if defined(TARGET_STM) || defined(TARGET_HOST)
+#include "cmsis.h"
+#define COMMAND_LOCK() __disable_irq()
+#define COMMAND_UNLOCK() __enable_irq()
+#else
+#define COMMAND_LOCK()
+#define COMMAND_UNLOCK()
+#endif
+
+/* SUMP command framing over a receive ring.
+
+   A circular DMA (see setWriter) or the RX interrupt (see push) puts
+   every byte into the ring and the main loop takes whole commands out
+   of it: opcodes with bit 7 set are followed by 4 parameter bytes, the
+   others stand alone. Bytes that arrive while a command runs wait in
+   the ring instead of overrunning the UART. Bytes lost to a full ring
+   or to the UART are counted. Plain C++, so that the host tools can
+   build it too. */
+class CommandReader{
+
+public:
+
+    CommandReader();
+
+    void push(uint8_t);                 // From the RX interrupt
+    void overrun();                     // A byte the UART lost
+    bool next(uint8_t *command);        // Whole command, COMMAND_LONG_LENGTH bytes zero padded
+    uint8_t getc();                     // Raw byte, for payloads following a command
+    bool read(uint8_t &);               // Raw byte, if any
+    bool empty();
+
+    //Getters and Setters
+    uint8_t *getBuffer();               // DMA target, COMMAND_RX_SIZE bytes
+    uint32_t getOverruns();
+    void setWriter(CommandWriter);
+
+    static uint8_t length(uint8_t opcode);
+
+private:
+    uint32_t written();
+
+    uint8_t ring[COMMAND_RX_SIZE];
+    CommandWriter writer;
+    volatile uint32_t pushed;
+    uint32_t taken;
+    uint8_t frame[COMMAND_LONG_LENGTH];
+    uint8_t index;
+    volatile uint32_t overruns;
+};
+#endif
@@ -0,0 +1,139 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+#include "FrameCodec.h"
+
+#define STATE_SYNC 0
+#define STATE_HEADER 1
+#define STATE_PAYLOAD 2
+#define STATE_CRC 3
+
+//CRC-16/CCITT, a nibble at a time
+static const uint16_t crcTable[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+uint16_t FrameParser::crc(uint16_t crc, uint8_t v)
+{
+    crc = (crc << 4) ^ crcTable[(crc >> 12) ^ (v >> 4)];
+    return (crc << 4) ^ crcTable[(crc >> 12) ^ (v & 0x0F)];
+}
+
+uint16_t FrameParser::crc(uint16_t c, const uint8_t *data, uint32_t n)
+{
+    for(uint32_t i = 0; i < n; i++)
+        c = crc(c, data[i]);
+    return c;
+}
+
+void FrameParser::header(uint8_t *out, uint8_t opcode, uint8_t sequence, uint16_t n)
+{
+    out[0] = FRAME_SYNC;
+    out[1] = n & 0xFF;
+    out[2] = n >> 8;
+    out[3] = opcode;
+    out[4] = sequence;
+}
+
+FrameParser::FrameParser()
+{
+    errors = 0;
+    reset();
+}
+
+void FrameParser::reset()
+{
+    state = STATE_SYNC;
+    received = 0;
+    length = 0;
+}
+
+uint8_t FrameParser::getOpcode()
+{
+    return head[3];
+}
+
+uint8_t FrameParser::getSequence()
+{
+    return head[4];
+}
+
+uint16_t FrameParser::getLength()
+{
+    return length;
+}
+
+const uint8_t *FrameParser::getPayload()
+{
+    return payload;
+}
+
+uint32_t FrameParser::getErrors()
+{
+    return errors;
+}
+
+uint8_t FrameParser::feed(uint8_t v)
+{
+    switch(state) {
+        case STATE_SYNC:
+            if(v == FRAME_SYNC) {
+                head[0] = v;
+                received = 1;
+                state = STATE_HEADER;
+            }
+            return FRAME_NONE;
+
+        case STATE_HEADER:
+            head[received++] = v;
+            if(received < FRAME_HEADER)
+                return FRAME_NONE;
+
+            length = head[1] | (head[2] << 8);
+            if(length > FRAME_MAX_PAYLOAD) {
+                errors++;
+                state = STATE_SYNC;
+                return FRAME_NONE;
+            }
+
+            received = 0;
+            state = length ? STATE_PAYLOAD : STATE_CRC;
+            return FRAME_NONE;
+
+        case STATE_PAYLOAD:
+            payload[received++] = v;
+            if(received == length) {
+                received = 0;
+                state = STATE_CRC;
+            }
+            return FRAME_NONE;
+
+        case STATE_CRC:
+            if(received++ == 0) {
+                expected = v;
+                return FRAME_NONE;
+            }
+
+            expected |= v << 8;
+            state = STATE_SYNC;
+
+            if(crc(crc(0xFFFF, head + 1, FRAME_HEADER - 1), payload, length) == expected)
+                return FRAME_OK;
+
+            errors++;
+            return FRAME_BAD;
+    }
+    return FRAME_NONE;
+}
@@ -0,0 +1,101 @@
+#ifndef FRAMECODEC_H
+#define FRAMECODEC_H
+#include <stdint.h>
+
+/* Framed binary protocol, entered from SUMP with the 0xAA command.
+
+     sync, length (uint16), opcode, sequence, payload[length], crc (uint16)
+
+   Multibyte fields are little endian, like the SUMP parameters. The CRC
+   is CRC-16/CCITT (0x1021, from 0xFFFF) of everything after the sync
+   byte. Replies carry the opcode and sequence of the request, and a
+   status byte at the start of the payload. */
+
+#define FRAME_SYNC 0xA5
+#define FRAME_HEADER 5
+#define FRAME_CRC 2
+#define FRAME_MAX_PAYLOAD 1024
+#define FRAME_VERSION 1
+
+//Sample replies are status, offset (uint32) and samples
+#define FRAME_MAX_SAMPLES (FRAME_MAX_PAYLOAD - 5)
+
+//Parameter of the SUMP command that enters the framed protocol, "LNFP"
+#define FRAME_MAGIC 0x50464E4C
+
+//Opcodes
+#define FRAME_PING 0x01         // Reply: "LNFP", version, max payload (uint16)
+#define FRAME_CONFIGURE 0x02    // SUMP configuration commands, reply: bytes used (uint16)
+#define FRAME_CAPTURE 0x03      // Reply: samples (uint32)
+#define FRAME_READ 0x04         // Offset (uint32), length (uint16), reply: offset, samples
+#define FRAME_STREAM 0x05       // Chunk length (uint16), captures and sends every chunk
+#define FRAME_EXIT 0x06         // Back to SUMP
+
+//Status
+#define FRAME_STATUS_OK 0x00
+#define FRAME_STATUS_BAD_CRC 0x01
+#define FRAME_STATUS_UNKNOWN 0x02
+#define FRAME_STATUS_BAD_LENGTH 0x03
+#define FRAME_STATUS_REJECTED 0x04
+#define FRAME_STATUS_END 0x05
+
+//Results of FrameParser::feed()
+#define FRAME_NONE 0
+#define FRAME_OK 1
+#define FRAME_BAD 2
+
+inline void storeUInt16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+inline void storeUInt32(uint8_t *p, uint32_t v)
+{
+    storeUInt16(p, v & 0xFFFF);
+    storeUInt16(p + 2, v >> 16);
+}
+
+typedef void (*FrameHandler)(uint8_t sequence, const uint8_t *payload, uint16_t length);
+
+struct FrameEntry {
+    uint8_t opcode;
+    FrameHandler handler;
+};
+
+/* Byte at a time frame parser. Bytes before a sync byte and frames
+   longer than FRAME_MAX_PAYLOAD are skipped, so the parser finds the
+   next frame after a broken one. Plain C++ without mbed, so that the
+   host tools can build it too. */
+class FrameParser{
+
+public:
+
+    FrameParser();
+
+    uint8_t feed(uint8_t);
+    void reset();
+
+    //Getters and Setters
+    uint8_t getOpcode();
+    uint8_t getSequence();
+    uint16_t getLength();
+    const uint8_t *getPayload();
+    uint32_t getErrors();
+
+    static uint16_t crc(uint16_t crc, const uint8_t *data, uint32_t length);
+    static uint16_t crc(uint16_t crc, uint8_t v);
+
+    //Writes the FRAME_HEADER bytes, the CRC starts from header + 1
+    static void header(uint8_t *out, uint8_t opcode, uint8_t sequence, uint16_t length);
+
+private:
+    uint8_t state;
+    uint8_t head[FRAME_HEADER];
+    uint16_t received;
+    uint16_t length;
+    uint16_t expected;
+    uint32_t errors;
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+};
+#endif
@@ -0,0 +1,220 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+#include "mbed.h"
+#include "FrequencyCounter.h"
+#include "SampleKernel.h"
+#include <algorithm>
+
+#define COUNTER_TIMERS 3
+
+//Timers in external clock mode 1, counting rising edges of one channel
+struct CounterTimer{
+    TIM_TypeDef *timer;
+    uint8_t channel;    // PB pin, same as the logic analyzer channel
+    uint8_t af;
+    uint32_t ccmr1;     // Input capture mapped on TI1 or TI2
+    uint32_t smcr;      // Trigger input and slave mode
+    uint32_t mask;      // Counter width
+};
+
+static const CounterTimer counterTimers[COUNTER_TIMERS] = {
+    {TIM2, 3, 1, TIM_CCMR1_CC2S_0, TIM_SMCR_TS_2 | TIM_SMCR_TS_1 | TIM_SMCR_SMS, 0xFFFFFFFF},   // TI2FP2
+    {TIM3, 4, 2, TIM_CCMR1_CC1S_0, TIM_SMCR_TS_2 | TIM_SMCR_TS_0 | TIM_SMCR_SMS, 0xFFFF},       // TI1FP1
+    {TIM4, 6, 2, TIM_CCMR1_CC1S_0, TIM_SMCR_TS_2 | TIM_SMCR_TS_0 | TIM_SMCR_SMS, 0xFFFF}        // TI1FP1
+};
+
+__attribute__((aligned(4))) static uint8_t burst_buffer[COUNTER_BURST];
+
+FrequencyCounter::FrequencyCounter(volatile uint32_t *p)
+{
+    port = p;
+    gate = COUNTER_DEFAULT_GATE;
+
+    SET_BIT(RCC->AHB1ENR, RCC_AHB1ENR_GPIOBEN);
+    SET_BIT(RCC->APB1ENR, RCC_APB1ENR_TIM2EN | RCC_APB1ENR_TIM3EN | RCC_APB1ENR_TIM4EN);
+
+    for(uint8_t c = 0; c < COUNTER_CHANNELS; c++)
+        frequency[c] = 0;
+}
+
+uint32_t FrequencyCounter::getGate()
+{
+    return gate;
+}
+
+void FrequencyCounter::setGate(uint32_t ms)
+{
+    gate = min((uint32_t) COUNTER_MAX_GATE, max((uint32_t) COUNTER_MIN_GATE, ms));
+}
+
+uint32_t FrequencyCounter::getFrequency(uint8_t channel)
+{
+    return frequency[channel];
+}
+
+uint8_t FrequencyCounter::getHardwareChannels()
+{
+    uint8_t channels = 0;
+    for(uint8_t i = 0; i < COUNTER_TIMERS; i++)
+        channels |= 1 << counterTimers[i].channel;
+
+    return channels;
+}
+
+/* Counts for the gate time. Between software bursts the hardware counters
+   are polled, so the 16 bit ones never wrap more than once.
+
+   Fast signals toggle many times in every burst, and are measured over
+   the burst time only. Slow signals are measured over the whole gate,
+   counting level changes between bursts as one transition each. */
+void FrequencyCounter::measure()
+{
+    uint32_t gateCycles = SystemCoreClock / 1000 * gate;
+    uint32_t burstCycles = 0;
+    uint32_t bursts = 0;
+    uint8_t last = 0;
+
+    for(uint8_t c = 0; c < COUNTER_CHANNELS; c++) {
+        transitions[c] = 0;
+        gapTransitions[c] = 0;
+    }
+
+    startTimers();
+    uint32_t t0 = DWT->CYCCNT;
+
+    while(DWT->CYCCNT - t0 < gateCycles) {
+        __disable_irq();
+        uint32_t b0 = DWT->CYCCNT;
+        ramKernel<KERNEL_MIN_CYCLES, KERNEL_UNROLL>(port, burst_buffer, COUNTER_BURST);
+        burstCycles += DWT->CYCCNT - b0;
+        __enable_irq();
+
+        //Newest sample first
+        uint8_t gap = burst_buffer[COUNTER_BURST - 1] ^ last;
+        if(bursts > 0) {
+            for(uint8_t c = 0; c < COUNTER_CHANNELS; c++)
+                gapTransitions[c] += (gap >> c) & 1;
+        }
+        last = burst_buffer[0];
+        bursts++;
+
+        countTransitions((const uint32_t *) burst_buffer, COUNTER_BURST / 4);
+        pollTimers();
+    }
+
+    stopTimers();
+    uint32_t elapsed = DWT->CYCCNT - t0;
+
+    for(uint8_t c = 0; c < COUNTER_CHANNELS; c++) {
+        double f;
+        if(transitions[c] >= 2 * bursts)
+            f = (double) transitions[c] * SystemCoreClock / 2 / burstCycles;
+        else
+            f = (double) (transitions[c] + gapTransitions[c]) * SystemCoreClock / 2 / elapsed;
+
+        frequency[c] = f + 0.5;
+    }
+
+    for(uint8_t i = 0; i < COUNTER_TIMERS; i++)
+        frequency[counterTimers[i].channel] = (double) edges[i] * SystemCoreClock / elapsed + 0.5;
+}
+
+/* Bytes are XORed with the previous sample, which leaves bit c set on
+   every transition of channel c. Each channel is then added up four
+   samples at a time in byte lanes (UADD8), and the lanes are folded into
+   the total (USADA8) before any of them can overflow. */
+void FrequencyCounter::countTransitions(const uint32_t *samples, uint32_t words)
+{
+    //The first sample is compared with itself
+    uint32_t previous = samples[0] << 24;
+
+    while(words > 0) {
+        uint32_t n = min(words, (uint32_t) 255);
+        uint32_t lanes[COUNTER_CHANNELS] = {0};
+
+        for(uint32_t i = 0; i < n; i++) {
+            uint32_t w = samples[i];
+            uint32_t t = w ^ ((w << 8) | (previous >> 24));
+            previous = w;
+
+            for(uint8_t c = 0; c < COUNTER_CHANNELS; c++)
+                lanes[c] = __UADD8(lanes[c], (t >> c) & 0x01010101);
+        }
+
+        for(uint8_t c = 0; c < COUNTER_CHANNELS; c++)
+            transitions[c] = __USADA8(lanes[c], 0, transitions[c]);
+
+        samples += n;
+        words -= n;
+    }
+}
+
+void FrequencyCounter::startTimers()
+{
+    for(uint8_t i = 0; i < COUNTER_TIMERS; i++) {
+        const CounterTimer &ct = counterTimers[i];
+        TIM_TypeDef *tim = ct.timer;
+
+        GPIOB->AFR[0] = (GPIOB->AFR[0] & ~(0xF << (ct.channel * 4))) | (ct.af << (ct.channel * 4));
+        GPIOB->MODER = (GPIOB->MODER & ~(3 << (ct.channel * 2))) | (2 << (ct.channel * 2));
+
+        tim->CR1 = 0;
+        tim->DIER = 0;
+        tim->SMCR = 0;
+        tim->CCER = 0;
+        tim->CCMR1 = ct.ccmr1;
+        tim->PSC = 0;
+        tim->ARR = ct.mask;
+
+        //The trigger input is selected before the slave mode
+        tim->SMCR = ct.smcr & TIM_SMCR_TS;
+        tim->SMCR = ct.smcr;
+        tim->EGR = TIM_EGR_UG;
+        tim->CNT = 0;
+
+        edges[i] = 0;
+        lastCount[i] = 0;
+    }
+
+    for(uint8_t i = 0; i < COUNTER_TIMERS; i++)
+        counterTimers[i].timer->CR1 = TIM_CR1_CEN;
+}
+
+void FrequencyCounter::pollTimers()
+{
+    for(uint8_t i = 0; i < COUNTER_TIMERS; i++) {
+        uint32_t count = counterTimers[i].timer->CNT;
+        edges[i] += (count - lastCount[i]) & counterTimers[i].mask;
+        lastCount[i] = count;
+    }
+}
+
+//Timers are released and the pins are back to plain inputs
+void FrequencyCounter::stopTimers()
+{
+    for(uint8_t i = 0; i < COUNTER_TIMERS; i++)
+        counterTimers[i].timer->CR1 = 0;
+
+    pollTimers();
+
+    for(uint8_t i = 0; i < COUNTER_TIMERS; i++) {
+        const CounterTimer &ct = counterTimers[i];
+
+        ct.timer->SMCR = 0;
+        ct.timer->CCMR1 = 0;
+        GPIOB->MODER &= ~(3 << (ct.channel * 2));
+        GPIOB->AFR[0] &= ~(0xF << (ct.channel * 4));
+    }
+}
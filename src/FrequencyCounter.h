@@ -0,0 +1,52 @@
+#ifndef FREQUENCYCOUNTER_H
+#define FREQUENCYCOUNTER_H
+#include "mbed.h"
+
+#define COUNTER_CHANNELS 8
+#define COUNTER_MIN_GATE 1        // ms
+#define COUNTER_MAX_GATE 10000    // ms
+#define COUNTER_DEFAULT_GATE 100  // ms
+
+//Samples per software burst, a multiple of KERNEL_UNROLL
+#define COUNTER_BURST 1024
+
+/* Measures the frequency of the 8 channels over a gate time.
+
+   PB3, PB4 and PB6 are counted in hardware: TIM2, TIM3 and TIM4 run in
+   external clock mode, clocked by the channel rising edges. The other
+   channels are sampled in short bursts with the fastest sampling kernel
+   and their transitions are counted in software. */
+class FrequencyCounter{
+
+public:
+
+    FrequencyCounter(volatile uint32_t *port);
+
+    void measure();
+
+    //Getters and Setters
+    uint32_t getFrequency(uint8_t channel);
+    uint8_t getHardwareChannels();
+    uint32_t getGate();
+
+    void setGate(uint32_t ms);
+
+private:
+    void startTimers();
+    void pollTimers();
+    void stopTimers();
+    void countTransitions(const uint32_t *samples, uint32_t words);
+
+    volatile uint32_t *port;
+    uint32_t gate;
+    uint32_t frequency[COUNTER_CHANNELS];
+
+    //Software counting state
+    uint32_t transitions[COUNTER_CHANNELS];
+    uint32_t gapTransitions[COUNTER_CHANNELS];
+
+    //Hardware counting state
+    uint32_t edges[3];
+    uint32_t lastCount[3];
+};
+#endif
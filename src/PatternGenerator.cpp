@@ -0,0 +1,176 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+#include "mbed.h"
+#include "PatternGenerator.h"
+#include <algorithm>
+
+/* Pattern bytes are written to PC0-PC7 (GPIOC->ODR low byte) by
+   DMA2 Stream5, which is requested by TIM1 update events (channel 6). */
+
+#define PATTERN_SIZE 16384
+#define PATTERN_MAX_FREQUENCY 10000000
+#define PATTERN_DMA_CHANNEL 6
+
+#define SUMP_ORIGINAL_FREQ  (100000000)
+
+uint8_t pattern_buffer[PATTERN_SIZE];
+
+//Timers run at twice the APB clock when it is divided
+static uint32_t timerClock()
+{
+    uint32_t clock = HAL_RCC_GetPCLK2Freq();
+
+    if(RCC->CFGR & RCC_CFGR_PPRE2_2)
+        clock *= 2;
+    return clock;
+}
+
+PatternGenerator::PatternGenerator(CommandReader *cr)
+{
+    commands = cr;
+    pattern = pattern_buffer;
+
+    SET_BIT(RCC->AHB1ENR, RCC_AHB1ENR_GPIOCEN | RCC_AHB1ENR_DMA2EN);
+    SET_BIT(RCC->APB2ENR, RCC_APB2ENR_TIM1EN);
+
+    reset();
+}
+
+void PatternGenerator::reset()
+{
+    stop();
+    length = 0;
+    flags = 0;
+    setDivider(99);
+}
+
+uint32_t PatternGenerator::getBufferSize()
+{
+    return PATTERN_SIZE;
+}
+
+uint32_t PatternGenerator::getMaxFrequency()
+{
+    return PATTERN_MAX_FREQUENCY;
+}
+
+uint8_t *PatternGenerator::getBuffer()
+{
+    return pattern;
+}
+
+//Core cycles per pattern byte
+uint32_t PatternGenerator::getStepCycles()
+{
+    return (uint64_t) (prescaler + 1) * (reload + 1) * SystemCoreClock / timerClock();
+}
+
+void PatternGenerator::setLength(uint16_t len, uint8_t f)
+{
+    stop();
+    length = min((uint16_t) PATTERN_SIZE, len);
+    flags = f;
+}
+
+bool PatternGenerator::isRunning()
+{
+    return (DMA2_Stream5->CR & DMA_SxCR_EN) != 0;
+}
+
+//Same meaning as the SUMP divider: rate = 100Mhz / (divider + 1)
+void PatternGenerator::setDivider(uint32_t divider)
+{
+    uint32_t clock = timerClock();
+    uint64_t cycles = ((uint64_t) clock * (divider + 1)) / SUMP_ORIGINAL_FREQ;
+    uint64_t minCycles = clock / PATTERN_MAX_FREQUENCY;
+
+    if(cycles < minCycles)
+        cycles = minCycles;
+
+    uint64_t psc = (cycles - 1) / 65536;
+    if(psc > 0xFFFF)
+        psc = 0xFFFF;
+
+    prescaler = psc;
+    reload = min((uint64_t) 65536, cycles / (psc + 1)) - 1;
+}
+
+void PatternGenerator::upload(uint16_t len, uint8_t f)
+{
+    stop();
+
+    length = min((uint16_t) PATTERN_SIZE, len);
+    flags = f;
+
+    for(uint16_t i = 0; i < len; i++) {
+        uint8_t v = commands->getc();
+
+        if(i < length)
+            pattern[i] = v;
+    }
+}
+
+void PatternGenerator::start()
+{
+    //PC0-PC7 as high speed outputs
+    GPIOC->MODER = (GPIOC->MODER & 0xFFFF0000) | 0x5555;
+    GPIOC->OSPEEDR |= 0xFFFF;
+    GPIOC->OTYPER &= 0xFF00;
+
+    start(&GPIOC->ODR);
+}
+
+//Target can also be a RAM word, as DMA2 reaches both
+void PatternGenerator::start(volatile uint32_t *target)
+{
+    if(length == 0)
+        return;
+
+    stop();
+
+    TIM1->CR1 = TIM_CR1_URS;
+    TIM1->PSC = prescaler;
+    TIM1->ARR = reload;
+    TIM1->EGR = TIM_EGR_UG;
+    TIM1->SR = 0;
+
+    DMA2->HIFCR = DMA_HIFCR_CTCIF5 | DMA_HIFCR_CHTIF5 | DMA_HIFCR_CTEIF5 | DMA_HIFCR_CDMEIF5 | DMA_HIFCR_CFEIF5;
+    DMA2_Stream5->PAR = (uintptr_t) target;
+    DMA2_Stream5->M0AR = (uintptr_t) pattern;
+    DMA2_Stream5->NDTR = length;
+    DMA2_Stream5->FCR = 0;      // Direct mode, byte to byte
+    DMA2_Stream5->CR = (PATTERN_DMA_CHANNEL * DMA_SxCR_CHSEL_0) | DMA_SxCR_PL | DMA_SxCR_MINC | DMA_SxCR_DIR_0;
+
+    if(flags & PATTERN_FLAGS_LOOP)
+        DMA2_Stream5->CR |= DMA_SxCR_CIRC;
+
+    DMA2_Stream5->CR |= DMA_SxCR_EN;
+
+    TIM1->DIER = TIM_DIER_UDE;
+    TIM1->CR1 |= TIM_CR1_CEN;
+}
+
+//TIM1 is only released if the generator owns it (the activity monitor shares it)
+void PatternGenerator::stop()
+{
+    if(!(TIM1->DIER & TIM_DIER_UDE))
+        return;
+
+    TIM1->CR1 &= ~TIM_CR1_CEN;
+    TIM1->DIER = 0;
+
+    DMA2_Stream5->CR &= ~DMA_SxCR_EN;
+    while(DMA2_Stream5->CR & DMA_SxCR_EN);
+}
@@ -0,0 +1,40 @@
+#ifndef PATTERNGENERATOR_H
+#define PATTERNGENERATOR_H
+#include "mbed.h"
+#include "CommandReader.h"
+
+#define PATTERN_FLAGS_LOOP 0x01
+
+class PatternGenerator{
+
+public:
+
+    PatternGenerator(CommandReader*);
+
+    void upload(uint16_t length, uint8_t flags);
+    void start();
+    void start(volatile uint32_t *target);
+    void stop();
+    void reset();
+    bool isRunning();
+
+    //Getters and Setters
+    uint32_t getBufferSize();
+    uint32_t getMaxFrequency();
+    uint8_t *getBuffer();
+    uint32_t getStepCycles();
+
+    void setLength(uint16_t, uint8_t);
+    void setDivider(uint32_t);
+
+private:
+    uint8_t *pattern;
+    uint16_t length;
+    uint8_t flags;
+
+    uint16_t prescaler;
+    uint16_t reload;
+
+    CommandReader *commands;
+};
+#endif
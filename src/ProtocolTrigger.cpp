@@ -0,0 +1,80 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+#include "mbed.h"
+#include "ProtocolTrigger.h"
+
+ProtocolTrigger::ProtocolTrigger()
+{
+    budget = 1;
+    configure(PROTOCOL_NONE, 0, 0, 0);
+}
+
+void ProtocolTrigger::reset()
+{
+    shift = 0;
+    bits = 0;
+    countdown = 0;
+    lastData = 0;
+    lastClock = 0;
+    active = 0;
+}
+
+/* channels: low nibble is the data line (RX, MOSI/MISO, SDA),
+   high nibble is the clock line (SCK, SCL). */
+void ProtocolTrigger::configure(uint8_t p, uint8_t channels, uint8_t m, uint8_t prm)
+{
+    if(p > PROTOCOL_I2C)
+        p = PROTOCOL_NONE;
+
+    protocol = p;
+    dataChannel = channels & 0x07;
+    clockChannel = (channels >> 4) & 0x07;
+    match = m;
+    param = prm;
+
+    //UART bit period must be at least one sample
+    if(protocol == PROTOCOL_UART && param == 0)
+        param = 1;
+    bitPeriod = param * PROTOCOL_STEP;
+
+    reset();
+}
+
+bool ProtocolTrigger::isEnabled()
+{
+    return protocol != PROTOCOL_NONE;
+}
+
+uint32_t ProtocolTrigger::getCycleBudget()
+{
+    return budget;
+}
+
+uint32_t ProtocolTrigger::getMaxFrequency()
+{
+    return SystemCoreClock / budget;
+}
+
+void ProtocolTrigger::setCycleBudget(uint32_t cycles)
+{
+    budget = cycles ? cycles : 1;
+}
+
+//Bit period rescaled to the steps, at least one step
+void ProtocolTrigger::setStepCycles(uint32_t sampleCycles, uint32_t stepCycles)
+{
+    uint64_t period = (uint64_t) param * PROTOCOL_STEP * sampleCycles / stepCycles;
+    bitPeriod = period > PROTOCOL_STEP ? period : PROTOCOL_STEP;
+}
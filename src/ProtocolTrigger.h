@@ -0,0 +1,171 @@
+#ifndef PROTOCOLTRIGGER_H
+#define PROTOCOLTRIGGER_H
+#include "mbed.h"
+
+#define PROTOCOL_NONE 0
+#define PROTOCOL_UART 1
+#define PROTOCOL_SPI  2
+#define PROTOCOL_I2C  3
+
+//SPI options (param byte)
+#define SPI_CS_CHANNEL_MASK 0x07
+#define SPI_CS_ENABLE       0x08
+#define SPI_SAMPLE_FALLING  0x10
+
+//I2C options (param byte)
+#define I2C_MATCH_RW        0x01
+
+//UART bit periods are counted in 1/256 of a decoder step
+#define PROTOCOL_STEP 256
+
+class ProtocolTrigger{
+
+public:
+
+    ProtocolTrigger();
+
+    void reset();
+    void configure(uint8_t protocol, uint8_t channels, uint8_t match, uint8_t param);
+    bool isEnabled();
+
+    uint32_t getCycleBudget();
+    uint32_t getMaxFrequency();
+
+    /* Worst case cost of one pre-trigger sample: port read, one decoder
+       step and the pacing loop, measured by the sampler at start up. */
+    void setCycleBudget(uint32_t);
+
+    //Decoder steps slower than the samples the UART bit period counts
+    void setStepCycles(uint32_t sampleCycles, uint32_t stepCycles);
+
+    //Feeds one port sample. Returns true when the match value was seen.
+    inline bool feed(uint32_t port)
+    {
+        uint32_t data = (port >> dataChannel) & 1;
+        uint32_t clock = (port >> clockChannel) & 1;
+
+        switch(protocol) {
+            case PROTOCOL_UART:
+                return feedUART(data);
+            case PROTOCOL_SPI:
+                return feedSPI(port, data, clock);
+            case PROTOCOL_I2C:
+                return feedI2C(data, clock);
+            default:
+                return true;
+        }
+    }
+
+private:
+    inline bool feedUART(uint32_t data);
+    inline bool feedSPI(uint32_t port, uint32_t data, uint32_t clock);
+    inline bool feedI2C(uint32_t data, uint32_t clock);
+
+    uint8_t protocol;
+    uint8_t dataChannel;
+    uint8_t clockChannel;
+    uint8_t match;
+    uint8_t param;
+
+    uint32_t budget;
+    uint32_t bitPeriod;
+
+    uint32_t shift;
+    uint8_t bits;
+    int32_t countdown;
+    uint8_t lastData;
+    uint8_t lastClock;
+    uint8_t active;
+};
+
+/* UART 8N1, LSB first, idle high. param is the bit period in samples.
+   A falling edge while idle starts a frame, bits are sampled mid-period.
+   The fractional countdown keeps the bit timing when the steps are
+   slower than the samples. */
+inline bool ProtocolTrigger::feedUART(uint32_t data)
+{
+    if(!active){
+        if(lastData && !data){
+            active = 1;
+            bits = 0;
+            shift = 0;
+            countdown = bitPeriod + (bitPeriod >> 1) - PROTOCOL_STEP;
+        }
+        lastData = data;
+        return false;
+    }
+
+    lastData = data;
+    countdown -= PROTOCOL_STEP;
+    if(countdown > 0)
+        return false;
+
+    countdown += bitPeriod;
+    if(bits < 8){
+        shift |= data << bits;
+        bits++;
+        return false;
+    }
+
+    //Stop bit
+    active = 0;
+    return data && (shift == match);
+}
+
+/* SPI, MSB first. Bits are shifted on the selected clock edge and every
+   8 consecutive bits are compared, so no word alignment is needed unless
+   a chip select channel is given. */
+inline bool ProtocolTrigger::feedSPI(uint32_t port, uint32_t data, uint32_t clock)
+{
+    uint32_t edge = (param & SPI_SAMPLE_FALLING) ? (lastClock & ~clock) : (~lastClock & clock);
+    lastClock = clock;
+
+    if(param & SPI_CS_ENABLE){
+        if((port >> (param & SPI_CS_CHANNEL_MASK)) & 1){
+            bits = 0;
+            return false;
+        }
+    }
+
+    if(!(edge & 1))
+        return false;
+
+    shift = (shift << 1) | data;
+    if(bits < 8)
+        bits++;
+
+    if(bits < 8)
+        return false;
+
+    if(param & SPI_CS_ENABLE)
+        bits = 0;
+
+    return (shift & 0xFF) == match;
+}
+
+/* I2C address match. A START (SDA falling while SCL high) opens a frame and
+   the first 8 bits are latched on SCL rising edges. */
+inline bool ProtocolTrigger::feedI2C(uint32_t data, uint32_t clock)
+{
+    bool matched = false;
+
+    if(clock && lastClock && lastData && !data){
+        active = 1;
+        bits = 0;
+        shift = 0;
+    }else if(active && clock && !lastClock){
+        shift = (shift << 1) | data;
+        if(++bits == 8){
+            active = 0;
+            if(param & I2C_MATCH_RW)
+                matched = (shift == match);
+            else
+                matched = ((shift >> 1) == (uint32_t)(match & 0x7F));
+        }
+    }
+
+    lastData = data;
+    lastClock = clock;
+    return matched;
+}
+#endif
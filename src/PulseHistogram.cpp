@@ -0,0 +1,87 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+#include "mbed.h"
+#include "PulseHistogram.h"
+#include <algorithm>
+
+PulseHistogram::PulseHistogram(TransitionIndex *ti)
+{
+    index = ti;
+    configure(0, 16, 0);
+}
+
+void PulseHistogram::configure(uint8_t c, uint8_t b, uint8_t s)
+{
+    channel = c & 0x07;
+    bins = min((uint8_t) HISTOGRAM_MAX_BINS, max((uint8_t) 1, b));
+    subBinsLog2 = min((uint8_t) HISTOGRAM_MAX_SUBBINS_LOG2, s);
+
+    for(uint8_t i = 0; i < HISTOGRAM_MAX_BINS; i++)
+        high[i] = low[i] = 0;
+}
+
+uint8_t PulseHistogram::getBins()
+{
+    return bins;
+}
+
+uint32_t PulseHistogram::getHigh(uint8_t bin)
+{
+    return high[bin];
+}
+
+uint32_t PulseHistogram::getLow(uint8_t bin)
+{
+    return low[bin];
+}
+
+uint8_t PulseHistogram::binOf(uint32_t length)
+{
+    uint32_t msb = 31 - __CLZ(length);
+    uint32_t fraction = ((length << subBinsLog2) >> msb) & ((1 << subBinsLog2) - 1);
+
+    return min((uint32_t) bins - 1, (msb << subBinsLog2) + fraction);
+}
+
+inline void PulseHistogram::add(uint32_t length, uint32_t level)
+{
+    if(level)
+        high[binOf(length)]++;
+    else
+        low[binOf(length)]++;
+}
+
+//Run lengths and levels do not depend on the scan direction
+void PulseHistogram::build(const uint8_t *samples, uint32_t count)
+{
+    for(uint8_t i = 0; i < HISTOGRAM_MAX_BINS; i++)
+        high[i] = low[i] = 0;
+
+    int32_t lastEdge = -1;
+
+    for(uint32_t from = 1; from < count; ) {
+        from = index->build(samples, count, from);
+
+        for(uint32_t i = 0; i < index->size(); i++) {
+            if(!((index->mask(i) >> channel) & 1))
+                continue;
+
+            int32_t at = index->position(i);
+            if(lastEdge >= 0)
+                add(at - lastEdge, !((samples[at] >> channel) & 1));
+            lastEdge = at;
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef PULSEHISTOGRAM_H
+#define PULSEHISTOGRAM_H
+#include "mbed.h"
+#include "TransitionIndex.h"
+
+#define HISTOGRAM_MAX_BINS 32
+#define HISTOGRAM_MAX_SUBBINS_LOG2 3
+
+/* Logarithmic histogram of the run lengths (pulse widths, in samples) of
+   one channel, high and low runs apart.
+
+   With 2^s bins per octave, octave m (2^m <= L < 2^(m+1)) is split in
+   2^s equal bins, so a run of L samples goes to bin m * 2^s plus the s
+   bits below the most significant bit of L. Runs past the last bin are
+   counted in the last bin. The first and last runs of the buffer are
+   partial and not counted. */
+class PulseHistogram{
+
+public:
+
+    PulseHistogram(TransitionIndex*);
+
+    void configure(uint8_t channel, uint8_t bins, uint8_t subBinsLog2);
+    void build(const uint8_t *samples, uint32_t count);
+
+    //Getters and Setters
+    uint8_t getBins();
+    uint32_t getHigh(uint8_t bin);
+    uint32_t getLow(uint8_t bin);
+
+private:
+    inline void add(uint32_t length, uint32_t level);
+    uint8_t binOf(uint32_t length);
+
+    TransitionIndex *index;
+    uint8_t channel;
+    uint8_t bins;
+    uint8_t subBinsLog2;
+
+    uint32_t high[HISTOGRAM_MAX_BINS];
+    uint32_t low[HISTOGRAM_MAX_BINS];
+};
+#endif
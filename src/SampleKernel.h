@@ -0,0 +1,136 @@
+#ifndef SAMPLEKERNEL_H
+#define SAMPLEKERNEL_H
+#include <stdint.h>
+
+/* Exact-cycle sampling loops generated at compile time.
+
+   Each sample slot is a port read, a byte store and NOP padding, so that
+   every slot takes CYCLES core cycles. The last slot of the unrolled body
+   also pays for the loop (subtract, compare and taken branch), so its
+   padding is shorter. The budget below is the Cortex-M4 timing of those
+   instructions running from a zero wait state memory; `make kernelcheck`
+   verifies the compiled loops against it. */
+
+#define KERNEL_READ_CYCLES 2    // LDR from GPIO (AHB1)
+#define KERNEL_STORE_CYCLES 1   // STRB, pipelined after the load
+#define KERNEL_LOOP_CYCLES 5    // SUBS, CMP, taken branch (1 + P, P = 2)
+
+#define KERNEL_UNROLL 4
+
+//Periods are multiples of the read cost, from the fastest loop up to 1Mhz at 84Mhz
+#define KERNEL_MIN_CYCLES 8
+#define KERNEL_MAX_CYCLES 84
+#define KERNEL_STEP_CYCLES KERNEL_READ_CYCLES
+#define SAMPLE_KERNEL_COUNT ((KERNEL_MAX_CYCLES - KERNEL_MIN_CYCLES) / KERNEL_STEP_CYCLES + 1)
+
+/* Kernels up to 2Mhz also get a copy in SRAM, away from the flash wait
+   states and ART cache misses. The copy lives in .ramfunc, which the
+   linker script places in .data, so the startup code loads it from
+   flash. Entry points are aligned so that the loop head has the same
+   alignment in both copies. */
+#define KERNEL_RAM_MAX_CYCLES 42
+#define RAM_KERNEL_COUNT ((KERNEL_RAM_MAX_CYCLES - KERNEL_MIN_CYCLES) / KERNEL_STEP_CYCLES + 1)
+#define KERNEL_ALIGN 16
+#ifdef TARGET_HOST
+#define KERNEL_RAM_SECTION ".text.ramfunc"
+#else
+#define KERNEL_RAM_SECTION ".ramfunc"
+#endif
+
+//The host build samples a simulated port, and `cycles` pass after the read
+#ifdef TARGET_HOST
+uint32_t hostReadPort(volatile uint32_t *port, uint32_t cycles);
+#define PORT_READ(port, cycles) hostReadPort(port, cycles)
+#else
+#define PORT_READ(port, cycles) (*(port))
+#endif
+
+typedef int32_t (*SampleKernelFn)(volatile uint32_t *, uint8_t *, int32_t);
+
+//The padding is also a compiler barrier, keeping each slot's store in place
+template<int N, bool BLOCK = (N >= 8)>
+struct KernelNops;
+
+template<int N>
+struct KernelNops<N, true>{
+    __attribute__((always_inline)) static inline void emit()
+    {
+        __asm volatile ("NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n" ::: "memory");
+        KernelNops<N - 8>::emit();
+    }
+};
+
+template<int N>
+struct KernelNops<N, false>{
+    __attribute__((always_inline)) static inline void emit()
+    {
+        __asm volatile ("NOP\n" ::: "memory");
+        KernelNops<N - 1>::emit();
+    }
+};
+
+template<>
+struct KernelNops<0, false>{
+    __attribute__((always_inline)) static inline void emit()
+    {
+        __asm volatile ("" ::: "memory");
+    }
+};
+
+//Slot SLOT stores the sample at p[-(SLOT + 1)], newest sample first
+template<int SLOT, int UNROLL, int PAD, int PAD_LAST>
+struct KernelSlot{
+    __attribute__((always_inline)) static inline void run(volatile uint32_t *port, uint8_t *p)
+    {
+        p[-(SLOT + 1)] = PORT_READ(port, KERNEL_READ_CYCLES + KERNEL_STORE_CYCLES + PAD);
+        KernelNops<SLOT == UNROLL - 1 ? PAD_LAST : PAD>::emit();
+        KernelSlot<SLOT + 1, UNROLL, PAD, PAD_LAST>::run(port, p);
+    }
+};
+
+template<int UNROLL, int PAD, int PAD_LAST>
+struct KernelSlot<UNROLL, UNROLL, PAD, PAD_LAST>{
+    __attribute__((always_inline)) static inline void run(volatile uint32_t *, uint8_t *)
+    {
+    }
+};
+
+template<int CYCLES, int UNROLL>
+struct SampleKernel{
+    enum {
+        PAD = CYCLES - KERNEL_READ_CYCLES - KERNEL_STORE_CYCLES,
+        PAD_LAST = PAD - KERNEL_LOOP_CYCLES
+    };
+
+    //Fails to compile if the loop does not fit in the last slot
+    typedef char BudgetCheck[PAD_LAST >= 0 ? 1 : -1];
+
+    //Fills buffer[0, snum) from the end and returns the samples left (< UNROLL)
+    __attribute__((always_inline)) static inline int32_t run(volatile uint32_t *port, uint8_t *buffer, int32_t snum)
+    {
+        uint8_t *p = buffer + snum;
+        uint8_t *limit = buffer + UNROLL;
+
+        while(__builtin_expect(p >= limit, 1)){
+            KernelSlot<0, UNROLL, PAD, PAD_LAST>::run(port, p);
+            p -= UNROLL;
+        }
+
+        return p - buffer;
+    }
+};
+
+template<int CYCLES, int UNROLL>
+__attribute__((noinline, aligned(KERNEL_ALIGN)))
+int32_t flashKernel(volatile uint32_t *port, uint8_t *buffer, int32_t snum)
+{
+    return SampleKernel<CYCLES, UNROLL>::run(port, buffer, snum);
+}
+
+template<int CYCLES, int UNROLL>
+__attribute__((noinline, aligned(KERNEL_ALIGN), section(KERNEL_RAM_SECTION)))
+int32_t ramKernel(volatile uint32_t *port, uint8_t *buffer, int32_t snum)
+{
+    return SampleKernel<CYCLES, UNROLL>::run(port, buffer, snum);
+}
+#endif
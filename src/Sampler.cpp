@@ -1,308 +1,973 @@
-/*
- This program is free software: you can redistribute it and/or modify
- it under the terms of the GNU General Public License as published by
- the Free Software Foundation, either version 3 of the License, or
- (at your option) any later version.
-
- This program is distributed in the hope that it will be useful,
- but WITHOUT ANY WARRANTY; without even the implied warranty of
- MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- GNU General Public License for more details.
-
- Author: Joao Paulo Barraca <jpbarraca@gmail.com>
-*/
-
-#include "mbed.h"
-#include "Sampler.h"
-#include <algorithm>
-
-#define TRIGGER_PARALLEL 0
-#define TRIGGER_SERIAL 1
-#define TRIGGER_DISABLED 0xFF
-
-#define TRIGGER_MODE_SERIAL 0
-#define TRIGGER_MODE_PARALLEL 1
-
-#define FLAGS_DEMUX 1
-#define FLAGS_FILTER 2
-#define FLAGS_CHANNEL_GROUPS 0x3C
-#define FLAGS_EXTERNAL 0x40
-#define FLAGS_INVERTED 0x80
-#define FLAGS_TEST 0x400
-
-
-#define SUMP_ORIGINAL_FREQ  (100000000)
-#define SYSTEM_CLOCK_MULT (SystemCoreClock / 1000000)
-#define BUFFER_SIZE 32768
-#define MAX_FREQUENCY 10000000
-
-__attribute((section("AHBSRAM0"),aligned))  uint8_t  main_buffer[BUFFER_SIZE];
-
-#define likely(x) __builtin_expect((x),1)
-
-Sampler::Sampler(Serial *sp)
-{
-    pc = sp;
-    bufferSize = BUFFER_SIZE;
-    buffer =  main_buffer;
-
-    //Setup port
-    SET_BIT(RCC->AHB1ENR, RCC_AHB1ENR_GPIOBEN);
-    GPIOB->OSPEEDR = 3;         // High Speed
-    GPIOB->BSRR = 0xFFFF0000;   // No Special pins
-    GPIOB->MODER = 0;           // Input
-    GPIOB->PUPDR = 0;           // No pull up or pull down
-
-    reset();
-}
-
-void Sampler::reset()
-{
-    buffer_index = 0;
-    setTriggerMask(0);
-    setTriggerValue(0);
-    setTriggerState(0);
-    setSamplingDivider(11);
-    setFlags(0);
-    setSampleNumber(bufferSize);
-    setSamplingDelay(0);
-}
-
-uint32_t Sampler::getMaxFrequency(){
-    return MAX_FREQUENCY;
-}
-
-uint32_t Sampler::getBufferSize(){
-    return bufferSize;
-}
-
-void Sampler::setSamplingDivider(uint32_t divider)
-{
-    //Max speed is 10Mhz
-    if(divider < 9)
-        divider = 9;
-
-    samplingPeriod = (divider+1)*10;
-}
-
-void Sampler::setSampleNumber(uint32_t s)
-{
-    sampleNumber = min((uint32_t) bufferSize, s);
-}
-
-void Sampler::setSamplingDelay(uint16_t s)
-{
-    sampleDelay = s;
-}
-
-void Sampler::setTriggerMask(uint32_t s)
-{
-    triggerMask = s;
-}
-void Sampler::setTriggerValue(uint32_t s)
-{
-    triggerValue = s & 0xFF;
-}
-
-void Sampler::setTriggerState(uint8_t state){
-    triggerState = state;
-}
-
-void Sampler::setFlags(uint32_t s)
-{
-    flags = s;
-}
-
-void Sampler::runTest()
-{
-    //TODO
-}
-
-void Sampler::start()
-{
-
-    int32_t snum = sampleNumber;
-
-
-    if(sampleDelay > 0){
-        wait_us(sampleDelay);
-    }
-
-    if(triggerState == 1){
-        while((GPIOB->IDR & triggerMask) != triggerValue);
-    }
-    
-    //10Mhz (Close but not really...)
-    if(samplingPeriod == 100){
-        while(likely(snum >= 4)){
-            buffer[snum - 1] = GPIOB->IDR;
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\n");
-            
-            buffer[snum - 2] = GPIOB->IDR;
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\n");
-            buffer[snum - 3] = GPIOB->IDR;  
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\n");
-            buffer[snum - 4] = GPIOB->IDR;  
-            snum -= 4;
-        }
-    //5Mhz (Almost)
-     }else  if(samplingPeriod == 200){
-        while(likely(snum >= 4)){
-            buffer[snum - 1] = GPIOB->IDR;
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            
-            buffer[snum - 2] = GPIOB->IDR;
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            
-            buffer[snum - 3] = GPIOB->IDR;
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            
-            buffer[snum - 4] = GPIOB->IDR;
-            snum -= 4;
-        }
-    //2Mhz (True)
-     }else if(samplingPeriod == 500){
-        while(likely(snum >= 4)){
-            
-            buffer[snum - 1] = GPIOB->IDR;
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP");
-            
-            buffer[snum - 2] = GPIOB->IDR;
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\n\nNOP\nNOP\nNOP\nNOP\nNOP");
-            
-            buffer[snum - 3] = GPIOB->IDR;
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\n\nNOP\nNOP\nNOP\nNOP\nNOP");
-            
-            buffer[snum - 4] = GPIOB->IDR;
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\n");
-            snum -= 4;
-        }
-        //1Mhz (True)
-     }else if(samplingPeriod == 1000){
-        while(likely(snum >= 4)){
-
-            buffer[snum - 1] = GPIOB->IDR;
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP");
-            
-            buffer[snum - 2] = GPIOB->IDR;
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP");
-            
-            buffer[snum - 3] = GPIOB->IDR;
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP");
-            
-            buffer[snum - 4] = GPIOB->IDR;
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n");
-            __asm volatile ( " NOP\nNOP\nNOP\n");
-
-            snum -= 4;
-        }
-    //Others
-     }else {
-        uint32_t c = samplingPeriod/1000.0;
-        while(likely(snum >= 4)){
-            buffer[snum - 1] = GPIOB->IDR;
-            wait_us(c);
-            buffer[snum - 2] = GPIOB->IDR;
-            wait_us(c);
-            buffer[snum - 3] = GPIOB->IDR;
-            wait_us(c);
-            buffer[snum - 4] = GPIOB->IDR;
-            wait_us(c);
-            snum -= 4;
-        }
-    }
-}
-
-void Sampler::arm()
-{
-    if (flags & FLAGS_TEST) {
-        PwmOut pwm0(PB_0);
-        pwm0.period_us(1);
-        pwm0.write(0.5);
-
-        PwmOut pwm1(PB_1);
-        pwm1.period_us(10);
-        pwm1.write(0.5);
-
-        PwmOut pwm2(PB_3);
-        pwm2.period_us(100);
-        pwm2.write(0.5);
-
-        PwmOut pwm3(PB_4);
-        pwm3.period_us(500);
-        pwm3.write(0.5);
-
-        PwmOut pwm4(PB_5);
-        pwm4.period_ms(1);
-        pwm4.write(0.5);
-        
-        PwmOut pwm5(PB_6);
-        pwm5.period_ms(10);
-        pwm5.write(0.5);
-
-        PwmOut pwm6(PB_7);
-        pwm6.period_ms(100);
-        pwm6.write(0.5);
-
-        start();
-
-        pwm0.write(0);
-        pwm1.write(0);
-        pwm2.write(0);
-        pwm3.write(0);
-        pwm4.write(0);
-        pwm5.write(0);
-        pwm6.write(0);
-    }else{
-        start();
-    }
-
-    for(uint16_t i = 0;i < sampleNumber; i++)
-    {
-        pc->putc(buffer[i]);
-        while(!pc->writeable());
-    }
-}
-
-void Sampler::stop()
-{
-}
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+#include "mbed.h"
+#include "Sampler.h"
+#include "delay.h"
+#include <algorithm>
+#include <math.h>
+
+#define TRIGGER_PARALLEL 0
+#define TRIGGER_SERIAL 1
+#define TRIGGER_DISABLED 0xFF
+
+#define TRIGGER_MODE_SERIAL 0
+#define TRIGGER_MODE_PARALLEL 1
+
+#define FLAGS_DEMUX 1
+#define FLAGS_FILTER 2
+#define FLAGS_CHANNEL_GROUPS 0x3C
+#define FLAGS_EXTERNAL 0x40
+#define FLAGS_INVERTED 0x80
+#define FLAGS_TEST 0x400
+
+
+#define SUMP_ORIGINAL_FREQ  (100000000)
+#define SYSTEM_CLOCK_MULT (SystemCoreClock / 1000000)
+#define BUFFER_SIZE 32768
+#define MAX_FREQUENCY 10000000
+#define OVERVIEW_BINS 256
+
+//Largest upload chunk, chunks are followed by their CRC
+#define UPLOAD_MAX_CHUNK 4096
+
+//Time needed to check the UART and send one byte between two samples
+#define STREAM_SEND_CYCLES 200
+
+__attribute((section("AHBSRAM0"),aligned))  uint8_t  main_buffer[BUFFER_SIZE];
+
+volatile uint32_t test_port;
+
+#define FLASH_KERNEL(c) &flashKernel<c, KERNEL_UNROLL>
+#define RAM_KERNEL(c) &ramKernel<c, KERNEL_UNROLL>
+
+static const SampleKernelFn flashKernels[SAMPLE_KERNEL_COUNT] = {
+    FLASH_KERNEL(8),  FLASH_KERNEL(10), FLASH_KERNEL(12), FLASH_KERNEL(14), FLASH_KERNEL(16), FLASH_KERNEL(18),
+    FLASH_KERNEL(20), FLASH_KERNEL(22), FLASH_KERNEL(24), FLASH_KERNEL(26), FLASH_KERNEL(28), FLASH_KERNEL(30),
+    FLASH_KERNEL(32), FLASH_KERNEL(34), FLASH_KERNEL(36), FLASH_KERNEL(38), FLASH_KERNEL(40), FLASH_KERNEL(42),
+    FLASH_KERNEL(44), FLASH_KERNEL(46), FLASH_KERNEL(48), FLASH_KERNEL(50), FLASH_KERNEL(52), FLASH_KERNEL(54),
+    FLASH_KERNEL(56), FLASH_KERNEL(58), FLASH_KERNEL(60), FLASH_KERNEL(62), FLASH_KERNEL(64), FLASH_KERNEL(66),
+    FLASH_KERNEL(68), FLASH_KERNEL(70), FLASH_KERNEL(72), FLASH_KERNEL(74), FLASH_KERNEL(76), FLASH_KERNEL(78),
+    FLASH_KERNEL(80), FLASH_KERNEL(82), FLASH_KERNEL(84)
+};
+
+static const SampleKernelFn ramKernels[RAM_KERNEL_COUNT] = {
+    RAM_KERNEL(8),  RAM_KERNEL(10), RAM_KERNEL(12), RAM_KERNEL(14), RAM_KERNEL(16), RAM_KERNEL(18),
+    RAM_KERNEL(20), RAM_KERNEL(22), RAM_KERNEL(24), RAM_KERNEL(26), RAM_KERNEL(28), RAM_KERNEL(30),
+    RAM_KERNEL(32), RAM_KERNEL(34), RAM_KERNEL(36), RAM_KERNEL(38), RAM_KERNEL(40), RAM_KERNEL(42)
+};
+
+#define BENCH_SAMPLES 1024
+#define BENCH_RUNS 32
+#define BENCH_TRIGGER_VALUE 0x80
+#define BENCH_TRIGGER_SAMPLES 16
+
+#define SELFTEST_MIN_SAMPLES 4
+#define SELFTEST_MIN_PERIODS 4
+
+static const uint32_t selfTestRates[] = {10000000, 5000000, 2000000, 1000000, 500000, 200000, 100000, 50000, 20000, 10000};
+
+//Period of the test signal on each channel, in ns
+static const uint32_t testSignalPeriods[8] = {1000, 10000, 0, 100000, 500000, 1000000, 10000000, 100000000};
+
+#define likely(x) __builtin_expect((x),1)
+
+Sampler::Sampler(Serial *sp, PatternGenerator *pg)
+{
+    pc = sp;
+    generator = pg;
+    source = &GPIOB->IDR;
+    bufferSize = BUFFER_SIZE;
+    buffer =  main_buffer;
+
+    //Setup port
+    SET_BIT(RCC->AHB1ENR, RCC_AHB1ENR_GPIOBEN);
+    GPIOB->OSPEEDR = 3;         // High Speed
+    GPIOB->BSRR = 0xFFFF0000;   // No Special pins
+    GPIOB->MODER = 0;           // Input
+    GPIOB->PUPDR = 0;           // No pull up or pull down
+
+    EnablePrecisionTiming();
+
+    SET_BIT(RCC->AHB1ENR, RCC_AHB1ENR_CRCEN);
+
+    calibrateProtocolTrigger();
+    reset();
+}
+
+/* Worst cost of one pre-trigger step with every decoder, on random
+   samples: the port read, the decoder and the cycle counter read and
+   compare of the pacing loop. The samples come from the buffer through
+   test_port, which adds a load and a store to every step. */
+void Sampler::calibrateProtocolTrigger()
+{
+    static const uint8_t decoders[][3] = {      // protocol, channels, param
+        {PROTOCOL_UART, 0x00, 1}, {PROTOCOL_UART, 0x00, 3},
+        {PROTOCOL_SPI, 0x10, 0}, {PROTOCOL_SPI, 0x10, SPI_CS_ENABLE | 2},
+        {PROTOCOL_I2C, 0x10, 0}, {PROTOCOL_I2C, 0x10, I2C_MATCH_RW}
+    };
+    ProtocolTrigger decoder;
+    uint32_t seed = 1;
+    uint32_t worst = 0;
+
+    for(uint32_t i = 0; i < BENCH_SAMPLES; i++) {
+        seed = seed * 1103515245 + 12345;
+        buffer[i] = seed >> 16;
+    }
+
+    __disable_irq();
+    for(uint8_t d = 0; d < sizeof(decoders) / sizeof(decoders[0]); d++) {
+        uint32_t slowest = 0;
+
+        //The first pass fills the instruction cache
+        for(uint8_t pass = 0; pass < 2; pass++) {
+            decoder.configure(decoders[d][0], decoders[d][1], 0x5A, decoders[d][2]);
+            slowest = 0;
+
+            uint32_t last = *DWT_CYCCNT;
+            for(uint32_t i = 0; i < BENCH_SAMPLES; i++) {
+                test_port = buffer[i];
+                if(decoder.feed(PORT_READ(&test_port, KERNEL_READ_CYCLES)))
+                    decoder.reset();
+
+                uint32_t now = *DWT_CYCCNT;
+                slowest = max(slowest, now - last);
+                last = now;
+            }
+        }
+        worst = max(worst, slowest);
+    }
+    __enable_irq();
+
+    protocolTrigger.setCycleBudget(worst);
+}
+
+void Sampler::reset()
+{
+    buffer_index = 0;
+    setTriggerMask(0);
+    setTriggerValue(0);
+    setTriggerState(0);
+    setSamplingDivider(11);
+    setFlags(0);
+    setSampleNumber(bufferSize);
+    setSamplingDelay(0);
+    setProtocolTrigger(PROTOCOL_NONE, 0, 0, 0);
+    setReadWindow(0, 0);
+    setUploadChunk(0);
+}
+
+uint32_t Sampler::getMaxFrequency(){
+    return MAX_FREQUENCY;
+}
+
+uint32_t Sampler::getProtocolTriggerMaxFrequency(){
+    return protocolTrigger.getMaxFrequency();
+}
+
+uint32_t Sampler::getBufferSize(){
+    return bufferSize;
+}
+
+//Last capture, newest sample first
+uint8_t *Sampler::getBuffer(){
+    return buffer;
+}
+
+uint32_t Sampler::getSampleNumber(){
+    return sampleNumber;
+}
+
+//Exact for the generated kernels, nominal for the generic one
+uint32_t Sampler::getSamplePeriodCycles(){
+    if(kernel != KERNEL_GENERIC)
+        return KERNEL_MIN_CYCLES + kernel * KERNEL_STEP_CYCLES;
+
+    return samplingPeriod * SYSTEM_CLOCK_MULT / 1000;
+}
+
+void Sampler::setSamplingDivider(uint32_t divider)
+{
+    //Max speed is 10Mhz
+    if(divider < 9)
+        divider = 9;
+
+    samplingPeriod = (divider+1)*10;
+
+    //Nearest exact-cycle kernel, if any
+    uint32_t cycles = (samplingPeriod * SYSTEM_CLOCK_MULT + 500) / 1000;
+    cycles = (cycles + KERNEL_STEP_CYCLES / 2) / KERNEL_STEP_CYCLES * KERNEL_STEP_CYCLES;
+
+    if(cycles < KERNEL_MIN_CYCLES)
+        cycles = KERNEL_MIN_CYCLES;
+
+    if(cycles <= KERNEL_MAX_CYCLES)
+        kernel = (cycles - KERNEL_MIN_CYCLES) / KERNEL_STEP_CYCLES;
+    else
+        kernel = KERNEL_GENERIC;
+
+    if(kernel < RAM_KERNEL_COUNT)
+        sampleKernel = ramKernels[kernel];
+    else if(kernel < SAMPLE_KERNEL_COUNT)
+        sampleKernel = flashKernels[kernel];
+}
+
+void Sampler::setSampleNumber(uint32_t s)
+{
+    sampleNumber = min((uint32_t) bufferSize, s);
+}
+
+void Sampler::setSamplingDelay(uint16_t s)
+{
+    sampleDelay = s;
+}
+
+void Sampler::setTriggerMask(uint32_t s)
+{
+    triggerMask = s;
+}
+void Sampler::setTriggerValue(uint32_t s)
+{
+    triggerValue = s & 0xFF;
+}
+
+void Sampler::setTriggerState(uint8_t state){
+    triggerState = state;
+}
+
+void Sampler::setFlags(uint32_t s)
+{
+    flags = s;
+}
+
+void Sampler::setProtocolTrigger(uint8_t protocol, uint8_t channels, uint8_t match, uint8_t param)
+{
+    protocolTrigger.configure(protocol, channels, match, param);
+}
+
+/* Captures a counter followed by walking ones, written by the pattern
+   generator into a RAM word at the sampling rate. The samples go through
+   the same kernel and upload path as a real capture. */
+void Sampler::runTest()
+{
+    uint8_t *pattern = generator->getBuffer();
+    uint16_t length = 0;
+
+    for(uint16_t i = 0; i < 256; i++)
+        pattern[length++] = i;
+
+    for(uint8_t i = 0; i < 8; i++)
+        pattern[length++] = 1 << i;
+
+    test_port = 0;
+    generator->setLength(length, PATTERN_FLAGS_LOOP);
+    generator->setDivider(samplingPeriod / 10 - 1);
+    generator->start(&test_port);
+
+    source = &test_port;
+    start();
+    source = &GPIOB->IDR;
+
+    generator->stop();
+    upload();
+}
+
+void Sampler::start()
+{
+
+    int32_t snum = sampleNumber;
+    volatile uint32_t *port = source;
+
+
+    counters.captures++;
+
+    if(sampleDelay > 0){
+        wait_us(sampleDelay);
+    }
+
+    uint32_t w0 = *DWT_CYCCNT;
+    waitForTrigger(port);
+
+    uint64_t cycles;
+
+    /* Any interrupt would stretch the samples around it. The RX DMA
+       keeps receiving commands, its interrupts and an activity monitor
+       half stay pending and are taken when the kernel returns. */
+    if(kernel != KERNEL_GENERIC){
+        NVIC_DisableIRQ(USART2_IRQn);
+        NVIC_DisableIRQ(DMA1_Stream5_IRQn);
+        NVIC_DisableIRQ(DMA2_Stream1_IRQn);
+    }
+
+    uint32_t t0 = *DWT_CYCCNT;
+
+    if(kernel != KERNEL_GENERIC){
+        snum = sampleKernel(port, buffer, snum);
+        cycles = *DWT_CYCCNT - t0;
+        NVIC_EnableIRQ(USART2_IRQn);
+        NVIC_EnableIRQ(DMA1_Stream5_IRQn);
+        if(DMA2_Stream1->CR & DMA_SxCR_EN)
+            NVIC_EnableIRQ(DMA2_Stream1_IRQn);
+    //Others
+    }else {
+        uint32_t c = samplingPeriod/1000.0;
+
+        //Slow captures can outlast the 32 bit cycle counter
+        uint32_t last = t0;
+        cycles = 0;
+        while(likely(snum >= 4)){
+            buffer[snum - 1] = PORT_READ(port, KERNEL_READ_CYCLES);
+            wait_us(c);
+            buffer[snum - 2] = PORT_READ(port, KERNEL_READ_CYCLES);
+            wait_us(c);
+            buffer[snum - 3] = PORT_READ(port, KERNEL_READ_CYCLES);
+            wait_us(c);
+            buffer[snum - 4] = PORT_READ(port, KERNEL_READ_CYCLES);
+            wait_us(c);
+            snum -= 4;
+
+            uint32_t now = *DWT_CYCCNT;
+            cycles += now - last;
+            last = now;
+        }
+    }
+
+    recordTiming(kernel, cycles, sampleNumber - snum);
+    recordTrigger(w0, t0);
+}
+
+void Sampler::waitForTrigger(volatile uint32_t *port)
+{
+    if(protocolTrigger.isEnabled()){
+        //Decoder runs at the sampling rate, but never faster than its budget
+        uint32_t sampleCycles = samplingPeriod * SYSTEM_CLOCK_MULT / 1000;
+        uint32_t period = max(sampleCycles, protocolTrigger.getCycleBudget());
+
+        protocolTrigger.setStepCycles(sampleCycles, period);
+        protocolTrigger.reset();
+        uint32_t next = *DWT_CYCCNT;
+        while(!protocolTrigger.feed(PORT_READ(port, KERNEL_READ_CYCLES))){
+            next += period;
+            while((int32_t)(*DWT_CYCCNT - next) < 0);
+        }
+    }else if(triggerState == 1){
+        while((PORT_READ(port, KERNEL_READ_CYCLES + KERNEL_LOOP_CYCLES) & triggerMask) != triggerValue);
+    }
+}
+
+/* Achieved mean sample period of the last capture, kept per kernel and
+   expressed as a rate and a deviation from the nominal period. */
+void Sampler::recordTiming(uint8_t k, uint64_t cycles, uint32_t samples)
+{
+    if(samples == 0 || cycles == 0)
+        return;
+
+    double actual = (double) cycles / SystemCoreClock / samples;
+    double nominal = samplingPeriod * 1e-9;
+
+    KernelTiming &t = kernelTiming[k];
+    t.rate = 1000000000 / samplingPeriod;
+    t.achievedRate = 1.0 / actual + 0.5;
+    t.deviation = (actual / nominal - 1.0) * 1e6;
+    t.captures++;
+
+    lastTiming = t;
+}
+
+/* Trigger counters, kept after the capture so that they add nothing
+   between the trigger and the first sample. The end of the wait is the
+   cycle count the capture starts from. */
+void Sampler::recordTrigger(uint32_t waitStart, uint32_t triggered)
+{
+    if(protocolTrigger.isEnabled() || triggerState == 1)
+        counters.triggers++;
+
+    counters.triggerWait = triggered - waitStart;
+}
+
+uint32_t Sampler::getAchievedFrequency(){
+    return lastTiming.achievedRate;
+}
+
+int32_t Sampler::getPeriodDeviation(){
+    return lastTiming.deviation;
+}
+
+const KernelTiming &Sampler::getKernelTiming(uint8_t k){
+    return kernelTiming[k];
+}
+
+const CodecTiming &Sampler::getCodecTiming(){
+    return codecTiming;
+}
+
+const UploadTiming &Sampler::getUploadTiming(){
+    return uploadTiming;
+}
+
+const SamplerCounters &Sampler::getCounters(){
+    return counters;
+}
+
+//Captures without uploading, the samples stay in the buffer
+void Sampler::capture()
+{
+    if (flags & FLAGS_TEST) {
+        startWithTestSignals();
+    }else{
+        start();
+    }
+}
+
+void Sampler::arm()
+{
+    capture();
+    upload();
+}
+
+/* Captures and uploads at the same time, oldest sample first. The
+   samples are paced with the cycle counter and the time left before the
+   next sample is used to send the samples already captured, so at low
+   rates the upload ends shortly after the capture. Rates served by the
+   exact-cycle kernels leave no time between samples: they capture first
+   and upload after, in the same order. The upload is timed from its
+   first byte, which is the trigger when it overlaps the capture. */
+void Sampler::armStreaming()
+{
+    uint32_t sent = 0;
+    uint32_t t0;
+
+    if (flags & FLAGS_TEST) {
+        startWithTestSignals();
+        t0 = *DWT_CYCCNT;
+    }else if(kernel != KERNEL_GENERIC){
+        start();
+        t0 = *DWT_CYCCNT;
+    }else {
+        volatile uint32_t *port = source;
+        uint32_t period = samplingPeriod * SYSTEM_CLOCK_MULT / 1000;
+
+        counters.captures++;
+
+        if(sampleDelay > 0){
+            wait_us(sampleDelay);
+        }
+
+        uint32_t w0 = *DWT_CYCCNT;
+        waitForTrigger(port);
+
+        uint32_t next = *DWT_CYCCNT;
+        uint32_t triggered = next;
+        uint32_t last = next;
+        uint64_t cycles = 0;
+        t0 = triggered;
+
+        for(uint32_t s = sampleNumber; s > 0; s--){
+            buffer[s - 1] = PORT_READ(port, KERNEL_READ_CYCLES);
+            next += period;
+
+            uint32_t captured = sampleNumber - s + 1;
+            while((int32_t)(*DWT_CYCCNT - next) < 0){
+                if(sent < captured && (int32_t)(next - *DWT_CYCCNT) > STREAM_SEND_CYCLES && pc->writeable())
+                    pc->putc(buffer[sampleNumber - 1 - sent++]);
+            }
+
+            uint32_t now = *DWT_CYCCNT;
+            cycles += now - last;
+            last = now;
+        }
+
+        recordTiming(KERNEL_GENERIC, cycles, sampleNumber);
+        recordTrigger(w0, triggered);
+    }
+
+    for(; sent < sampleNumber; sent++){
+        while(!pc->writeable());
+        pc->putc(buffer[sampleNumber - 1 - sent]);
+    }
+
+    uploadTiming.bytes = sampleNumber;
+    uploadTiming.cycles = *DWT_CYCCNT - t0;
+    counters.uploads++;
+}
+
+//Captures as arm() does, but only sends the overview
+void Sampler::armProgressive()
+{
+    capture();
+    uploadOverview(0);
+}
+
+/* Sends the capture summarised in bins of binSize samples (0 picks the
+   size for OVERVIEW_BINS bins): the bin size and count (uint32, big
+   endian), then the OR and the AND of the samples of every bin, in the
+   upload order (newest first). A channel changed within a bin when its
+   OR and AND bits differ. Four samples are folded per word operation. */
+void Sampler::uploadOverview(uint32_t binSize)
+{
+    if(binSize == 0)
+        binSize = (sampleNumber + OVERVIEW_BINS - 1) / OVERVIEW_BINS;
+    binSize = max((uint32_t) 1, min(binSize, sampleNumber));
+
+    uint32_t bins = (sampleNumber + binSize - 1) / binSize;
+    putUInt(binSize);
+    putUInt(bins);
+
+    for(uint32_t from = 0; from < sampleNumber; from += binSize) {
+        uint32_t to = min(from + binSize, sampleNumber);
+        uint32_t i = from;
+        uint8_t orValue = 0;
+        uint8_t andValue = 0xFF;
+
+        for(; i < to && (i & 3); i++) {
+            orValue |= buffer[i];
+            andValue &= buffer[i];
+        }
+
+        uint32_t orWord = 0;
+        uint32_t andWord = 0xFFFFFFFF;
+        for(; i + 4 <= to; i += 4) {
+            uint32_t w = *(uint32_t *) (buffer + i);
+            orWord |= w;
+            andWord &= w;
+        }
+
+        for(; i < to; i++) {
+            orValue |= buffer[i];
+            andValue &= buffer[i];
+        }
+
+        orWord |= orWord >> 16;
+        orWord |= orWord >> 8;
+        andWord &= andWord >> 16;
+        andWord &= andWord >> 8;
+
+        pc->putc(orValue | (orWord & 0xFF));
+        while(!pc->writeable());
+        pc->putc(andValue & (andWord & 0xFF));
+        while(!pc->writeable());
+    }
+}
+
+//Offsets count in the upload order, so a failed transfer can be read again from where it broke
+void Sampler::setReadWindow(uint16_t offset, uint16_t length)
+{
+    windowOffset = offset;
+    windowLength = length;
+}
+
+//Codec outputs, the sizing pass and the upload
+static void discardByte(void *, uint8_t)
+{
+}
+
+static void sendByte(void *context, uint8_t v)
+{
+    Serial *pc = (Serial *) context;
+    pc->putc(v);
+    while(!pc->writeable());
+}
+
+/* Sends a window of the last capture: the payload size (uint32, big
+   endian), then every decimation-th sample of the window, raw, as
+   (value, run length - 1) pairs, runs being at most 256 samples, or
+   delta + LZ coded (CaptureCodec). The RLE and LZ payloads are measured
+   in a first pass. */
+void Sampler::uploadWindow(uint16_t decimation, uint8_t mode)
+{
+    uint32_t from = min((uint32_t) windowOffset, sampleNumber);
+    uint32_t to = min(from + (windowLength ? windowLength : sampleNumber), sampleNumber);
+    uint32_t step = max((uint16_t) 1, decimation);
+
+    if(mode != WINDOW_RLE && mode != WINDOW_LZ) {
+        putUInt((to - from + step - 1) / step);
+        for(uint32_t i = from; i < to; i += step) {
+            pc->putc(buffer[i]);
+            while(!pc->writeable());
+        }
+        return;
+    }
+
+    if(mode == WINDOW_LZ) {
+        uint32_t count = (to - from + step - 1) / step;
+
+        //Sizing pass, which is also the encoder timing
+        uint32_t t0 = *DWT_CYCCNT;
+        uint32_t size = codec.encode(buffer + from, count, step, discardByte, NULL);
+        codecTiming.cycles = *DWT_CYCCNT - t0;
+        codecTiming.samples = count;
+        codecTiming.bytes = size;
+
+        putUInt(size);
+        codec.encode(buffer + from, count, step, sendByte, pc);
+        return;
+    }
+
+    putUInt(encodeRle(from, to, step, false));
+    encodeRle(from, to, step, true);
+}
+
+//(value, run length - 1) pairs of every step-th sample, sent or only counted
+uint32_t Sampler::encodeRle(uint32_t from, uint32_t to, uint32_t step, bool send)
+{
+    uint32_t size = 0;
+
+    for(uint32_t i = from; i < to; ) {
+        uint8_t value = buffer[i];
+        uint32_t run = 1;
+
+        while(run < 256 && i + run * step < to && buffer[i + run * step] == value)
+            run++;
+        i += run * step;
+        size += 2;
+
+        if(send) {
+            pc->putc(value);
+            while(!pc->writeable());
+            pc->putc(run - 1);
+            while(!pc->writeable());
+        }
+    }
+    return size;
+}
+
+void Sampler::putUInt(uint32_t v)
+{
+    for(int8_t shift = 24; shift >= 0; shift -= 8) {
+        pc->putc(v >> shift);
+        while(!pc->writeable());
+    }
+}
+
+//PWM signals from 1us to 100ms on PB0-PB7 (PB2 is not driven)
+void Sampler::startWithTestSignals()
+{
+    PwmOut pwm0(PB_0);
+    pwm0.period_us(1);
+    pwm0.write(0.5);
+
+    PwmOut pwm1(PB_1);
+    pwm1.period_us(10);
+    pwm1.write(0.5);
+
+    PwmOut pwm2(PB_3);
+    pwm2.period_us(100);
+    pwm2.write(0.5);
+
+    PwmOut pwm3(PB_4);
+    pwm3.period_us(500);
+    pwm3.write(0.5);
+
+    PwmOut pwm4(PB_5);
+    pwm4.period_ms(1);
+    pwm4.write(0.5);
+
+    PwmOut pwm5(PB_6);
+    pwm5.period_ms(10);
+    pwm5.write(0.5);
+
+    PwmOut pwm6(PB_7);
+    pwm6.period_ms(100);
+    pwm6.write(0.5);
+
+    start();
+
+    pwm0.write(0);
+    pwm1.write(0);
+    pwm2.write(0);
+    pwm3.write(0);
+    pwm4.write(0);
+    pwm5.write(0);
+    pwm6.write(0);
+}
+
+/* Captures the test signals at every rate and prints, for the channel with
+   the most periods that still spans at least SELFTEST_MIN_SAMPLES samples
+   per period, the measured period error and jitter (in samples).
+   The capture configuration is reset before and after the test. */
+void Sampler::selfTest()
+{
+    reset();
+
+    pc->printf("rate     ch expected measured  error%% jitter stddev\r\n");
+
+    for(uint8_t r = 0; r < sizeof(selfTestRates) / sizeof(selfTestRates[0]); r++) {
+        uint32_t rate = selfTestRates[r];
+
+        setSamplingDivider(SUMP_ORIGINAL_FREQ / rate - 1);
+        startWithTestSignals();
+
+        int8_t channel = -1;
+        float expected = 0;
+
+        //Channels are sorted by period, the first usable one has the most periods
+        for(uint8_t ch = 0; ch < 8 && channel < 0; ch++) {
+            if(testSignalPeriods[ch] == 0)
+                continue;
+
+            float e = (float) testSignalPeriods[ch] * rate / 1e9f;
+            if(e >= SELFTEST_MIN_SAMPLES && e * SELFTEST_MIN_PERIODS <= sampleNumber) {
+                channel = ch;
+                expected = e;
+            }
+        }
+
+        if(channel < 0) {
+            pc->printf("%-8lu  - no usable test signal\r\n", rate);
+            continue;
+        }
+
+        uint32_t count = 0;
+        uint32_t minPeriod = 0xFFFFFFFF;
+        uint32_t maxPeriod = 0;
+        float sum = 0;
+        float sumSq = 0;
+        int32_t lastEdge = -1;
+        uint8_t last = 1;
+
+        //Chronological order is from the end of the buffer
+        for(uint32_t t = 0; t < sampleNumber; t++) {
+            uint8_t v = (buffer[sampleNumber - 1 - t] >> channel) & 1;
+
+            if(v && !last) {
+                if(lastEdge >= 0) {
+                    uint32_t period = t - lastEdge;
+                    sum += period;
+                    sumSq += (float) period * period;
+                    minPeriod = min(minPeriod, period);
+                    maxPeriod = max(maxPeriod, period);
+                    count++;
+                }
+                lastEdge = t;
+            }
+            last = v;
+        }
+
+        if(count == 0) {
+            pc->printf("%-8lu %2d %8.2f no edges\r\n", rate, channel, expected);
+            continue;
+        }
+
+        float mean = sum / count;
+        float stddev = sqrtf(max(0.0f, sumSq / count - mean * mean));
+
+        pc->printf("%-8lu %2d %8.2f %8.2f %+7.2f %6lu %6.2f\r\n", rate, channel, expected, mean,
+                   100.0f * (mean - expected) / expected, maxPeriod - minPeriod, stddev);
+    }
+
+    reset();
+    pc->putc(0);
+}
+
+/* Runs every kernel that has a RAM copy from flash and from RAM, with
+   interrupts off and the ART instruction cache flushed before each run,
+   and prints the mean cycles per sample and the spread between runs. */
+void Sampler::benchmarkKernels()
+{
+    pc->printf("cycles   flash  spread     ram  spread\r\n");
+
+    for(uint8_t k = 0; k < RAM_KERNEL_COUNT; k++) {
+        uint32_t cycles = KERNEL_MIN_CYCLES + k * KERNEL_STEP_CYCLES;
+        uint32_t flashMin, flashMax, ramMin, ramMax;
+        float flashMean = benchmarkKernel(flashKernels[k], flashMin, flashMax);
+        float ramMean = benchmarkKernel(ramKernels[k], ramMin, ramMax);
+
+        pc->printf("%6lu %7.3f %7lu %7.3f %7lu\r\n", cycles, flashMean, flashMax - flashMin, ramMean, ramMax - ramMin);
+    }
+
+    pc->putc(0);
+}
+
+//Mean cycles per sample of a kernel, from flash or from its RAM copy
+float Sampler::benchmarkKernel(uint8_t k, bool ram, uint32_t &spread)
+{
+    uint32_t minCycles, maxCycles;
+    float mean = benchmarkKernel(ram ? ramKernels[k] : flashKernels[k], minCycles, maxCycles);
+
+    spread = maxCycles - minCycles;
+    return mean;
+}
+
+float Sampler::benchmarkKernel(SampleKernelFn fn, uint32_t &minCycles, uint32_t &maxCycles)
+{
+    uint64_t total = 0;
+    minCycles = 0xFFFFFFFF;
+    maxCycles = 0;
+
+    for(uint8_t r = 0; r < BENCH_RUNS; r++) {
+        FLASH->ACR &= ~FLASH_ACR_ICEN;
+        FLASH->ACR |= FLASH_ACR_ICRST;
+        FLASH->ACR &= ~FLASH_ACR_ICRST;
+        FLASH->ACR |= FLASH_ACR_ICEN;
+
+        __disable_irq();
+        uint32_t t0 = *DWT_CYCCNT;
+        fn(source, buffer, BENCH_SAMPLES);
+        uint32_t t = *DWT_CYCCNT - t0;
+        __enable_irq();
+
+        total += t;
+        minCycles = min(minCycles, t);
+        maxCycles = max(maxCycles, t);
+    }
+
+    return (float) total / (BENCH_RUNS * BENCH_SAMPLES);
+}
+
+/* Time from a trigger match to the first sample of the fastest kernel.
+   The pattern generator writes a counter into test_port at its fastest
+   rate and a parallel trigger on BENCH_TRIGGER_VALUE starts a capture of
+   it through start(), as an arm command would, so the oldest sample tells
+   how many counter steps went by, with a resolution of one step. The
+   pattern and its divider are replaced, as in runTest; the capture
+   settings and counters are put back after the runs. */
+void Sampler::benchmarkTrigger(TriggerTiming &timing)
+{
+    uint8_t *pattern = generator->getBuffer();
+    uint64_t total = 0;
+
+    for(uint16_t i = 0; i < 256; i++)
+        pattern[i] = i;
+
+    test_port = 0;
+    generator->setLength(256, PATTERN_FLAGS_LOOP);
+    generator->setDivider(0);
+
+    uint32_t period = samplingPeriod;
+    uint32_t samples = sampleNumber;
+    uint32_t delay = sampleDelay;
+    uint32_t mask = triggerMask;
+    uint32_t value = triggerValue;
+    uint8_t state = triggerState;
+    ProtocolTrigger protocol = protocolTrigger;
+    SamplerCounters saved = counters;
+    KernelTiming fastest = kernelTiming[0];
+    KernelTiming last = lastTiming;
+
+    //Clamped to the fastest kernel
+    setSamplingDivider(0);
+    setSampleNumber(BENCH_TRIGGER_SAMPLES);
+    setSamplingDelay(0);
+    setTriggerMask(0xFF);
+    setTriggerValue(BENCH_TRIGGER_VALUE);
+    setTriggerState(1);
+    protocolTrigger.configure(PROTOCOL_NONE, 0, 0, 0);
+    source = &test_port;
+
+    timing.resolution = generator->getStepCycles();
+    timing.max = 0;
+
+    for(uint8_t r = 0; r < BENCH_RUNS; r++) {
+        generator->start(&test_port);
+        start();
+        generator->stop();
+
+        uint8_t steps = buffer[BENCH_TRIGGER_SAMPLES - 1] - BENCH_TRIGGER_VALUE;
+        uint32_t t = steps * timing.resolution;
+        total += t;
+        timing.max = max(timing.max, t);
+    }
+
+    timing.mean = total / BENCH_RUNS;
+
+    source = &GPIOB->IDR;
+    setSamplingDivider(period / 10 - 1);
+    sampleNumber = samples;
+    sampleDelay = delay;
+    triggerMask = mask;
+    triggerValue = value;
+    triggerState = state;
+    protocolTrigger = protocol;
+    counters = saved;
+    kernelTiming[0] = fastest;
+    lastTiming = last;
+}
+
+//Both window encoders on the whole last capture, without the UART
+void Sampler::benchmarkEncoders(CodecTiming &rle, CodecTiming &lz)
+{
+    uint32_t t0 = *DWT_CYCCNT;
+    rle.bytes = encodeRle(0, sampleNumber, 1, false);
+    rle.cycles = *DWT_CYCCNT - t0;
+    rle.samples = sampleNumber;
+
+    t0 = *DWT_CYCCNT;
+    lz.bytes = codec.encode(buffer, sampleNumber, 1, discardByte, NULL);
+    lz.cycles = *DWT_CYCCNT - t0;
+    lz.samples = sampleNumber;
+}
+
+void Sampler::upload()
+{
+    uint32_t t0 = *DWT_CYCCNT;
+
+    if(uploadChunkSize > 0) {
+        uint32_t chunks = 0;
+        for(; chunks * uploadChunkSize < sampleNumber; chunks++)
+            uploadChunk(chunks);
+        uploadTiming.bytes = sampleNumber + chunks * 4;
+    }else {
+        for(uint16_t i = 0;i < sampleNumber; i++)
+        {
+            pc->putc(buffer[i]);
+            while(!pc->writeable());
+        }
+        uploadTiming.bytes = sampleNumber;
+    }
+
+    uploadTiming.cycles = *DWT_CYCCNT - t0;
+    counters.uploads++;
+}
+
+//Multiple of 4 samples, 0 for the plain upload
+void Sampler::setUploadChunk(uint16_t size)
+{
+    uploadChunkSize = min((uint16_t) UPLOAD_MAX_CHUNK, size) & ~3;
+}
+
+/* CRC unit: CRC-32 (0x04C11DB7) from 0xFFFFFFFF, without reflection or
+   final XOR, fed with the little endian words of the samples. Chunks
+   start at multiples of 4 in the word aligned buffer. */
+uint32_t Sampler::chunkCrc(uint32_t offset, uint32_t length)
+{
+    const uint32_t *words = (const uint32_t *) (buffer + offset);
+
+    CRC->CR = CRC_CR_RESET;
+    for(uint32_t i = 0; i < length / 4; i++)
+        CRC->DR = words[i];
+
+    return CRC->DR;
+}
+
+//Samples of the chunk in upload order, then its CRC (big endian)
+void Sampler::uploadChunk(uint16_t index)
+{
+    uint32_t offset = index * uploadChunkSize;
+
+    if(uploadChunkSize == 0 || offset >= sampleNumber)
+        return;
+
+    uint32_t length = min((uint32_t) uploadChunkSize, sampleNumber - offset);
+    uint32_t crc = chunkCrc(offset, length);
+
+    for(uint32_t i = offset; i < offset + length; i++) {
+        pc->putc(buffer[i]);
+        while(!pc->writeable());
+    }
+    putUInt(crc);
+}
+
+void Sampler::stop()
+{
+}
@@ -1,48 +1,143 @@
-#ifndef SAMPLER_H
-#define SAMPLER_H
-#include "mbed.h"
-
-class Sampler{
-
-public:
-
-    Sampler(Serial*);
-
-    void start();
-    void arm();
-    void stop();
-    void reset();
-    void runTest();
-
-    //Getters and Setters
-    uint32_t getBufferSize();
-    uint32_t getMaxFrequency();
-
-    void setSamplingDivider(uint32_t);
-    void setSampleNumber(uint32_t);
-    void setSamplingDelay(uint16_t);
-    void setTriggerMask(uint32_t);
-    void setTriggerValue(uint32_t);
-    void setTriggerState(uint8_t);
-    void setFlags(uint32_t);
-
-
-private:
-    uint8_t *buffer;
-    uint16_t buffer_index;
-    uint8_t buffer_rle_value;
-    uint8_t buffer_rle_count;
-
-    uint32_t samplingPeriod;
-    uint32_t sampleNumber;
-    uint32_t sampleDelay;
-    uint32_t triggerMask;
-    uint32_t triggerValue;
-    uint8_t  triggerState;
-    uint32_t flags;
-
-    uint32_t bufferSize;
-
-    Serial *pc;
-};
+#ifndef SAMPLER_H
+#define SAMPLER_H
+#include "mbed.h"
+#include "ProtocolTrigger.h"
+#include "PatternGenerator.h"
+#include "SampleKernel.h"
+#include "CaptureCodec.h"
+
+//Generated kernels, then the wait_us based one
+#define KERNEL_GENERIC SAMPLE_KERNEL_COUNT
+#define KERNEL_COUNT (SAMPLE_KERNEL_COUNT + 1)
+
+//Readback encodings
+#define WINDOW_RAW 0
+#define WINDOW_RLE 1
+#define WINDOW_LZ 2
+
+struct KernelTiming{
+    uint32_t rate;          // Nominal rate of the last capture, Hz
+    uint32_t achievedRate;  // Measured rate, Hz
+    int32_t deviation;      // Measured period vs nominal, ppm
+    uint32_t captures;
+};
+
+struct CodecTiming{
+    uint32_t samples;       // Last delta + LZ readback
+    uint32_t bytes;
+    uint32_t cycles;        // Encoder only, without the UART
+};
+
+struct UploadTiming{
+    uint32_t bytes;         // Last arm, streaming arm or test upload, with the chunk CRCs
+    uint32_t cycles;
+};
+
+//Since power up, one increment per capture or upload
+struct SamplerCounters{
+    uint32_t captures;      // Started, including any still waiting for the trigger
+    uint32_t triggers;      // Captures started by a trigger
+    uint32_t triggerWait;   // Last wait for the trigger, core cycles (modulo 2^32)
+    uint32_t uploads;
+};
+
+struct TriggerTiming{
+    uint32_t mean;          // Trigger match to the first sample, core cycles
+    uint32_t max;
+    uint32_t resolution;
+};
+
+class Sampler{
+
+public:
+
+    Sampler(Serial*, PatternGenerator*);
+
+    void start();
+    void capture();
+    void arm();
+    void armProgressive();
+    void armStreaming();
+    void uploadOverview(uint32_t binSize);
+    void uploadWindow(uint16_t decimation, uint8_t mode);
+    void uploadChunk(uint16_t index);
+    void stop();
+    void reset();
+    void runTest();
+    void selfTest();
+    void benchmarkKernels();
+    float benchmarkKernel(uint8_t, bool ram, uint32_t &spread);
+    void benchmarkTrigger(TriggerTiming &);
+    void benchmarkEncoders(CodecTiming &rle, CodecTiming &lz);
+
+    //Getters and Setters
+    uint32_t getBufferSize();
+    uint8_t *getBuffer();
+    uint32_t getSampleNumber();
+    uint32_t getSamplePeriodCycles();
+    uint32_t getMaxFrequency();
+    uint32_t getProtocolTriggerMaxFrequency();
+    uint32_t getAchievedFrequency();
+    int32_t getPeriodDeviation();
+    const KernelTiming &getKernelTiming(uint8_t);
+    const CodecTiming &getCodecTiming();
+    const UploadTiming &getUploadTiming();
+    const SamplerCounters &getCounters();
+
+    void setSamplingDivider(uint32_t);
+    void setSampleNumber(uint32_t);
+    void setSamplingDelay(uint16_t);
+    void setTriggerMask(uint32_t);
+    void setTriggerValue(uint32_t);
+    void setTriggerState(uint8_t);
+    void setFlags(uint32_t);
+    void setProtocolTrigger(uint8_t, uint8_t, uint8_t, uint8_t);
+    void setReadWindow(uint16_t offset, uint16_t length);
+    void setUploadChunk(uint16_t);
+
+
+private:
+    void upload();
+    void putUInt(uint32_t);
+    uint32_t chunkCrc(uint32_t offset, uint32_t length);
+    uint32_t encodeRle(uint32_t from, uint32_t to, uint32_t step, bool send);
+    void startWithTestSignals();
+    void waitForTrigger(volatile uint32_t *);
+    void calibrateProtocolTrigger();
+    void recordTiming(uint8_t, uint64_t, uint32_t);
+    void recordTrigger(uint32_t waitStart, uint32_t triggered);
+    float benchmarkKernel(SampleKernelFn, uint32_t &, uint32_t &);
+
+    uint8_t *buffer;
+    volatile uint32_t *source;
+    uint16_t buffer_index;
+    uint8_t buffer_rle_value;
+    uint8_t buffer_rle_count;
+
+    uint32_t samplingPeriod;
+    uint8_t kernel;
+    SampleKernelFn sampleKernel;
+    uint32_t sampleNumber;
+    uint32_t sampleDelay;
+    uint32_t triggerMask;
+    uint32_t triggerValue;
+    uint8_t  triggerState;
+    uint32_t flags;
+    ProtocolTrigger protocolTrigger;
+
+    uint32_t bufferSize;
+    uint16_t windowOffset;
+    uint16_t windowLength;
+    uint16_t uploadChunkSize;
+
+    KernelTiming kernelTiming[KERNEL_COUNT];
+    KernelTiming lastTiming;
+    CaptureCodec codec;
+    CodecTiming codecTiming;
+    UploadTiming uploadTiming;
+    SamplerCounters counters;
+
+    Serial *pc;
+    PatternGenerator *generator;
+};
 #endif
\ No newline at end of file
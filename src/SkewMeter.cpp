@@ -0,0 +1,140 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+#include "mbed.h"
+#include "SkewMeter.h"
+#include <algorithm>
+
+#define NO_EDGE -1
+
+SkewMeter::SkewMeter(TransitionIndex *ti)
+{
+    index = ti;
+    configure(0, 1, SKEW_RISING | SKEW_FALLING, 0);
+}
+
+//A zero window accepts any distance
+void SkewMeter::configure(uint8_t r, uint8_t o, uint8_t e, uint8_t w)
+{
+    reference = r & 0x07;
+    other = o & 0x07;
+    edges = e & (SKEW_RISING | SKEW_FALLING);
+    window = w ? w : 0xFFFFFFFF;
+
+    if(edges == 0)
+        edges = SKEW_RISING | SKEW_FALLING;
+
+    pairs = 0;
+    minSkew = maxSkew = 0;
+    sum = 0;
+}
+
+uint32_t SkewMeter::getPairs()
+{
+    return pairs;
+}
+
+int32_t SkewMeter::getMin()
+{
+    return minSkew;
+}
+
+int32_t SkewMeter::getMax()
+{
+    return maxSkew;
+}
+
+int32_t SkewMeter::getMeanMilli()
+{
+    return pairs ? sum * 1000 / (int64_t) pairs : 0;
+}
+
+void SkewMeter::pair(int32_t edge, int32_t before, int32_t after)
+{
+    int32_t skew;
+
+    if(before == NO_EDGE && after == NO_EDGE)
+        return;
+    else if(before == NO_EDGE)
+        skew = after - edge;
+    else if(after == NO_EDGE)
+        skew = before - edge;
+    else
+        skew = (after - edge) < (edge - before) ? after - edge : before - edge;
+
+    if((uint32_t) abs(skew) > window)
+        return;
+
+    //Positions run backwards in time
+    skew = -skew;
+
+    minSkew = pairs ? min(minSkew, skew) : skew;
+    maxSkew = pairs ? max(maxSkew, skew) : skew;
+    sum += skew;
+    pairs++;
+}
+
+/* Walks the transition index, which is in buffer order, so backwards in
+   time: the later edge in buffer order is the earlier one in time and
+   the new level of an edge at p is the one of samples[p - 1]. Reference
+   edges are kept until the next edge of the other channel shows up, then
+   paired with the nearest of it and the previous one. */
+void SkewMeter::measure(const uint8_t *samples, uint32_t count)
+{
+    int32_t pending[SKEW_PENDING];
+    uint32_t waiting = 0;
+    int32_t lastOther = NO_EDGE;
+
+    pairs = 0;
+    minSkew = maxSkew = 0;
+    sum = 0;
+
+    for(uint32_t from = 1; from < count; ) {
+        from = index->build(samples, count, from);
+
+        for(uint32_t i = 0; i < index->size(); i++) {
+            uint8_t changed = index->mask(i);
+            int32_t p = index->position(i);
+            uint8_t v = samples[p - 1];
+
+            if((changed >> other) & 1) {
+                uint8_t kind = (v >> other) & 1 ? SKEW_RISING : SKEW_FALLING;
+
+                if(kind & edges) {
+                    for(uint32_t w = 0; w < waiting; w++)
+                        pair(pending[w], lastOther, p);
+                    waiting = 0;
+                    lastOther = p;
+                }
+            }
+
+            if((changed >> reference) & 1) {
+                uint8_t kind = (v >> reference) & 1 ? SKEW_RISING : SKEW_FALLING;
+
+                if(kind & edges) {
+                    //Too many in a row: the oldest one only gets the previous edge
+                    if(waiting == SKEW_PENDING) {
+                        pair(pending[0], lastOther, NO_EDGE);
+                        memmove(pending, pending + 1, sizeof(pending) - sizeof(pending[0]));
+                        waiting--;
+                    }
+                    pending[waiting++] = p;
+                }
+            }
+        }
+    }
+
+    for(uint32_t w = 0; w < waiting; w++)
+        pair(pending[w], lastOther, NO_EDGE);
+}
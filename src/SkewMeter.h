@@ -0,0 +1,48 @@
+#ifndef SKEWMETER_H
+#define SKEWMETER_H
+#include "mbed.h"
+#include "TransitionIndex.h"
+
+#define SKEW_RISING  0x01
+#define SKEW_FALLING 0x02
+
+//Reference edges waiting for the next edge of the other channel
+#define SKEW_PENDING 64
+
+/* Edge to edge skew between two channels of a capture.
+
+   Every selected edge of the reference channel is paired with the
+   nearest selected edge of the other channel, before or after it, and
+   the skew is the time from the reference edge to that edge, in samples
+   (positive when the other channel is late). Pairs further apart than
+   the window are ignored. */
+class SkewMeter{
+
+public:
+
+    SkewMeter(TransitionIndex*);
+
+    void configure(uint8_t reference, uint8_t other, uint8_t edges, uint8_t window);
+    void measure(const uint8_t *samples, uint32_t count);
+
+    //Getters and Setters
+    uint32_t getPairs();
+    int32_t getMin();
+    int32_t getMax();
+    int32_t getMeanMilli();    // Mean skew, in thousandths of a sample
+
+private:
+    void pair(int32_t edge, int32_t before, int32_t after);
+
+    TransitionIndex *index;
+    uint8_t reference;
+    uint8_t other;
+    uint8_t edges;
+    uint32_t window;
+
+    uint32_t pairs;
+    int32_t minSkew;
+    int32_t maxSkew;
+    int64_t sum;
+};
+#endif
@@ -0,0 +1,77 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+#include "TransitionIndex.h"
+
+TransitionIndex::TransitionIndex()
+{
+    entries = 0;
+}
+
+/* Four samples at a time: the word is XORed with itself shifted by one
+   sample, with the sample before the word shifted in, which leaves the
+   changed bits of every sample in its byte lane. Words without changes,
+   the common case, cost a load, a shift and an XOR. */
+uint32_t TransitionIndex::build(const uint8_t *samples, uint32_t count, uint32_t from)
+{
+    uint32_t p = from < 1 ? 1 : from;
+    entries = 0;
+
+    //Up to a word boundary
+    for(; p < count && (p & 3); p++) {
+        uint8_t t = samples[p] ^ samples[p - 1];
+        if(t == 0)
+            continue;
+        if(entries == TRANSITION_INDEX_CAPACITY)
+            return p;
+
+        positions[entries] = p;
+        masks[entries++] = t;
+    }
+
+    const uint32_t *words = (const uint32_t *) samples;
+
+    //A word adds at most 4 entries
+    for(; p + 4 <= count && entries + 4 <= TRANSITION_INDEX_CAPACITY; p += 4) {
+        uint32_t w = words[p / 4];
+        uint32_t t = w ^ ((w << 8) | samples[p - 1]);
+
+        if(t == 0)
+            continue;
+
+        for(uint8_t b = 0; b < 4; b++, t >>= 8) {
+            if(t & 0xFF) {
+                positions[entries] = p + b;
+                masks[entries++] = t;
+            }
+        }
+    }
+
+    //Full, the next chunk goes on from here
+    if(p + 4 <= count)
+        return p;
+
+    for(; p < count; p++) {
+        uint8_t t = samples[p] ^ samples[p - 1];
+        if(t == 0)
+            continue;
+        if(entries == TRANSITION_INDEX_CAPACITY)
+            return p;
+
+        positions[entries] = p;
+        masks[entries++] = t;
+    }
+
+    return p;
+}
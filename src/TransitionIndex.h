@@ -0,0 +1,38 @@
+#ifndef TRANSITIONINDEX_H
+#define TRANSITIONINDEX_H
+#include <stdint.h>
+
+//Entries per chunk, positions fit the 32K capture buffer
+#define TRANSITION_INDEX_CAPACITY 1024
+
+/* List of the positions where a byte stream changes, with the bits that
+   changed, built in chunks of up to TRANSITION_INDEX_CAPACITY entries:
+
+     for(uint32_t from = 1; from < count; ) {
+         from = index.build(samples, count, from);
+         for(uint32_t i = 0; i < index.size(); i++)
+             ... index.position(i), index.mask(i) ...
+     }
+
+   Position p means samples[p] != samples[p - 1], in buffer order (the
+   capture buffer is newest first, so that is backwards in time).
+   Plain C++ without mbed, so that the host tools can build it too. */
+class TransitionIndex{
+
+public:
+
+    TransitionIndex();
+
+    //Indexes samples [from, count) and returns where it stopped, count when done
+    uint32_t build(const uint8_t *samples, uint32_t count, uint32_t from);
+
+    uint32_t size() const { return entries; }
+    uint16_t position(uint32_t i) const { return positions[i]; }
+    uint8_t mask(uint32_t i) const { return masks[i]; }
+
+private:
+    uint32_t entries;
+    uint16_t positions[TRANSITION_INDEX_CAPACITY];
+    uint8_t masks[TRANSITION_INDEX_CAPACITY];
+};
+#endif
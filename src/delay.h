@@ -1,9 +1,17 @@
 
+#ifdef TARGET_HOST
+//Simulated cycle counter (host/HostTarget.cpp), the enables do nothing
+volatile HostCycleCounter *DWT_CYCCNT = &DWT->CYCCNT;
+volatile unsigned int *DWT_CONTROL  = (volatile unsigned int *) &DWT->CTRL;
+static volatile unsigned int hostDEMCR;
+volatile unsigned int *SCB_DEMCR        = &hostDEMCR;
+#else
 volatile unsigned int *DWT_CYCCNT   = (volatile unsigned int *)0xE0001004; //address of the register
 volatile unsigned int *DWT_CONTROL  = (volatile unsigned int *)0xE0001000; //address of the register
 volatile unsigned int *SCB_DEMCR        = (volatile unsigned int *)0xE000EDFC; //address of the register
+#endif
 
-static uint32_t __PrecisionTimingTarget = 0;
+static uint32_t __PrecisionTimingTarget __attribute__((unused)) = 0;
 
 //Not perfect but better than wait_us at 1us scale
 #define wait_ns(ns)   *DWT_CYCCNT = 0; \
@@ -1,218 +1,990 @@
-/*
- This program is free software: you can redistribute it and/or modify
- it under the terms of the GNU General Public License as published by
- the Free Software Foundation, either version 3 of the License, or
- (at your option) any later version.
-
- This program is distributed in the hope that it will be useful,
- but WITHOUT ANY WARRANTY; without even the implied warranty of
- MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- GNU General Public License for more details.
-
- Author: Joao Paulo Barraca <jpbarraca@gmail.com>
-*/
-
-#include "mbed.h"
-#include "Sampler.h"
-
-#define SUMP_RESET 0x00
-#define SUMP_ARM   0x01
-#define SUMP_QUERY 0x02
-#define SUMP_TEST   0x03
-#define SUMP_GET_METADATA 0x04
-#define SUMP_RLE_FINISH 0x05
-#define SUMP_XON 0x11
-#define SUMP_XOFF 0x13
-#define SUMP_SET_TRIGGER_MASK 0xC0
-#define SUMP_SET_TRIGGER_VALUES 0xC1
-#define SUMP_SET_TRIGGER_CONF 0xC2
-#define SUMP_SET_DIVIDER 0x80
-#define SUMP_SET_READ_DELAY_COUNT 0x81
-#define SUMP_SET_FLAGS 0x82
-
-
-#define BYTE1(v) ((uint8_t)v & 0xff)         //LSB
-#define BYTE2(v) ((uint8_t)(v >> 8) & 0xff)  //
-#define BYTE3(v) ((uint8_t)(v >> 16) & 0xff) //
-#define BYTE4(v) ((uint8_t)(v >> 24) & 0xff) //MSB
-
-#define printChar(v) pc.putc(v); while(!pc.writeable());
-
-#define printUInt(v)\
-    printChar(BYTE4(v));\
-    printChar(BYTE3(v));\
-    printChar(BYTE2(v));\
-    printChar(BYTE1(v));
-
-
-#define printString(v)\
-    for(unsigned int i =0;i<strlen(v);i++) printChar(v[i]);
-
-Serial pc(USBTX, USBRX);
-DigitalOut led(LED2);
-Sampler sampler(&pc);
-
-inline void blink(unsigned int onTime,unsigned int offTime, unsigned int num){
-    for(unsigned int i=0;i<num;i++){
-        led = 1;
-        wait_ms(onTime);
-        led = 0;
-        wait_ms(offTime);
-    }
-}
-
-void handleSerial()
-{
-    uint8_t cmd_buffer[5];
-    uint8_t cmd_index = 0;
-    memset(cmd_buffer, 0, sizeof(cmd_buffer));
-    
-    led = 0;
-
-    //Looping through the serial.   
-    while (1) {
-        led = 0;
-
-        while(!pc.readable());
-        
-        led = 1;        
-        cmd_buffer[cmd_index] = pc.getc();
-        switch(cmd_buffer[0]) {
-            case SUMP_RESET : {
-                break;
-            }
-            case SUMP_QUERY:  {
-                printString("1ALS");
-                break;
-            }
-            case SUMP_GET_METADATA: {
-                uint32_t bufferSize = sampler.getBufferSize();
-                uint32_t maxFrequency = sampler.getMaxFrequency();
-
-                while(!pc.writeable());
-                //NAME
-                printChar(0x01);
-                printString("LogicalNucleo");
-                printChar(0x00);
-
-                //SAMPLE MEM
-                printChar(0x21);
-                printUInt(bufferSize);
-
-                //DYNAMIC MEM
-                printChar(0x22);
-                printUInt(0);
-
-                //SAMPLE RATE
-                printChar(0x23);
-                printUInt(maxFrequency);
-
-                //Number of Probes
-                printChar(0x40);
-                printChar(0x08);
-
-                //Protocol Version
-                printChar(0x41);
-                printChar(0x02);
-            
-                //END
-                printChar(0x00);
-                break;
-            }
-            case SUMP_TEST:{
-                sampler.runTest();
-                break;    
-            }
-            case SUMP_ARM: {
-                sampler.arm();
-                break;
-            }
-            case SUMP_XON: {
-                sampler.start();
-                break;
-            }
-            case SUMP_XOFF: {
-                sampler.stop();
-                break;
-            }
-            case SUMP_SET_READ_DELAY_COUNT: {
-                cmd_index ++;
-                if(cmd_index < 5)
-                    continue;
-
-                uint16_t readCount  = 1 + *((uint16_t*)(cmd_buffer + 1));
-                uint16_t delayCount = * ((uint16_t*)(cmd_buffer + 3));
-                sampler.setSampleNumber(4 * readCount);
-                sampler.setSamplingDelay(4 * delayCount);
-                break;
-            }
-            case SUMP_SET_DIVIDER: {
-                cmd_index ++;
-                if(cmd_index < 5)
-                    continue;
-                
-                uint32_t divider = *((uint32_t *)(cmd_buffer + 1));
-                sampler.setSamplingDivider(divider);
-                break;
-            }
-            case SUMP_SET_TRIGGER_MASK:{
-                cmd_index ++;
-                if(cmd_index < 5)
-                    continue;
-                sampler.setTriggerMask(*(uint32_t *)(cmd_buffer + 1));
-                break;
-            }
-            case SUMP_SET_TRIGGER_VALUES:{
-                cmd_index ++;
-                if(cmd_index < 5)
-                    continue;
-                
-                sampler.setTriggerValue(*(uint32_t *)(cmd_buffer + 1));
-                break;
-            }
-            case SUMP_SET_TRIGGER_CONF:{
-                cmd_index ++;
-                if(cmd_index < 5)
-                    continue;
-
-                uint8_t serial = (*((uint8_t*)(cmd_buffer + 4)) & 0x04) > 0 ? 1 : 0;
-                uint8_t state = (*((uint8_t*)(cmd_buffer + 4)) & 0x08) > 0 ? 1 : 0;
-
-                if(serial == 1)
-                    sampler.setTriggerState(0);//Not supported
-                else
-                    sampler.setTriggerState(state); 
-
-                break;
-            }
-            case SUMP_SET_FLAGS:{
-                cmd_index ++;
-                if(cmd_index < 5)
-                    continue;
-                
-                sampler.setFlags(*(uint32_t *)(cmd_buffer + 1));
-                break;
-            }
-            default: {
-            }
-        }
-
-        cmd_index = 0;
-        memset(cmd_buffer, 0, sizeof(cmd_buffer));
-    }
-}
-
-
-
-int main()
-{
-    pc.baud(115200);
-
-    //Flush it
-    while(pc.readable() == 1)
-        pc.getc();
-
-    blink(50,100,5);
-
-    handleSerial();
-}
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+#include "mbed.h"
+#include "Sampler.h"
+#include "PatternGenerator.h"
+#include "FrequencyCounter.h"
+#include "ActivityMonitor.h"
+#include "PulseHistogram.h"
+#include "SkewMeter.h"
+#include "CommandReader.h"
+#include "CommandDecoder.h"
+#include "FrameCodec.h"
+#include <algorithm>
+#include <unistd.h>
+
+#define SUMP_RESET 0x00
+#define SUMP_ARM   0x01
+#define SUMP_QUERY 0x02
+#define SUMP_TEST   0x03
+#define SUMP_GET_METADATA 0x04
+#define SUMP_RLE_FINISH 0x05
+#define SUMP_XON 0x11
+#define SUMP_XOFF 0x13
+#define SUMP_SET_TRIGGER_MASK 0xC0
+#define SUMP_SET_TRIGGER_VALUES 0xC1
+#define SUMP_SET_TRIGGER_CONF 0xC2
+#define SUMP_SET_DIVIDER 0x80
+#define SUMP_SET_READ_DELAY_COUNT 0x81
+#define SUMP_SET_FLAGS 0x82
+
+//Vendor extensions
+#define SUMP_PATTERN_START 0x06
+#define SUMP_PATTERN_STOP 0x07
+#define SUMP_SELF_TEST 0x08
+#define SUMP_GET_DIAGNOSTICS 0x09
+#define SUMP_KERNEL_BENCHMARK 0x0A
+#define SUMP_COUNT_FREQUENCY 0x0B
+#define SUMP_MONITOR_STOP 0x0C
+#define SUMP_MONITOR_QUERY 0x0D
+#define SUMP_GET_HISTOGRAM 0x0E
+#define SUMP_GET_SKEW 0x0F
+#define SUMP_ARM_PROGRESSIVE 0x10
+#define SUMP_ARM_STREAMING 0x12
+#define SUMP_RUN_BENCHMARK 0x14
+#define SUMP_SET_PROTOCOL_TRIGGER 0xA0
+#define SUMP_SET_PATTERN 0xA1
+#define SUMP_SET_PATTERN_DIVIDER 0xA2
+#define SUMP_SET_COUNTER_GATE 0xA3
+#define SUMP_MONITOR_START 0xA4
+#define SUMP_SET_HISTOGRAM 0xA5
+#define SUMP_SET_SKEW 0xA6
+#define SUMP_GET_OVERVIEW 0xA7
+#define SUMP_SET_READ_WINDOW 0xA8
+#define SUMP_READ_WINDOW 0xA9
+#define SUMP_ENTER_FRAMED 0xAA
+#define SUMP_SET_UPLOAD_CHUNK 0xAB
+#define SUMP_RESEND_CHUNK 0xAC
+
+//Vendor metadata keys
+#define META_PROTOCOL_TRIGGER_RATE 0x30
+#define META_ACHIEVED_RATE 0x31
+#define META_PERIOD_DEVIATION 0x32
+
+//Diagnostics keys, one group per sampling kernel
+#define DIAG_KERNEL 0x40
+#define DIAG_KERNEL_RATE 0x20
+#define DIAG_KERNEL_ACHIEVED_RATE 0x21
+#define DIAG_KERNEL_DEVIATION 0x22
+#define DIAG_KERNEL_CAPTURES 0x23
+#define DIAG_CODEC_SAMPLES 0x24
+#define DIAG_CODEC_BYTES 0x25
+#define DIAG_CODEC_CYCLES 0x26
+#define DIAG_CAPTURES 0x27
+#define DIAG_TRIGGERS 0x28
+#define DIAG_TRIGGER_WAIT 0x29
+#define DIAG_SAMPLE_PERIOD 0x2A
+#define DIAG_UPLOADS 0x2B
+#define DIAG_UPLOAD_BYTES 0x2C
+#define DIAG_UPLOAD_CYCLES 0x2D
+#define DIAG_RX_OVERRUNS 0x2E
+#define DIAG_UNKNOWN_COMMANDS 0x2F
+#define DIAG_STACK_SIZE 0x30
+#define DIAG_STACK_USED 0x31
+#define DIAG_CORE_CLOCK 0x32
+//One group per opcode received
+#define DIAG_OPCODE 0x41
+#define DIAG_OPCODE_COUNT 0x20
+
+#define STACK_PAINT 0xA5C35A3C
+
+//Benchmark keys, global then one group per sampling kernel, cycles in 1/1000
+#define BENCH_KERNEL 0x40
+#define BENCH_KERNEL_CYCLES 0x20
+#define BENCH_KERNEL_FLASH 0x21
+#define BENCH_KERNEL_FLASH_SPREAD 0x22
+#define BENCH_KERNEL_RAM 0x23
+#define BENCH_KERNEL_RAM_SPREAD 0x24
+#define BENCH_CORE_CLOCK 0x28
+#define BENCH_TRIGGER_LATENCY 0x29
+#define BENCH_TRIGGER_MAX 0x2A
+#define BENCH_TRIGGER_RESOLUTION 0x2B
+#define BENCH_ENCODE_SAMPLES 0x2C
+#define BENCH_RLE_BYTES 0x2D
+#define BENCH_RLE_CYCLES 0x2E
+#define BENCH_LZ_BYTES 0x2F
+#define BENCH_LZ_CYCLES 0x30
+#define BENCH_UPLOAD_BYTES 0x31
+#define BENCH_UPLOAD_CYCLES 0x32
+
+//Activity monitor keys, global then one group per channel
+#define MONITOR_RATE 0x20
+#define MONITOR_SECONDS 0x21
+#define MONITOR_OVERRUNS 0x22
+#define MONITOR_CHANNEL 0x40
+#define MONITOR_EDGES 0x23
+#define MONITOR_HIGH_RATIO 0x24
+#define MONITOR_MIN_HIGH 0x25
+#define MONITOR_MAX_HIGH 0x26
+#define MONITOR_MIN_LOW 0x27
+#define MONITOR_MAX_LOW 0x28
+#define MONITOR_IDLE 0x29
+
+//Skew keys
+#define SKEW_PAIRS 0x20
+#define SKEW_MIN 0x21
+#define SKEW_MAX 0x22
+#define SKEW_MEAN 0x23
+#define SKEW_SAMPLE_CYCLES 0x24
+
+
+#define BYTE1(v) ((uint8_t)v & 0xff)         //LSB
+#define BYTE2(v) ((uint8_t)(v >> 8) & 0xff)  //
+#define BYTE3(v) ((uint8_t)(v >> 16) & 0xff) //
+#define BYTE4(v) ((uint8_t)(v >> 24) & 0xff) //MSB
+
+#define printChar(v) do { pc.putc(v); while(!pc.writeable()); } while(0)
+
+#define printUInt(v) do {\
+    printChar(BYTE4(v));\
+    printChar(BYTE3(v));\
+    printChar(BYTE2(v));\
+    printChar(BYTE1(v));\
+    } while(0)
+
+
+#define printString(v)\
+    for(unsigned int i =0;i<strlen(v);i++) printChar(v[i]);
+
+Serial pc(USBTX, USBRX);
+DigitalOut led(LED2);
+CommandReader commands;
+PatternGenerator generator(&commands);
+Sampler sampler(&pc, &generator);
+FrequencyCounter counter(&GPIOB->IDR);
+ActivityMonitor monitor(&GPIOB->IDR);
+TransitionIndex transitions;
+PulseHistogram histogram(&transitions);
+SkewMeter skew(&transitions);
+FrameParser frames;
+bool framed = false;
+
+//Defined after the command table
+extern CommandDecoder decoder;
+
+#ifdef TARGET_HOST
+//The host build runs on a thread stack of its own
+void paintStack() {}
+uint32_t getStackSize() { return 0; }
+uint32_t getStackUsed() { return 0; }
+#else
+extern "C" uint32_t __StackTop[];
+
+/* The heap grows up from the end of .bss with sbrk and the stack grows
+   down from the top of the RAM, the free RAM between them is shared. */
+inline uint32_t *heapEnd()
+{
+    return (uint32_t *) (((uintptr_t) sbrk(0) + 3) & ~3);
+}
+
+//Fills the free RAM below the current frame, before anything else uses it
+void paintStack()
+{
+    __disable_irq();
+    uint32_t *sp = (uint32_t *) (uintptr_t) __get_MSP();
+    for(uint32_t *p = heapEnd(); p < sp - 8; p++)
+        *p = STACK_PAINT;
+    __enable_irq();
+}
+
+//RAM the stack can grow into, up to the heap
+uint32_t getStackSize()
+{
+    return (__StackTop - heapEnd()) * 4;
+}
+
+//Deepest use since power up, as the first word above the heap that lost the paint
+uint32_t getStackUsed()
+{
+    uint32_t *p = heapEnd();
+    while(p < __StackTop && *p == STACK_PAINT)
+        p++;
+    return (__StackTop - p) * 4;
+}
+#endif
+
+inline void blink(unsigned int onTime,unsigned int offTime, unsigned int num){
+    for(unsigned int i=0;i<num;i++){
+        led = 1;
+        wait_ms(onTime);
+        led = 0;
+        wait_ms(offTime);
+    }
+}
+
+//Plain SUMP clients start with a reset, they get the plain upload
+void handleReset(const uint8_t *)
+{
+    sampler.setUploadChunk(0);
+}
+
+void handleQuery(const uint8_t *)
+{
+    printString("1ALS");
+}
+
+void handleGetMetadata(const uint8_t *)
+{
+    uint32_t bufferSize = sampler.getBufferSize();
+    uint32_t maxFrequency = sampler.getMaxFrequency();
+
+    while(!pc.writeable());
+    //NAME
+    printChar(0x01);
+    printString("LogicalNucleo");
+    printChar(0x00);
+
+    //SAMPLE MEM
+    printChar(0x21);
+    printUInt(bufferSize);
+
+    //DYNAMIC MEM
+    printChar(0x22);
+    printUInt(0);
+
+    //SAMPLE RATE
+    printChar(0x23);
+    printUInt(maxFrequency);
+
+    //Max sample rate with a protocol trigger
+    printChar(META_PROTOCOL_TRIGGER_RATE);
+    printUInt(sampler.getProtocolTriggerMaxFrequency());
+
+    //Measured timing of the last capture
+    printChar(META_ACHIEVED_RATE);
+    printUInt(sampler.getAchievedFrequency());
+    printChar(META_PERIOD_DEVIATION);
+    printUInt(sampler.getPeriodDeviation());
+
+    //Number of Probes
+    printChar(0x40);
+    printChar(0x08);
+
+    //Protocol Version
+    printChar(0x41);
+    printChar(0x02);
+
+    //END
+    printChar(0x00);
+}
+
+void handleTest(const uint8_t *)
+{
+    monitor.stop();
+    sampler.runTest();
+}
+
+/* Global keys, then the groups of every kernel used and of every opcode
+   received. The counters run since power up, SUMP resets keep them. */
+void handleGetDiagnostics(const uint8_t *)
+{
+    const CodecTiming &c = sampler.getCodecTiming();
+    if(c.samples) {
+        printChar(DIAG_CODEC_SAMPLES);
+        printUInt(c.samples);
+        printChar(DIAG_CODEC_BYTES);
+        printUInt(c.bytes);
+        printChar(DIAG_CODEC_CYCLES);
+        printUInt(c.cycles);
+    }
+
+    const SamplerCounters &n = sampler.getCounters();
+    uint32_t rate = sampler.getAchievedFrequency();
+    //Periods past 2^32 ps (rates below about 233Hz) saturate
+    uint64_t ps = rate ? 1000000000000ULL / rate : 0;
+    uint32_t period = ps > 0xFFFFFFFF ? 0xFFFFFFFF : ps;
+
+    printChar(DIAG_CORE_CLOCK);
+    printUInt(SystemCoreClock);
+    printChar(DIAG_CAPTURES);
+    printUInt(n.captures);
+    printChar(DIAG_TRIGGERS);
+    printUInt(n.triggers);
+    printChar(DIAG_TRIGGER_WAIT);
+    printUInt(n.triggerWait);
+    printChar(DIAG_SAMPLE_PERIOD);
+    printUInt(period);
+
+    const UploadTiming &u = sampler.getUploadTiming();
+    printChar(DIAG_UPLOADS);
+    printUInt(n.uploads);
+    printChar(DIAG_UPLOAD_BYTES);
+    printUInt(u.bytes);
+    printChar(DIAG_UPLOAD_CYCLES);
+    printUInt(u.cycles);
+
+    uint32_t overruns = commands.getOverruns();
+    uint32_t unknown = decoder.getUnknown();
+    uint32_t stackSize = getStackSize();
+    uint32_t stackUsed = getStackUsed();
+
+    printChar(DIAG_RX_OVERRUNS);
+    printUInt(overruns);
+    printChar(DIAG_UNKNOWN_COMMANDS);
+    printUInt(unknown);
+    printChar(DIAG_STACK_SIZE);
+    printUInt(stackSize);
+    printChar(DIAG_STACK_USED);
+    printUInt(stackUsed);
+
+    for(uint8_t k = 0; k < KERNEL_COUNT; k++) {
+        const KernelTiming &t = sampler.getKernelTiming(k);
+        if(t.captures == 0)
+            continue;
+
+        printChar(DIAG_KERNEL);
+        printChar(k);
+        printChar(DIAG_KERNEL_RATE);
+        printUInt(t.rate);
+        printChar(DIAG_KERNEL_ACHIEVED_RATE);
+        printUInt(t.achievedRate);
+        printChar(DIAG_KERNEL_DEVIATION);
+        printUInt(t.deviation);
+        printChar(DIAG_KERNEL_CAPTURES);
+        printUInt(t.captures);
+    }
+
+    for(uint32_t op = 0; op < 256; op++) {
+        uint32_t count = decoder.getCount(op);
+        if(count == 0)
+            continue;
+
+        printChar(DIAG_OPCODE);
+        printChar(op);
+        printChar(DIAG_OPCODE_COUNT);
+        printUInt(count);
+    }
+
+    printChar(0x00);
+}
+
+void handleKernelBenchmark(const uint8_t *)
+{
+    sampler.benchmarkKernels();
+}
+
+/* Global keys, then the kernel groups. Encoders on the last capture
+   first, as the kernel and trigger runs overwrite the buffer. The upload
+   is the one of the last arm, streaming arm or test command. */
+void handleRunBenchmark(const uint8_t *)
+{
+    CodecTiming rle, lz;
+    TriggerTiming trigger;
+
+    sampler.benchmarkEncoders(rle, lz);
+    sampler.benchmarkTrigger(trigger);
+
+    printChar(BENCH_CORE_CLOCK);
+    printUInt(SystemCoreClock);
+    printChar(BENCH_TRIGGER_LATENCY);
+    printUInt(trigger.mean);
+    printChar(BENCH_TRIGGER_MAX);
+    printUInt(trigger.max);
+    printChar(BENCH_TRIGGER_RESOLUTION);
+    printUInt(trigger.resolution);
+
+    printChar(BENCH_ENCODE_SAMPLES);
+    printUInt(lz.samples);
+    printChar(BENCH_RLE_BYTES);
+    printUInt(rle.bytes);
+    printChar(BENCH_RLE_CYCLES);
+    printUInt(rle.cycles);
+    printChar(BENCH_LZ_BYTES);
+    printUInt(lz.bytes);
+    printChar(BENCH_LZ_CYCLES);
+    printUInt(lz.cycles);
+
+    const UploadTiming &u = sampler.getUploadTiming();
+    if(u.bytes) {
+        printChar(BENCH_UPLOAD_BYTES);
+        printUInt(u.bytes);
+        printChar(BENCH_UPLOAD_CYCLES);
+        printUInt(u.cycles);
+    }
+
+    for(uint8_t k = 0; k < SAMPLE_KERNEL_COUNT; k++) {
+        uint32_t cycles = KERNEL_MIN_CYCLES + k * KERNEL_STEP_CYCLES;
+        uint32_t spread;
+        float mean = sampler.benchmarkKernel(k, false, spread);
+
+        printChar(BENCH_KERNEL);
+        printChar(k);
+        printChar(BENCH_KERNEL_CYCLES);
+        printUInt(cycles);
+        printChar(BENCH_KERNEL_FLASH);
+        printUInt((uint32_t) (mean * 1000 + 0.5f));
+        printChar(BENCH_KERNEL_FLASH_SPREAD);
+        printUInt(spread);
+
+        if(k < RAM_KERNEL_COUNT) {
+            mean = sampler.benchmarkKernel(k, true, spread);
+            printChar(BENCH_KERNEL_RAM);
+            printUInt((uint32_t) (mean * 1000 + 0.5f));
+            printChar(BENCH_KERNEL_RAM_SPREAD);
+            printUInt(spread);
+        }
+    }
+
+    printChar(0x00);
+}
+
+void handleCountFrequency(const uint8_t *)
+{
+    counter.measure();
+
+    //One frequency per channel (Hz), then the hardware counted channels
+    for(uint8_t c = 0; c < COUNTER_CHANNELS; c++) {
+        printUInt(counter.getFrequency(c));
+    }
+    printChar(counter.getHardwareChannels());
+}
+
+void handleMonitorStop(const uint8_t *)
+{
+    monitor.stop();
+}
+
+void handleMonitorQuery(const uint8_t *)
+{
+    ChannelActivity channels[MONITOR_CHANNELS];
+    uint64_t samples;
+    uint32_t rate = monitor.getFrequency();
+    monitor.getStatistics(channels, samples);
+
+    printChar(MONITOR_RATE);
+    printUInt(rate);
+    printChar(MONITOR_SECONDS);
+    printUInt((uint32_t) (rate ? samples / rate : 0));
+    printChar(MONITOR_OVERRUNS);
+    printUInt(monitor.getOverruns());
+
+    //Counts saturate, widths and idle time are in samples
+    for(uint8_t c = 0; c < MONITOR_CHANNELS; c++) {
+        const ChannelActivity &ch = channels[c];
+
+        printChar(MONITOR_CHANNEL);
+        printChar(c);
+        printChar(MONITOR_EDGES);
+        printUInt((uint32_t) min(ch.edges, (uint64_t) 0xFFFFFFFF));
+        printChar(MONITOR_HIGH_RATIO);
+        printUInt((uint32_t) (samples ? ch.highSamples * 1000000 / samples : 0));
+        printChar(MONITOR_MIN_HIGH);
+        printUInt(ch.minHigh);
+        printChar(MONITOR_MAX_HIGH);
+        printUInt(ch.maxHigh);
+        printChar(MONITOR_MIN_LOW);
+        printUInt(ch.minLow);
+        printChar(MONITOR_MAX_LOW);
+        printUInt(ch.maxLow);
+        printChar(MONITOR_IDLE);
+        printUInt((uint32_t) min(samples - ch.lastEdge, (uint64_t) 0xFFFFFFFF));
+    }
+
+    printChar(0x00);
+}
+
+void handleGetHistogram(const uint8_t *)
+{
+    histogram.build(sampler.getBuffer(), sampler.getSampleNumber());
+
+    //Bin count, then the high and the low run counts
+    printChar(histogram.getBins());
+    for(uint8_t b = 0; b < histogram.getBins(); b++) {
+        printUInt(histogram.getHigh(b));
+    }
+    for(uint8_t b = 0; b < histogram.getBins(); b++) {
+        printUInt(histogram.getLow(b));
+    }
+}
+
+void handleGetSkew(const uint8_t *)
+{
+    skew.measure(sampler.getBuffer(), sampler.getSampleNumber());
+
+    //Skews in samples (the mean in thousandths), one sample is SKEW_SAMPLE_CYCLES core cycles
+    printChar(SKEW_PAIRS);
+    printUInt(skew.getPairs());
+    printChar(SKEW_MIN);
+    printUInt(skew.getMin());
+    printChar(SKEW_MAX);
+    printUInt(skew.getMax());
+    printChar(SKEW_MEAN);
+    printUInt(skew.getMeanMilli());
+    printChar(SKEW_SAMPLE_CYCLES);
+    printUInt(sampler.getSamplePeriodCycles());
+    printChar(0x00);
+}
+
+void handleSelfTest(const uint8_t *)
+{
+    sampler.selfTest();
+}
+
+void handleArm(const uint8_t *)
+{
+    sampler.arm();
+}
+
+void handleArmProgressive(const uint8_t *)
+{
+    sampler.armProgressive();
+}
+
+void handleArmStreaming(const uint8_t *)
+{
+    sampler.armStreaming();
+}
+
+void handlePatternStart(const uint8_t *)
+{
+    monitor.stop();
+    generator.start();
+}
+
+void handlePatternStop(const uint8_t *)
+{
+    generator.stop();
+}
+
+void handleXon(const uint8_t *)
+{
+    sampler.start();
+}
+
+void handleXoff(const uint8_t *)
+{
+    sampler.stop();
+}
+
+void handleSetReadDelayCount(const uint8_t *parameters)
+{
+    uint16_t readCount  = 1 + loadUInt16(parameters);
+    uint16_t delayCount = loadUInt16(parameters + 2);
+    sampler.setSampleNumber(4 * readCount);
+    sampler.setSamplingDelay(4 * delayCount);
+}
+
+void handleSetDivider(const uint8_t *parameters)
+{
+    uint32_t divider = loadUInt32(parameters);
+    sampler.setSamplingDivider(divider);
+}
+
+void handleSetTriggerMask(const uint8_t *parameters)
+{
+    sampler.setTriggerMask(loadUInt32(parameters));
+}
+
+void handleSetTriggerValues(const uint8_t *parameters)
+{
+    sampler.setTriggerValue(loadUInt32(parameters));
+}
+
+void handleSetTriggerConf(const uint8_t *parameters)
+{
+    uint8_t serial = (parameters[3] & 0x04) > 0 ? 1 : 0;
+    uint8_t state = (parameters[3] & 0x08) > 0 ? 1 : 0;
+
+    if(serial == 1)
+        sampler.setTriggerState(0);//Not supported
+    else
+        sampler.setTriggerState(state); 
+}
+
+void handleSetFlags(const uint8_t *parameters)
+{
+    sampler.setFlags(loadUInt32(parameters));
+}
+
+void handleSetProtocolTrigger(const uint8_t *parameters)
+{
+    sampler.setProtocolTrigger(parameters[0], parameters[1], parameters[2], parameters[3]);
+}
+
+void handleSetPattern(const uint8_t *parameters)
+{
+    //Pattern bytes follow the command
+    generator.upload(loadUInt16(parameters), parameters[2]);
+}
+
+void handleSetPatternDivider(const uint8_t *parameters)
+{
+    generator.setDivider(loadUInt32(parameters));
+}
+
+void handleSetCounterGate(const uint8_t *parameters)
+{
+    counter.setGate(loadUInt32(parameters));
+}
+
+void handleSetHistogram(const uint8_t *parameters)
+{
+    histogram.configure(parameters[0], parameters[1], parameters[2]);
+}
+
+void handleSetSkew(const uint8_t *parameters)
+{
+    skew.configure(parameters[0], parameters[1], parameters[2], parameters[3]);
+}
+
+void handleGetOverview(const uint8_t *parameters)
+{
+    sampler.uploadOverview(loadUInt32(parameters));
+}
+
+void handleSetReadWindow(const uint8_t *parameters)
+{
+    sampler.setReadWindow(loadUInt16(parameters), loadUInt16(parameters + 2));
+}
+
+void handleReadWindow(const uint8_t *parameters)
+{
+    sampler.uploadWindow(loadUInt16(parameters), parameters[2]);
+}
+
+void handleSetUploadChunk(const uint8_t *parameters)
+{
+    sampler.setUploadChunk(loadUInt16(parameters));
+}
+
+//The host asks again for chunks with a bad CRC
+void handleResendChunk(const uint8_t *parameters)
+{
+    sampler.uploadChunk(loadUInt16(parameters));
+}
+
+void handleMonitorStart(const uint8_t *parameters)
+{
+    //Takes TIM1 from the pattern generator
+    generator.stop();
+    monitor.start(loadUInt32(parameters));
+}
+
+void handleFramePing(uint8_t sequence, const uint8_t *, uint16_t);
+
+//Answers with a ping reply, the magic keeps stray bytes from entering
+void handleEnterFramed(const uint8_t *parameters)
+{
+    if(loadUInt32(parameters) != FRAME_MAGIC)
+        return;
+
+    frames.reset();
+    framed = true;
+    handleFramePing(0, 0, 0);
+}
+
+//Opcode, length and handler of every command, kept in flash
+static const CommandEntry commandTable[] = {
+    {SUMP_RESET, 1, handleReset, COMMAND_CONFIGURATION},
+    {SUMP_QUERY, 1, handleQuery, 0},
+    {SUMP_GET_METADATA, 1, handleGetMetadata, 0},
+    {SUMP_TEST, 1, handleTest, 0},
+    {SUMP_GET_DIAGNOSTICS, 1, handleGetDiagnostics, 0},
+    {SUMP_KERNEL_BENCHMARK, 1, handleKernelBenchmark, 0},
+    {SUMP_RUN_BENCHMARK, 1, handleRunBenchmark, 0},
+    {SUMP_COUNT_FREQUENCY, 1, handleCountFrequency, 0},
+    {SUMP_MONITOR_STOP, 1, handleMonitorStop, 0},
+    {SUMP_MONITOR_QUERY, 1, handleMonitorQuery, 0},
+    {SUMP_GET_HISTOGRAM, 1, handleGetHistogram, 0},
+    {SUMP_GET_SKEW, 1, handleGetSkew, 0},
+    {SUMP_SELF_TEST, 1, handleSelfTest, 0},
+    {SUMP_ARM, 1, handleArm, 0},
+    {SUMP_ARM_PROGRESSIVE, 1, handleArmProgressive, 0},
+    {SUMP_ARM_STREAMING, 1, handleArmStreaming, 0},
+    {SUMP_PATTERN_START, 1, handlePatternStart, 0},
+    {SUMP_PATTERN_STOP, 1, handlePatternStop, 0},
+    {SUMP_XON, 1, handleXon, 0},
+    {SUMP_XOFF, 1, handleXoff, 0},
+    {SUMP_SET_READ_DELAY_COUNT, COMMAND_LONG_LENGTH, handleSetReadDelayCount, COMMAND_CONFIGURATION},
+    {SUMP_SET_DIVIDER, COMMAND_LONG_LENGTH, handleSetDivider, COMMAND_CONFIGURATION},
+    {SUMP_SET_TRIGGER_MASK, COMMAND_LONG_LENGTH, handleSetTriggerMask, COMMAND_CONFIGURATION},
+    {SUMP_SET_TRIGGER_VALUES, COMMAND_LONG_LENGTH, handleSetTriggerValues, COMMAND_CONFIGURATION},
+    {SUMP_SET_TRIGGER_CONF, COMMAND_LONG_LENGTH, handleSetTriggerConf, COMMAND_CONFIGURATION},
+    {SUMP_SET_FLAGS, COMMAND_LONG_LENGTH, handleSetFlags, COMMAND_CONFIGURATION},
+    {SUMP_SET_PROTOCOL_TRIGGER, COMMAND_LONG_LENGTH, handleSetProtocolTrigger, COMMAND_CONFIGURATION},
+    {SUMP_SET_PATTERN, COMMAND_LONG_LENGTH, handleSetPattern, 0},
+    {SUMP_SET_PATTERN_DIVIDER, COMMAND_LONG_LENGTH, handleSetPatternDivider, COMMAND_CONFIGURATION},
+    {SUMP_SET_COUNTER_GATE, COMMAND_LONG_LENGTH, handleSetCounterGate, COMMAND_CONFIGURATION},
+    {SUMP_SET_HISTOGRAM, COMMAND_LONG_LENGTH, handleSetHistogram, COMMAND_CONFIGURATION},
+    {SUMP_SET_SKEW, COMMAND_LONG_LENGTH, handleSetSkew, COMMAND_CONFIGURATION},
+    {SUMP_GET_OVERVIEW, COMMAND_LONG_LENGTH, handleGetOverview, 0},
+    {SUMP_SET_READ_WINDOW, COMMAND_LONG_LENGTH, handleSetReadWindow, COMMAND_CONFIGURATION},
+    {SUMP_READ_WINDOW, COMMAND_LONG_LENGTH, handleReadWindow, 0},
+    {SUMP_MONITOR_START, COMMAND_LONG_LENGTH, handleMonitorStart, 0},
+    {SUMP_ENTER_FRAMED, COMMAND_LONG_LENGTH, handleEnterFramed, 0},
+    {SUMP_SET_UPLOAD_CHUNK, COMMAND_LONG_LENGTH, handleSetUploadChunk, COMMAND_CONFIGURATION},
+    {SUMP_RESEND_CHUNK, COMMAND_LONG_LENGTH, handleResendChunk, 0},
+};
+
+#define COMMAND_TABLE_SIZE (sizeof(commandTable) / sizeof(commandTable[0]))
+
+//Entries past COMMAND_MAX_ENTRIES would not be decoded, refuse to build
+typedef char CommandTableCheck[COMMAND_TABLE_SIZE <= COMMAND_MAX_ENTRIES ? 1 : -1];
+
+CommandDecoder decoder(commandTable, COMMAND_TABLE_SIZE);
+
+//Reply payload: status, then prefix and data
+void writeFrame(uint8_t opcode, uint8_t sequence, uint8_t status, const uint8_t *prefix, uint16_t prefixLength,
+                const uint8_t *data, uint16_t length)
+{
+    uint8_t header[FRAME_HEADER];
+    FrameParser::header(header, opcode, sequence, 1 + prefixLength + length);
+
+    uint16_t crc = FrameParser::crc(0xFFFF, header + 1, FRAME_HEADER - 1);
+    crc = FrameParser::crc(crc, status);
+    crc = FrameParser::crc(crc, prefix, prefixLength);
+    crc = FrameParser::crc(crc, data, length);
+
+    for(uint8_t i = 0; i < FRAME_HEADER; i++) {
+        printChar(header[i]);
+    }
+    printChar(status);
+    for(uint16_t i = 0; i < prefixLength; i++) {
+        printChar(prefix[i]);
+    }
+    for(uint16_t i = 0; i < length; i++) {
+        printChar(data[i]);
+    }
+    printChar(crc & 0xFF);
+    printChar(crc >> 8);
+}
+
+//Offsets count in the upload order, newest sample first
+void writeSamples(uint8_t opcode, uint8_t sequence, uint32_t offset, uint16_t length)
+{
+    uint32_t samples = sampler.getSampleNumber();
+    uint8_t prefix[4];
+
+    offset = min(offset, samples);
+    length = min((uint32_t) min(length, (uint16_t) FRAME_MAX_SAMPLES), samples - offset);
+    storeUInt32(prefix, offset);
+
+    writeFrame(opcode, sequence, FRAME_STATUS_OK, prefix, sizeof(prefix), sampler.getBuffer() + offset, length);
+}
+
+void handleFramePing(uint8_t sequence, const uint8_t *, uint16_t)
+{
+    uint8_t reply[7] = {'L', 'N', 'F', 'P', FRAME_VERSION, 0, 0};
+    storeUInt16(reply + 5, FRAME_MAX_PAYLOAD);
+    writeFrame(FRAME_PING, sequence, FRAME_STATUS_OK, reply, sizeof(reply), 0, 0);
+}
+
+//A batch of SUMP configuration commands, anything else stops it
+void handleFrameConfigure(uint8_t sequence, const uint8_t *payload, uint16_t length)
+{
+    uint8_t reply[2];
+    uint32_t used = decoder.decode(payload, length, COMMAND_CONFIGURATION);
+
+    storeUInt16(reply, used);
+    writeFrame(FRAME_CONFIGURE, sequence, used == length ? FRAME_STATUS_OK : FRAME_STATUS_REJECTED,
+               reply, sizeof(reply), 0, 0);
+}
+
+void handleFrameCapture(uint8_t sequence, const uint8_t *, uint16_t)
+{
+    uint8_t reply[4];
+
+    sampler.capture();
+    storeUInt32(reply, sampler.getSampleNumber());
+    writeFrame(FRAME_CAPTURE, sequence, FRAME_STATUS_OK, reply, sizeof(reply), 0, 0);
+}
+
+void handleFrameRead(uint8_t sequence, const uint8_t *payload, uint16_t length)
+{
+    if(length < 6) {
+        writeFrame(FRAME_READ, sequence, FRAME_STATUS_BAD_LENGTH, 0, 0, 0, 0);
+        return;
+    }
+    writeSamples(FRAME_READ, sequence, loadUInt32(payload), loadUInt16(payload + 4));
+}
+
+//Chunks are sent without waiting for the host, which reads the broken ones again
+void handleFrameStream(uint8_t sequence, const uint8_t *payload, uint16_t length)
+{
+    uint16_t chunk = length >= 2 ? loadUInt16(payload) : FRAME_MAX_SAMPLES;
+    chunk = max((uint16_t) 1, min(chunk, (uint16_t) FRAME_MAX_SAMPLES));
+
+    sampler.capture();
+
+    uint32_t samples = sampler.getSampleNumber();
+    for(uint32_t offset = 0; offset < samples; offset += chunk)
+        writeSamples(FRAME_STREAM, sequence++, offset, chunk);
+
+    uint8_t end[4];
+    storeUInt32(end, samples);
+    writeFrame(FRAME_STREAM, sequence, FRAME_STATUS_END, end, sizeof(end), 0, 0);
+}
+
+void handleFrameExit(uint8_t sequence, const uint8_t *, uint16_t)
+{
+    writeFrame(FRAME_EXIT, sequence, FRAME_STATUS_OK, 0, 0, 0, 0);
+    framed = false;
+}
+
+static const FrameEntry frameTable[] = {
+    {FRAME_PING, handleFramePing},
+    {FRAME_CONFIGURE, handleFrameConfigure},
+    {FRAME_CAPTURE, handleFrameCapture},
+    {FRAME_READ, handleFrameRead},
+    {FRAME_STREAM, handleFrameStream},
+    {FRAME_EXIT, handleFrameExit},
+};
+
+void handleFrameByte(uint8_t v)
+{
+    uint8_t result = frames.feed(v);
+
+    if(result == FRAME_BAD)
+        writeFrame(frames.getOpcode(), frames.getSequence(), FRAME_STATUS_BAD_CRC, 0, 0, 0, 0);
+    if(result != FRAME_OK)
+        return;
+
+    for(uint8_t i = 0; i < sizeof(frameTable) / sizeof(frameTable[0]); i++) {
+        if(frameTable[i].opcode == frames.getOpcode()) {
+            frameTable[i].handler(frames.getSequence(), frames.getPayload(), frames.getLength());
+            return;
+        }
+    }
+    writeFrame(frames.getOpcode(), frames.getSequence(), FRAME_STATUS_UNKNOWN, 0, 0, 0, 0);
+}
+
+#ifdef TARGET_HOST
+//The simulated USART2 has no DMA, reading DR clears the interrupt
+void serialRx()
+{
+    while(USART2->SR & USART_SR_RXNE)
+        commands.push(USART2->DR);
+}
+
+void startSerialRx()
+{
+    pc.attach(&serialRx, Serial::RxIrq);
+}
+#else
+//USART2_RX is DMA1 Stream5 channel 4
+#define SERIAL_DMA_CHANNEL 4
+
+//Ring halves the DMA has filled
+static volatile uint32_t serialHalves = 0;
+
+//The current half is whatever NDTR says past the last counted one
+uint32_t serialWritten()
+{
+    uint32_t base = serialHalves * (COMMAND_RX_SIZE / 2);
+    uint32_t position = COMMAND_RX_SIZE - DMA1_Stream5->NDTR;
+    return base + (position - base) % COMMAND_RX_SIZE;
+}
+
+void serialDmaIrq()
+{
+    uint32_t status = DMA1->HISR;
+    DMA1->HIFCR = DMA_HIFCR_CTCIF5 | DMA_HIFCR_CHTIF5 | DMA_HIFCR_CTEIF5 | DMA_HIFCR_CDMEIF5 | DMA_HIFCR_CFEIF5;
+
+    if(status & DMA_HISR_HTIF5)
+        serialHalves++;
+    if(status & DMA_HISR_TCIF5)
+        serialHalves++;
+}
+
+/* Only the end of a burst (IDLE) and a lost byte (ORE) interrupt, the
+   first to wake idle(). Reading SR then DR clears both. */
+void serialIrq()
+{
+    uint32_t status = USART2->SR;
+    if(status & (USART_SR_IDLE | USART_SR_ORE))
+        (void) USART2->DR;
+    if(status & USART_SR_ORE)
+        commands.overrun();
+}
+
+//USART2 is behind USBTX/USBRX, the DMA fills the command ring without the CPU
+void startSerialRx()
+{
+    SET_BIT(RCC->AHB1ENR, RCC_AHB1ENR_DMA1EN);
+
+    DMA1->HIFCR = DMA_HIFCR_CTCIF5 | DMA_HIFCR_CHTIF5 | DMA_HIFCR_CTEIF5 | DMA_HIFCR_CDMEIF5 | DMA_HIFCR_CFEIF5;
+    DMA1_Stream5->PAR = (uintptr_t) &USART2->DR;
+    DMA1_Stream5->M0AR = (uintptr_t) commands.getBuffer();
+    DMA1_Stream5->NDTR = COMMAND_RX_SIZE;
+    DMA1_Stream5->FCR = 0;      // Direct mode, byte to byte
+    DMA1_Stream5->CR = (SERIAL_DMA_CHANNEL * DMA_SxCR_CHSEL_0) | DMA_SxCR_MINC | DMA_SxCR_CIRC | DMA_SxCR_HTIE | DMA_SxCR_TCIE;
+    DMA1_Stream5->CR |= DMA_SxCR_EN;
+    commands.setWriter(&serialWritten);
+
+    NVIC_SetVector(DMA1_Stream5_IRQn, (uintptr_t) &serialDmaIrq);
+    NVIC_SetVector(USART2_IRQn, (uintptr_t) &serialIrq);
+    NVIC_EnableIRQ(DMA1_Stream5_IRQn);
+    NVIC_EnableIRQ(USART2_IRQn);
+
+    USART2->CR3 |= USART_CR3_DMAR | USART_CR3_EIE;
+    USART2->CR1 = (USART2->CR1 & ~USART_CR1_RXNEIE) | USART_CR1_IDLEIE;
+}
+#endif
+
+//Sleeps until the next interrupt, a byte may arrive before the WFI
+inline void idle()
+{
+    __disable_irq();
+    if(commands.empty())
+        __WFI();
+    __enable_irq();
+}
+
+void handleSerial()
+{
+    uint8_t cmd_buffer[COMMAND_LONG_LENGTH];
+
+    led = 0;
+
+    //Looping through the received commands, SUMP or framed
+    while (1) {
+        led = 0;
+
+        if(framed) {
+            uint8_t v;
+            while(!commands.read(v))
+                idle();
+
+            led = 1;
+            handleFrameByte(v);
+            continue;
+        }
+
+        while(!commands.next(cmd_buffer))
+            idle();
+
+        led = 1;
+        decoder.decode(cmd_buffer, decoder.length(cmd_buffer[0]));
+    }
+}
+
+
+
+int main()
+{
+    paintStack();
+    pc.baud(115200);
+
+    //Flush it
+    while(pc.readable() == 1)
+        pc.getc();
+
+    startSerialRx();
+
+    blink(50,100,5);
+
+    handleSerial();
+    return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+#include "CaptureCorpus.h"
+#include <cstdlib>
+
+void rleEncode(const Bytes &s, Bytes &out)
+{
+    out.clear();
+    for(size_t i = 0; i < s.size(); ) {
+        size_t run = 1;
+        while(run < 256 && i + run < s.size() && s[i + run] == s[i])
+            run++;
+        out.push_back(s[i]);
+        out.push_back(run - 1);
+        i += run;
+    }
+}
+
+void rleDecode(const Bytes &in, Bytes &out)
+{
+    out.clear();
+    for(size_t i = 0; i + 1 < in.size(); i += 2)
+        out.insert(out.end(), in[i + 1] + 1, in[i]);
+}
+
+//Holds each bit for bitSamples samples on channel ch, LSB first, from the current level
+static void serial(Bytes &s, uint8_t &level, uint8_t ch, uint32_t bits, uint8_t count, double bitSamples, double &t)
+{
+    for(uint8_t b = 0; b < count; b++) {
+        level = (level & ~(1 << ch)) | (((bits >> b) & 1) << ch);
+        for(t += bitSamples; s.size() < t && s.size() < CORPUS_SAMPLES; )
+            s.push_back(level);
+    }
+}
+
+static Bytes uart()
+{
+    Bytes s;
+    uint8_t level = 1;
+    double t = 0;
+
+    //115200 baud at 1 MSPS, frames with random gaps
+    while(s.size() < CORPUS_SAMPLES) {
+        serial(s, level, 0, 1, 1, 8.68 * (1 + rand() % 30), t);
+        serial(s, level, 0, (rand() & 0xFF) << 1 | 0x200, 10, 8.68, t);
+    }
+    return s;
+}
+
+static Bytes spi()
+{
+    Bytes s;
+
+    //Chip select low for 4 bytes, clock of 4 samples, MOSI on ch1, MISO on ch2
+    while(s.size() < CORPUS_SAMPLES) {
+        s.insert(s.end(), 20 + rand() % 200, 0x08);
+        for(int n = 0; n < 4; n++) {
+            uint8_t mosi = rand(), miso = rand();
+            for(int b = 7; b >= 0; b--) {
+                uint8_t d = ((mosi >> b) & 1) << 1 | ((miso >> b) & 1) << 2;
+                s.insert(s.end(), 2, d);
+                s.insert(s.end(), 2, d | 1);
+            }
+        }
+    }
+    s.resize(CORPUS_SAMPLES);
+    return s;
+}
+
+static Bytes i2c()
+{
+    Bytes s;
+
+    //100 kHz at 1 MSPS, SCL on ch0 and SDA on ch1, address and two bytes with acks
+    while(s.size() < CORPUS_SAMPLES) {
+        s.insert(s.end(), 50 + rand() % 500, 0x03);
+        s.insert(s.end(), 5, 0x01);
+        for(int n = 0; n < 27; n++) {
+            uint8_t sda = n % 9 == 8 ? 0 : rand() & 1;
+            s.insert(s.end(), 3, sda << 1);
+            s.insert(s.end(), 5, sda << 1 | 1);
+            s.insert(s.end(), 2, sda << 1);
+        }
+        s.insert(s.end(), 5, 0x01);
+    }
+    s.resize(CORPUS_SAMPLES);
+    return s;
+}
+
+void captureCorpus(std::vector<Capture> &out)
+{
+    Capture c;
+
+    c.name = "idle";
+    c.samples.assign(CORPUS_SAMPLES, 0x81);
+    out.push_back(c);
+
+    c.name = "uart";
+    c.samples = uart();
+    out.push_back(c);
+
+    c.name = "spi";
+    c.samples = spi();
+    out.push_back(c);
+
+    c.name = "i2c";
+    c.samples = i2c();
+    out.push_back(c);
+
+    c.name = "counter";
+    c.samples.resize(CORPUS_SAMPLES);
+    for(uint32_t i = 0; i < CORPUS_SAMPLES; i++)
+        c.samples[i] = i;
+    out.push_back(c);
+
+    c.name = "noise";
+    for(uint32_t i = 0; i < CORPUS_SAMPLES; i++)
+        c.samples[i] = rand();
+    out.push_back(c);
+}
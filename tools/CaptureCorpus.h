@@ -0,0 +1,23 @@
+#ifndef CAPTURECORPUS_H
+#define CAPTURECORPUS_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define CORPUS_SAMPLES 32768
+
+typedef std::vector<uint8_t> Bytes;
+
+struct Capture {
+    std::string name;
+    Bytes samples;
+};
+
+/* Synthetic captures of an idle bus, UART, SPI, I2C, a counter and
+   noise, CORPUS_SAMPLES each, for the codec benchmarks. */
+void captureCorpus(std::vector<Capture> &out);
+
+//Host copy of the RLE window encoding: (value, run length - 1) pairs
+void rleEncode(const Bytes &samples, Bytes &out);
+void rleDecode(const Bytes &in, Bytes &out);
+#endif
@@ -0,0 +1,256 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+#include "FrameClient.h"
+#include <algorithm>
+#include <cstring>
+
+static uint32_t readUInt32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+FrameClient::FrameClient(SumpClient *s)
+{
+    sump = s;
+    sequence = 1;
+    retransmissions = 0;
+    badFrames = 0;
+    retries = 3;
+    timeout = 1000;
+    pendingIndex = 0;
+}
+
+uint32_t FrameClient::getRetransmissions()
+{
+    return retransmissions;
+}
+
+uint32_t FrameClient::getBadFrames()
+{
+    return badFrames;
+}
+
+void FrameClient::setRetries(int r)
+{
+    retries = r;
+}
+
+void FrameClient::setTimeout(int ms)
+{
+    timeout = ms;
+}
+
+void FrameClient::append(std::vector<uint8_t> &commands, uint8_t opcode, uint32_t parameter)
+{
+    commands.push_back(opcode);
+    for(int i = 0; i < 4; i++)
+        commands.push_back(parameter >> (8 * i));
+}
+
+bool FrameClient::send(uint8_t opcode, uint8_t seq, const uint8_t *payload, uint16_t length)
+{
+    std::vector<uint8_t> frame(FRAME_HEADER);
+    FrameParser::header(&frame[0], opcode, seq, length);
+    frame.insert(frame.end(), payload, payload + length);
+
+    uint16_t crc = FrameParser::crc(0xFFFF, &frame[1], frame.size() - 1);
+    frame.push_back(crc & 0xFF);
+    frame.push_back(crc >> 8);
+
+    return sump->write(&frame[0], frame.size());
+}
+
+//Next frame in the parser: FRAME_OK, FRAME_BAD or FRAME_NONE on timeout
+uint8_t FrameClient::receive(int timeoutMs)
+{
+    double deadline = sumpNow() + timeoutMs / 1e3;
+
+    while(true) {
+        while(pendingIndex < pending.size()) {
+            uint8_t result = parser.feed(pending[pendingIndex++]);
+            if(result == FRAME_BAD)
+                badFrames++;
+            if(result != FRAME_NONE)
+                return result;
+        }
+
+        int left = (deadline - sumpNow()) * 1e3;
+        if(left <= 0)
+            return FRAME_NONE;
+
+        pending.resize(4096);
+        pending.resize(sump->readAvailable(&pending[0], pending.size(), left));
+        pendingIndex = 0;
+    }
+}
+
+uint8_t FrameClient::status()
+{
+    return parser.getLength() ? parser.getPayload()[0] : FRAME_STATUS_BAD_LENGTH;
+}
+
+bool FrameClient::request(uint8_t opcode, const uint8_t *payload, uint16_t length, int timeoutMs)
+{
+    for(int attempt = 0; attempt <= retries; attempt++) {
+        if(attempt > 0)
+            retransmissions++;
+
+        uint8_t seq = sequence++;
+        if(!send(opcode, seq, payload, length))
+            return false;
+
+        //A broken frame is most likely the reply, replies to earlier attempts are stale
+        while(receive(timeoutMs) == FRAME_OK) {
+            if(parser.getOpcode() != opcode || parser.getSequence() != seq)
+                continue;
+            if(status() == FRAME_STATUS_BAD_CRC)
+                break;
+            return true;
+        }
+    }
+    return false;
+}
+
+//The device answers the enter command with a ping reply
+bool FrameClient::enter()
+{
+    parser.reset();
+    pending.clear();
+    pendingIndex = 0;
+
+    if(!sump->command(SUMP_ENTER_FRAMED, FRAME_MAGIC))
+        return false;
+
+    uint8_t result;
+    while((result = receive(timeout)) != FRAME_NONE) {
+        if(result == FRAME_OK && parser.getOpcode() == FRAME_PING && status() == FRAME_STATUS_OK)
+            return true;
+    }
+    return false;
+}
+
+bool FrameClient::leave()
+{
+    return request(FRAME_EXIT, NULL, 0, timeout) && status() == FRAME_STATUS_OK;
+}
+
+bool FrameClient::ping()
+{
+    if(!request(FRAME_PING, NULL, 0, timeout) || status() != FRAME_STATUS_OK || parser.getLength() < 6)
+        return false;
+    return !memcmp(parser.getPayload() + 1, "LNFP", 4);
+}
+
+bool FrameClient::configure(const std::vector<uint8_t> &commands)
+{
+    if(commands.size() > FRAME_MAX_PAYLOAD)
+        return false;
+    return request(FRAME_CONFIGURE, commands.empty() ? NULL : &commands[0], commands.size(), timeout) &&
+           status() == FRAME_STATUS_OK;
+}
+
+bool FrameClient::capture(uint32_t &samples, int timeoutMs)
+{
+    if(!request(FRAME_CAPTURE, NULL, 0, timeoutMs) || status() != FRAME_STATUS_OK || parser.getLength() < 5)
+        return false;
+
+    samples = readUInt32(parser.getPayload() + 1);
+    return true;
+}
+
+bool FrameClient::read(uint32_t offset, uint16_t length, std::vector<uint8_t> &out)
+{
+    uint8_t payload[6];
+    storeUInt32(payload, offset);
+    storeUInt16(payload + 4, length);
+
+    if(!request(FRAME_READ, payload, sizeof(payload), timeout) || status() != FRAME_STATUS_OK || parser.getLength() < 5)
+        return false;
+    if(readUInt32(parser.getPayload() + 1) != offset)
+        return false;
+
+    out.assign(parser.getPayload() + 5, parser.getPayload() + parser.getLength());
+    return true;
+}
+
+bool FrameClient::readAll(uint32_t samples, uint16_t chunk, std::vector<uint8_t> &out)
+{
+    std::vector<uint8_t> data;
+    chunk = std::max((uint16_t) 1, std::min(chunk, (uint16_t) FRAME_MAX_SAMPLES));
+
+    out.clear();
+    for(uint32_t offset = 0; offset < samples; offset += chunk) {
+        if(!read(offset, std::min((uint32_t) chunk, samples - offset), data) || data.empty())
+            return false;
+        out.insert(out.end(), data.begin(), data.end());
+    }
+
+    std::reverse(out.begin(), out.end());
+    return out.size() == samples;
+}
+
+bool FrameClient::stream(uint32_t samples, uint16_t chunk, std::vector<uint8_t> &out, int timeoutMs)
+{
+    chunk = std::max((uint16_t) 1, std::min(chunk, (uint16_t) FRAME_MAX_SAMPLES));
+
+    uint32_t chunks = (samples + chunk - 1) / chunk;
+    std::vector<bool> received(chunks, false);
+    uint8_t payload[2];
+    uint8_t seq = sequence;
+
+    storeUInt16(payload, chunk);
+    sequence += chunks + 1;
+    out.assign(samples, 0);
+
+    if(!send(FRAME_STREAM, seq, payload, sizeof(payload)))
+        return false;
+
+    //The first chunk comes after the capture, the others back to back
+    int wait = timeoutMs;
+    uint8_t result;
+    while((result = receive(wait)) != FRAME_NONE) {
+        wait = timeout;
+        if(result != FRAME_OK || parser.getOpcode() != FRAME_STREAM)
+            continue;
+        if(status() == FRAME_STATUS_END)
+            break;
+        if(status() != FRAME_STATUS_OK || parser.getLength() < 5)
+            continue;
+
+        uint32_t offset = readUInt32(parser.getPayload() + 1);
+        uint32_t n = parser.getLength() - 5;
+        if(offset % chunk || offset + n > samples)
+            continue;
+
+        std::copy(parser.getPayload() + 5, parser.getPayload() + 5 + n, out.begin() + offset);
+        received[offset / chunk] = n == std::min((uint32_t) chunk, samples - offset);
+    }
+
+    //Broken or lost chunks are read again
+    std::vector<uint8_t> data;
+    for(uint32_t c = 0; c < chunks; c++) {
+        if(received[c])
+            continue;
+
+        uint32_t offset = c * chunk;
+        retransmissions++;
+        if(!read(offset, std::min((uint32_t) chunk, samples - offset), data))
+            return false;
+        std::copy(data.begin(), data.end(), out.begin() + offset);
+    }
+
+    std::reverse(out.begin(), out.end());
+    return true;
+}
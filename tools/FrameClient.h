@@ -0,0 +1,60 @@
+#ifndef FRAMECLIENT_H
+#define FRAMECLIENT_H
+#include "SumpClient.h"
+#include "../src/FrameCodec.h"
+#include <vector>
+
+#define SUMP_ENTER_FRAMED 0xAA
+
+/* Host side of the framed protocol (src/FrameCodec.h), on top of an
+   open SumpClient. Requests are sent again when the reply is broken,
+   reports a bad CRC or does not arrive in time. */
+class FrameClient{
+
+public:
+
+    FrameClient(SumpClient *sump);
+
+    bool enter();
+    bool leave();
+    bool ping();
+
+    //Batch of SUMP configuration commands, built with append()
+    bool configure(const std::vector<uint8_t> &commands);
+    static void append(std::vector<uint8_t> &commands, uint8_t opcode, uint32_t parameter);
+
+    bool capture(uint32_t &samples, int timeoutMs);
+
+    //Samples in upload order (newest first) from offset
+    bool read(uint32_t offset, uint16_t length, std::vector<uint8_t> &out);
+
+    //The whole capture in chunks, oldest sample first
+    bool readAll(uint32_t samples, uint16_t chunk, std::vector<uint8_t> &out);
+
+    //Captures and receives the chunks as the device sends them, oldest sample first
+    bool stream(uint32_t samples, uint16_t chunk, std::vector<uint8_t> &out, int timeoutMs);
+
+    //Getters and Setters
+    uint32_t getRetransmissions();
+    uint32_t getBadFrames();
+    void setRetries(int);
+    void setTimeout(int ms);
+
+private:
+    bool send(uint8_t opcode, uint8_t sequence, const uint8_t *payload, uint16_t length);
+    uint8_t receive(int timeoutMs);
+    bool request(uint8_t opcode, const uint8_t *payload, uint16_t length, int timeoutMs);
+    uint8_t status();
+
+    SumpClient *sump;
+    FrameParser parser;
+    uint8_t sequence;
+    uint32_t retransmissions;
+    uint32_t badFrames;
+    int retries;
+    int timeout;
+
+    std::vector<uint8_t> pending;
+    size_t pendingIndex;
+};
+#endif
@@ -0,0 +1,311 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+#include "SumpClient.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+double sumpNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static speed_t toSpeed(int baud)
+{
+    switch(baud) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return B115200;
+    }
+}
+
+SumpClient::SumpClient()
+{
+    fd = -1;
+}
+
+SumpClient::~SumpClient()
+{
+    close();
+}
+
+static int connectTcp(const char *address)
+{
+    std::string host(address);
+    size_t colon = host.rfind(':');
+    if(colon == std::string::npos)
+        return -1;
+
+    std::string port = host.substr(colon + 1);
+    host.resize(colon);
+
+    struct addrinfo hints, *list;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if(getaddrinfo(host.c_str(), port.c_str(), &hints, &list) != 0)
+        return -1;
+
+    int s = -1;
+    for(struct addrinfo *a = list; a != NULL && s < 0; a = a->ai_next) {
+        s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if(s >= 0 && connect(s, a->ai_addr, a->ai_addrlen) != 0) {
+            ::close(s);
+            s = -1;
+        }
+    }
+    freeaddrinfo(list);
+
+    //Commands are a few bytes, do not wait to fill a segment
+    int one = 1;
+    if(s >= 0)
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return s;
+}
+
+bool SumpClient::open(const char *device, int baud)
+{
+    close();
+
+    if(!strncmp(device, "tcp:", 4)) {
+        fd = connectTcp(device + 4);
+        return fd >= 0;
+    }
+
+    fd = ::open(device, O_RDWR | O_NOCTTY);
+    if(fd < 0)
+        return false;
+
+    //Not a tty (pipe, socket): use as is
+    struct termios tio;
+    if(tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, toSpeed(baud));
+        cfsetospeed(&tio, toSpeed(baud));
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &tio);
+        tcflush(fd, TCIOFLUSH);
+    }
+
+    return true;
+}
+
+void SumpClient::close()
+{
+    if(fd >= 0)
+        ::close(fd);
+    fd = -1;
+}
+
+bool SumpClient::isOpen()
+{
+    return fd >= 0;
+}
+
+int SumpClient::getFd()
+{
+    return fd;
+}
+
+bool SumpClient::write(const uint8_t *data, size_t len)
+{
+    while(len > 0) {
+        ssize_t n = ::write(fd, data, len);
+        if(n <= 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+size_t SumpClient::read(uint8_t *data, size_t len, int timeoutMs)
+{
+    size_t total = 0;
+
+    while(total < len) {
+        struct pollfd p;
+        p.fd = fd;
+        p.events = POLLIN;
+
+        if(poll(&p, 1, timeoutMs) <= 0)
+            break;
+
+        ssize_t n = ::read(fd, data + total, len - total);
+        if(n <= 0)
+            break;
+        total += n;
+    }
+    return total;
+}
+
+size_t SumpClient::readAvailable(uint8_t *data, size_t len, int timeoutMs)
+{
+    struct pollfd p;
+    p.fd = fd;
+    p.events = POLLIN;
+
+    if(poll(&p, 1, timeoutMs) <= 0)
+        return 0;
+
+    ssize_t n = ::read(fd, data, len);
+    return n > 0 ? n : 0;
+}
+
+bool SumpClient::command(uint8_t opcode)
+{
+    return write(&opcode, 1);
+}
+
+//Parameters are sent LSB first
+bool SumpClient::command(uint8_t opcode, uint32_t param)
+{
+    uint8_t cmd[5];
+    cmd[0] = opcode;
+    cmd[1] = param & 0xFF;
+    cmd[2] = (param >> 8) & 0xFF;
+    cmd[3] = (param >> 16) & 0xFF;
+    cmd[4] = (param >> 24) & 0xFF;
+    return write(cmd, sizeof(cmd));
+}
+
+//Five resets bring the device out of any long command
+void SumpClient::reset()
+{
+    for(int i = 0; i < 5; i++)
+        command(SUMP_RESET);
+}
+
+bool SumpClient::setRate(uint32_t rate)
+{
+    return command(SUMP_SET_DIVIDER, SUMP_ORIGINAL_FREQ / rate - 1);
+}
+
+bool SumpClient::setSampleNumber(uint32_t samples)
+{
+    uint32_t count = samples / 4 - 1;
+    return command(SUMP_SET_READ_DELAY_COUNT, count & 0xFFFF);
+}
+
+bool SumpClient::capture(uint8_t opcode, uint32_t samples, std::vector<uint8_t> &out, int timeoutMs)
+{
+    out.resize(samples);
+
+    if(!command(opcode))
+        return false;
+
+    if(read(&out[0], samples, timeoutMs) != samples)
+        return false;
+
+    //Samples arrive newest first
+    std::reverse(out.begin(), out.end());
+    return true;
+}
+
+//CRC-32 (0x04C11DB7) from 0xFFFFFFFF over little endian words, MSB first
+uint32_t sumpCrc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for(size_t i = 0; i + 4 <= len; i += 4) {
+        crc ^= data[i] | (data[i + 1] << 8) | (data[i + 2] << 16) | ((uint32_t) data[i + 3] << 24);
+        for(int b = 0; b < 32; b++)
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+    }
+    return crc;
+}
+
+static bool chunkValid(const uint8_t *chunk, size_t length)
+{
+    const uint8_t *c = chunk + length;
+    return sumpCrc32(chunk, length) == (uint32_t) ((c[0] << 24) | (c[1] << 16) | (c[2] << 8) | c[3]);
+}
+
+bool SumpClient::captureChunked(uint8_t opcode, uint32_t samples, uint16_t chunk, std::vector<uint8_t> &out,
+                                int timeoutMs, uint32_t &resent)
+{
+    chunk &= ~3;
+    if(chunk == 0 || !command(SUMP_SET_UPLOAD_CHUNK, chunk) || !command(opcode))
+        return false;
+
+    uint32_t chunks = (samples + chunk - 1) / chunk;
+    std::vector<uint8_t> data(chunk + 4);
+    std::vector<uint32_t> bad;
+
+    out.resize(samples);
+    resent = 0;
+
+    /* A lost byte shifts every later chunk, which then fail their CRC.
+       After a timeout the rest of the chunks are asked for again. */
+    bool timedOut = false;
+    for(uint32_t c = 0; c < chunks; c++) {
+        uint32_t length = std::min((uint32_t) chunk, samples - c * chunk);
+
+        if(timedOut || read(&data[0], length + 4, c == 0 ? timeoutMs : 1000) != length + 4) {
+            timedOut = true;
+            bad.push_back(c);
+            continue;
+        }
+
+        if(chunkValid(&data[0], length))
+            std::copy(data.begin(), data.begin() + length, out.begin() + c * chunk);
+        else
+            bad.push_back(c);
+    }
+
+    //Anything left of a broken upload
+    uint8_t drain[256];
+    while(!bad.empty() && read(drain, sizeof(drain), 100) > 0);
+
+    for(size_t i = 0; i < bad.size(); i++) {
+        uint32_t c = bad[i];
+        uint32_t length = std::min((uint32_t) chunk, samples - c * chunk);
+        bool ok = false;
+
+        for(int attempt = 0; attempt < 3 && !ok; attempt++) {
+            resent++;
+            command(SUMP_RESEND_CHUNK, c);
+            ok = read(&data[0], length + 4, 1000) == length + 4 && chunkValid(&data[0], length);
+            if(!ok)
+                while(read(drain, sizeof(drain), 100) > 0);
+        }
+
+        if(!ok)
+            return false;
+        std::copy(data.begin(), data.begin() + length, out.begin() + c * chunk);
+    }
+
+    //Samples arrive newest first
+    std::reverse(out.begin(), out.end());
+    return true;
+}
@@ -0,0 +1,61 @@
+#ifndef SUMPCLIENT_H
+#define SUMPCLIENT_H
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#define SUMP_RESET 0x00
+#define SUMP_ARM   0x01
+#define SUMP_QUERY 0x02
+#define SUMP_TEST   0x03
+#define SUMP_GET_METADATA 0x04
+#define SUMP_SET_DIVIDER 0x80
+#define SUMP_SET_READ_DELAY_COUNT 0x81
+#define SUMP_SET_FLAGS 0x82
+#define SUMP_SET_UPLOAD_CHUNK 0xAB
+#define SUMP_RESEND_CHUNK 0xAC
+
+#define SUMP_ORIGINAL_FREQ  (100000000)
+
+/* Minimal SUMP host side over a serial port (termios) or TCP. */
+class SumpClient{
+
+public:
+
+    SumpClient();
+    ~SumpClient();
+
+    //A serial device, or tcp:host:port for sumpbridge
+    bool open(const char *device, int baud);
+    void close();
+    bool isOpen();
+    int getFd();
+
+    bool write(const uint8_t *data, size_t len);
+    size_t read(uint8_t *data, size_t len, int timeoutMs);
+    size_t readAvailable(uint8_t *data, size_t len, int timeoutMs);   // Waits for the first byte only
+
+    bool command(uint8_t opcode);
+    bool command(uint8_t opcode, uint32_t param);
+
+    void reset();
+    bool setRate(uint32_t rate);
+    bool setSampleNumber(uint32_t samples);
+
+    //Sends the capture opcode and returns the samples oldest first
+    bool capture(uint8_t opcode, uint32_t samples, std::vector<uint8_t> &out, int timeoutMs);
+
+    //Same, with the chunked upload enabled; chunks with a bad CRC are asked for again
+    bool captureChunked(uint8_t opcode, uint32_t samples, uint16_t chunk, std::vector<uint8_t> &out,
+                        int timeoutMs, uint32_t &resent);
+
+private:
+    int fd;
+};
+
+//Monotonic time in seconds
+double sumpNow();
+
+//CRC of the chunked upload, as computed by the STM32 CRC unit
+uint32_t sumpCrc32(const uint8_t *data, size_t len);
+#endif
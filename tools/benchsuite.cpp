@@ -0,0 +1,392 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+/*
+ Benchmark suite with a JSON report, to compare firmware builds:
+
+   benchsuite [-n runs] [-o report.json] [-d device [-b baud] [-r rate] [-s samples]]
+
+ The host part runs the RLE and delta + LZ window encoders and their
+ decoders (src/CaptureCodec.cpp built for the host) on the synthetic
+ corpus of codecbench and checks every round trip. With a device, it
+ runs a test capture (0x03), times a raw window readback, and runs the
+ benchmark command (0x14), which measures with the DWT cycle counter the
+ cycles per sample of every kernel from flash and RAM, the latency from
+ a trigger match to the first sample, the encoder cycles on the test
+ capture and the upload of that capture.
+*/
+
+#include "../src/CaptureCodec.h"
+#include "SumpClient.h"
+#include "CaptureCorpus.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+
+#define SUMP_RUN_BENCHMARK 0x14
+#define SUMP_SET_READ_WINDOW 0xA8
+#define SUMP_READ_WINDOW 0xA9
+
+#define WINDOW_RAW 0
+
+#define BENCH_KERNEL 0x40
+#define BENCH_KERNEL_CYCLES 0x20
+#define BENCH_KERNEL_FLASH 0x21
+#define BENCH_KERNEL_FLASH_SPREAD 0x22
+#define BENCH_KERNEL_RAM 0x23
+#define BENCH_KERNEL_RAM_SPREAD 0x24
+#define BENCH_CORE_CLOCK 0x28
+#define BENCH_TRIGGER_LATENCY 0x29
+#define BENCH_TRIGGER_MAX 0x2A
+#define BENCH_TRIGGER_RESOLUTION 0x2B
+#define BENCH_ENCODE_SAMPLES 0x2C
+#define BENCH_RLE_BYTES 0x2D
+#define BENCH_RLE_CYCLES 0x2E
+#define BENCH_LZ_BYTES 0x2F
+#define BENCH_LZ_CYCLES 0x30
+#define BENCH_UPLOAD_BYTES 0x31
+#define BENCH_UPLOAD_CYCLES 0x32
+
+#define BENCH_TIMEOUT 20000
+
+typedef std::map<uint8_t, uint32_t> Values;
+
+//Minimal JSON writer, one member per line
+class Json{
+
+public:
+    Json(FILE *f) : out(f), depth(0), first(true) {}
+
+    void open(const char *key, char bracket)
+    {
+        member(key);
+        fputc(bracket, out);
+        depth++;
+        first = true;
+    }
+
+    void close(char bracket)
+    {
+        depth--;
+        fprintf(out, "\n%*s%c", depth * 2, "", bracket);
+        first = false;
+        if(depth == 0)
+            fputc('\n', out);
+    }
+
+    void number(const char *key, double v)
+    {
+        member(key);
+        fprintf(out, "%.6g", v);
+    }
+
+    void integer(const char *key, uint64_t v)
+    {
+        member(key);
+        fprintf(out, "%llu", (unsigned long long) v);
+    }
+
+    void boolean(const char *key, bool v)
+    {
+        member(key);
+        fputs(v ? "true" : "false", out);
+    }
+
+    void string(const char *key, const std::string &v)
+    {
+        member(key);
+        fputc('"', out);
+        for(size_t i = 0; i < v.size(); i++) {
+            if(v[i] == '"' || v[i] == '\\')
+                fputc('\\', out);
+            if((uint8_t) v[i] >= 0x20)
+                fputc(v[i], out);
+        }
+        fputc('"', out);
+    }
+
+private:
+    //Array elements have no key
+    void member(const char *key)
+    {
+        if(depth > 0)
+            fprintf(out, "%s\n%*s", first ? "" : ",", depth * 2, "");
+        if(key)
+            fprintf(out, "\"%s\": ", key);
+        first = false;
+    }
+
+    FILE *out;
+    int depth;
+    bool first;
+};
+
+static void collect(void *context, uint8_t v)
+{
+    ((Bytes *) context)->push_back(v);
+}
+
+static CaptureCodec codec;
+
+static void codecReport(Json &json, const char *name, size_t samples, size_t bytes, double encode, double decode, bool ok)
+{
+    json.open(name, '{');
+    json.integer("bytes", bytes);
+    json.number("ratio", (double) samples / bytes);
+    json.number("encode_mb_per_s", samples / encode / 1e6);
+    json.number("decode_mb_per_s", samples / decode / 1e6);
+    json.boolean("ok", ok);
+    json.close('}');
+}
+
+static bool host(Json &json, const Capture &c, int runs)
+{
+    const Bytes &s = c.samples;
+    Bytes r, rd, lz;
+    Bytes ld(s.size());
+
+    double t0 = sumpNow();
+    for(int i = 0; i < runs; i++)
+        rleEncode(s, r);
+    double t1 = sumpNow();
+    for(int i = 0; i < runs; i++)
+        rleDecode(r, rd);
+    double t2 = sumpNow();
+    uint32_t size = 0;
+    for(int i = 0; i < runs; i++) {
+        lz.clear();
+        size = codec.encode(s.data(), s.size(), 1, collect, &lz);
+    }
+    double t3 = sumpNow();
+    uint32_t decoded = 0;
+    for(int i = 0; i < runs; i++)
+        decoded = CaptureCodec::decode(lz.data(), lz.size(), ld.data(), ld.size());
+    double t4 = sumpNow();
+
+    bool rleOk = rd == s;
+    bool lzOk = size == lz.size() && decoded == s.size() && ld == s;
+
+    json.open(NULL, '{');
+    json.string("name", c.name);
+    json.integer("samples", s.size());
+    codecReport(json, "rle", s.size(), r.size(), (t1 - t0) / runs, (t2 - t1) / runs, rleOk);
+    codecReport(json, "lz", s.size(), lz.size(), (t3 - t2) / runs, (t4 - t3) / runs, lzOk);
+    json.close('}');
+
+    return rleOk && lzOk;
+}
+
+/* Metadata tokens: 0x01-0x1F strings, 0x20-0x3F uint32 (big endian),
+   0x40-0x5F one byte, up to 0x00. A one byte key starts a group, the
+   values that follow are stored under (group, key). */
+static bool readTokens(SumpClient &sump, std::map<int, Values> &groups, std::map<uint8_t, std::string> &strings)
+{
+    int group = -1;
+    uint8_t key;
+
+    while(sump.read(&key, 1, BENCH_TIMEOUT) == 1) {
+        uint8_t v[4];
+
+        if(key == 0x00)
+            return true;
+
+        if(key < 0x20) {
+            std::string text;
+            while(sump.read(v, 1, BENCH_TIMEOUT) == 1 && v[0] != 0)
+                text += (char) v[0];
+            strings[key] = text;
+        }else if(key < 0x40) {
+            if(sump.read(v, 4, BENCH_TIMEOUT) != 4)
+                return false;
+            groups[group][key] = (v[0] << 24) | (v[1] << 16) | (v[2] << 8) | v[3];
+        }else {
+            if(sump.read(v, 1, BENCH_TIMEOUT) != 1)
+                return false;
+            group = v[0];
+        }
+    }
+    return false;
+}
+
+static bool readWindow(SumpClient &sump, Bytes &out, double &seconds)
+{
+    uint8_t header[4];
+
+    double t0 = sumpNow();
+    sump.command(SUMP_SET_READ_WINDOW, 0);
+    sump.command(SUMP_READ_WINDOW, 1 | (WINDOW_RAW << 16));
+    if(sump.read(header, sizeof(header), BENCH_TIMEOUT) != sizeof(header))
+        return false;
+
+    out.resize((header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3]);
+    if(!out.empty() && sump.read(&out[0], out.size(), BENCH_TIMEOUT) != out.size())
+        return false;
+    seconds = sumpNow() - t0;
+    return true;
+}
+
+static void encoderReport(Json &json, const char *name, uint32_t samples, uint32_t bytes, uint32_t cycles)
+{
+    json.open(name, '{');
+    json.integer("bytes", bytes);
+    json.integer("cycles", cycles);
+    json.number("cycles_per_byte", samples ? (double) cycles / samples : 0);
+    json.close('}');
+}
+
+static bool device(Json &json, const char *path, int baud, uint32_t rate, uint32_t samples)
+{
+    SumpClient sump;
+    if(!sump.open(path, baud)) {
+        perror(path);
+        return false;
+    }
+
+    sump.reset();
+    sump.setRate(rate);
+    sump.setSampleNumber(samples);
+
+    std::map<int, Values> groups, none;
+    std::map<uint8_t, std::string> strings;
+    Bytes captured, window;
+    double windowTime;
+
+    if(!sump.command(SUMP_GET_METADATA) || !readTokens(sump, none, strings) ||
+       !sump.capture(SUMP_TEST, samples, captured, BENCH_TIMEOUT) || !readWindow(sump, window, windowTime) ||
+       !sump.command(SUMP_RUN_BENCHMARK) || !readTokens(sump, groups, strings)) {
+        fprintf(stderr, "%s: no reply\n", path);
+        return false;
+    }
+
+    Values &g = groups[-1];
+    double clock = g[BENCH_CORE_CLOCK] ? g[BENCH_CORE_CLOCK] : 1;
+
+    json.open("device", '{');
+    json.string("name", strings[0x01]);
+    json.integer("core_clock", g[BENCH_CORE_CLOCK]);
+
+    json.open("kernels", '[');
+    for(std::map<int, Values>::iterator k = groups.begin(); k != groups.end(); k++) {
+        Values &v = k->second;
+        if(k->first < 0)
+            continue;
+
+        json.open(NULL, '{');
+        json.integer("cycles", v[BENCH_KERNEL_CYCLES]);
+        json.number("flash_cycles_per_sample", v[BENCH_KERNEL_FLASH] / 1000.0);
+        json.integer("flash_spread", v[BENCH_KERNEL_FLASH_SPREAD]);
+        if(v.count(BENCH_KERNEL_RAM)) {
+            json.number("ram_cycles_per_sample", v[BENCH_KERNEL_RAM] / 1000.0);
+            json.integer("ram_spread", v[BENCH_KERNEL_RAM_SPREAD]);
+        }
+        json.close('}');
+    }
+    json.close(']');
+
+    json.open("trigger", '{');
+    json.integer("latency_cycles", g[BENCH_TRIGGER_LATENCY]);
+    json.integer("max_cycles", g[BENCH_TRIGGER_MAX]);
+    json.integer("resolution_cycles", g[BENCH_TRIGGER_RESOLUTION]);
+    json.number("latency_ns", g[BENCH_TRIGGER_LATENCY] / clock * 1e9);
+    json.close('}');
+
+    json.open("encoders", '{');
+    json.integer("samples", g[BENCH_ENCODE_SAMPLES]);
+    encoderReport(json, "rle", g[BENCH_ENCODE_SAMPLES], g[BENCH_RLE_BYTES], g[BENCH_RLE_CYCLES]);
+    encoderReport(json, "lz", g[BENCH_ENCODE_SAMPLES], g[BENCH_LZ_BYTES], g[BENCH_LZ_CYCLES]);
+    json.close('}');
+
+    json.open("upload", '{');
+    json.integer("baud", baud);
+    json.integer("bytes", g[BENCH_UPLOAD_BYTES]);
+    json.integer("cycles", g[BENCH_UPLOAD_CYCLES]);
+    json.number("bytes_per_s", g[BENCH_UPLOAD_CYCLES] ? g[BENCH_UPLOAD_BYTES] * clock / g[BENCH_UPLOAD_CYCLES] : 0);
+    json.number("host_window_bytes_per_s", window.size() / windowTime);
+    json.close('}');
+
+    json.close('}');
+    return true;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: benchsuite [-n runs] [-o report.json] [-d device [-b baud] [-r rate] [-s samples]]\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int runs = 20;
+    const char *path = NULL;
+    const char *output = NULL;
+    int baud = 115200;
+    uint32_t rate = 1000000;
+    uint32_t samples = 8192;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-o") && i + 1 < argc)
+            output = argv[++i];
+        else if(!strcmp(argv[i], "-d") && i + 1 < argc)
+            path = argv[++i];
+        else if(!strcmp(argv[i], "-b") && i + 1 < argc)
+            baud = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-r") && i + 1 < argc)
+            rate = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-s") && i + 1 < argc)
+            samples = atoi(argv[++i]);
+        else
+            usage();
+    }
+
+    if(runs <= 0 || rate == 0 || samples == 0)
+        usage();
+
+    FILE *out = output ? fopen(output, "w") : stdout;
+    if(out == NULL) {
+        perror(output);
+        return 1;
+    }
+
+    std::vector<Capture> captures;
+    captureCorpus(captures);
+
+    Json json(out);
+    int failed = 0;
+
+    json.open(NULL, '{');
+    json.open("host", '{');
+    json.integer("runs", runs);
+    json.open("captures", '[');
+    for(size_t i = 0; i < captures.size(); i++)
+        failed += !host(json, captures[i], runs);
+    json.close(']');
+    json.close('}');
+
+    if(path) {
+        json.integer("rate", rate);
+        failed += !device(json, path, baud, rate, samples);
+    }
+
+    json.boolean("ok", failed == 0);
+    json.close('}');
+
+    if(output)
+        fclose(out);
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,550 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+/*
+ Tests sumpbridge against a simulated board on a pseudo terminal, and
+ compares the latency of direct and bridged access.
+
+   bridgebench [-n runs] [-b baud] [-s samples] [-c clients] [-p port]
+
+ The simulated board answers the ID, metadata, capture (arm and test),
+ chunked upload and window readback commands. Its replies are paced at
+ the baud rate, and its command ring has the 256 bytes of the firmware,
+ so that a bridge that writes too far ahead loses commands. Every
+ capture is a ramp from a seed that changes with each capture:
+
+   1. the same operations, direct on the pty and through the bridge
+   2. clients with different sample counts and chunk sizes, all at once
+   3. clients with the same configuration, which share captures
+
+ Every reply is checked. sumpbridge is started from the directory of
+ this program.
+*/
+
+#include "../src/CaptureCodec.h"
+#include "SumpClient.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <pty.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define SIM_RING 1024
+#define SIM_MAX_SAMPLES 32768
+
+#define SUMP_SET_READ_WINDOW 0xA8
+#define SUMP_READ_WINDOW 0xA9
+#define WINDOW_RLE 1
+#define WINDOW_LZ 2
+
+typedef std::vector<uint8_t> Bytes;
+
+/* Serial side of the firmware: an RX thread fills a 1024 byte ring, and
+   the main thread runs one command at a time from it. */
+class SimBoard {
+
+public:
+
+    SimBoard(int fd, int baud) : fd(fd), byteTime(10.0 / baud) {
+        stopping = false;
+        overruns = 0;
+        captures = 0;
+        samples = 8192;
+        chunk = 0;
+        window = 0;
+        rxThread = std::thread(&SimBoard::receive, this);
+        mainThread = std::thread(&SimBoard::run, this);
+    }
+
+    void stop() {
+        stopping = true;
+        ready.notify_all();
+        rxThread.join();
+        mainThread.join();
+    }
+
+    std::atomic<uint32_t> overruns;
+    std::atomic<uint32_t> captures;
+
+private:
+    void receive() {
+        while(!stopping) {
+            struct pollfd p = {fd, POLLIN, 0};
+            if(poll(&p, 1, 50) <= 0)
+                continue;
+
+            uint8_t data[512];
+            ssize_t n = read(fd, data, sizeof(data));
+            std::lock_guard<std::mutex> lock(mutex);
+            for(ssize_t i = 0; i < n; i++) {
+                if(ring.size() < SIM_RING)
+                    ring.push_back(data[i]);
+                else
+                    overruns++;
+            }
+            ready.notify_all();
+        }
+    }
+
+    bool getc(uint8_t &v) {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this] { return stopping || !ring.empty(); });
+        if(ring.empty())
+            return false;
+        v = ring.front();
+        ring.pop_front();
+        return true;
+    }
+
+    //At the baud rate, a few bytes at a time
+    void put(const Bytes &out) {
+        double t0 = sumpNow();
+        for(size_t i = 0; i < out.size(); i += 32) {
+            size_t n = std::min((size_t) 32, out.size() - i);
+            if(write(fd, &out[i], n) != (ssize_t) n)
+                return;
+            double wait = t0 + (i + n) * byteTime - sumpNow();
+            if(wait > 0)
+                usleep(wait * 1e6);
+        }
+    }
+
+    static void bigEndian(Bytes &out, uint32_t v) {
+        for(int shift = 24; shift >= 0; shift -= 8)
+            out.push_back(v >> shift);
+    }
+
+    static void collect(void *context, uint8_t v) {
+        ((Bytes *) context)->push_back(v);
+    }
+
+    void capture() {
+        uint8_t seed = captures++ * 13;
+        buffer.resize(samples);
+        for(uint32_t i = 0; i < samples; i++)
+            buffer[i] = seed + 7 * i;
+
+        Bytes out;
+        for(uint32_t offset = 0; offset < samples; offset += chunk ? chunk : samples) {
+            uint32_t length = chunk ? std::min(chunk, samples - offset) : samples;
+            out.insert(out.end(), buffer.begin() + offset, buffer.begin() + offset + length);
+            if(chunk)
+                bigEndian(out, sumpCrc32(&buffer[offset], length));
+        }
+        put(out);
+    }
+
+    void readWindow(uint32_t param) {
+        uint32_t n = buffer.size();
+        uint32_t from = std::min(window & 0xFFFF, n);
+        uint32_t to = std::min(from + ((window >> 16) ? (window >> 16) : n), n);
+        uint32_t step = std::max((uint32_t) 1, param & 0xFFFF);
+        Bytes body;
+
+        if(((param >> 16) & 0xFF) == WINDOW_LZ) {
+            codec.encode(buffer.data() + from, (to - from + step - 1) / step, step, collect, &body);
+        }else if(((param >> 16) & 0xFF) == WINDOW_RLE) {
+            for(uint32_t i = from; i < to; ) {
+                uint32_t run = 1;
+                while(run < 256 && i + run * step < to && buffer[i + run * step] == buffer[i])
+                    run++;
+                body.push_back(buffer[i]);
+                body.push_back(run - 1);
+                i += run * step;
+            }
+        }else {
+            for(uint32_t i = from; i < to; i += step)
+                body.push_back(buffer[i]);
+        }
+
+        Bytes out;
+        bigEndian(out, body.size());
+        out.insert(out.end(), body.begin(), body.end());
+        put(out);
+    }
+
+    void run() {
+        uint8_t op;
+
+        while(getc(op)) {
+            uint32_t param = 0;
+            if(op & 0x80) {
+                uint8_t p[4];
+                for(int i = 0; i < 4; i++)
+                    if(!getc(p[i]))
+                        return;
+                param = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+            }
+
+            switch(op) {
+                case SUMP_RESET:
+                    chunk = 0;
+                    break;
+                case SUMP_QUERY:
+                    put(Bytes({'1', 'A', 'L', 'S'}));
+                    break;
+                case SUMP_GET_METADATA: {
+                    Bytes out({0x01, 'S', 'i', 'm', 0x00, 0x21});
+                    bigEndian(out, SIM_MAX_SAMPLES);
+                    out.push_back(0x23);
+                    bigEndian(out, 10000000);
+                    out.insert(out.end(), {0x40, 0x08, 0x41, 0x02, 0x00});
+                    put(out);
+                    break;
+                }
+                case SUMP_ARM:
+                case SUMP_TEST:
+                    capture();
+                    break;
+                case SUMP_SET_READ_DELAY_COUNT:
+                    samples = std::min((uint32_t) SIM_MAX_SAMPLES, 4 * (1 + (param & 0xFFFF)));
+                    break;
+                case SUMP_SET_UPLOAD_CHUNK:
+                    chunk = std::min((uint32_t) 4096, param & 0xFFFF) & ~3;
+                    break;
+                case SUMP_SET_READ_WINDOW:
+                    window = param;
+                    break;
+                case SUMP_READ_WINDOW:
+                    readWindow(param);
+                    break;
+            }
+        }
+    }
+
+    int fd;
+    double byteTime;
+    std::atomic<bool> stopping;
+    std::thread rxThread;
+    std::thread mainThread;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<uint8_t> ring;
+
+    uint32_t samples;
+    uint32_t chunk;
+    uint32_t window;
+    Bytes buffer;           // Newest first
+    CaptureCodec codec;
+};
+
+//Returns the capture seed, or -1 when the samples are not a ramp
+static int seedOf(const Bytes &newestFirst)
+{
+    for(size_t i = 1; i < newestFirst.size(); i++)
+        if(newestFirst[i] != (uint8_t) (newestFirst[0] + 7 * i))
+            return -1;
+    return newestFirst.empty() ? -1 : newestFirst[0];
+}
+
+/* One capture with the given configuration, checked. Returns the seed or
+   -1. Chunks are checked with their CRC. */
+static int capture(SumpClient &sump, uint32_t samples, uint16_t chunk)
+{
+    sump.setSampleNumber(samples);
+    sump.command(SUMP_SET_UPLOAD_CHUNK, chunk);
+    sump.command(SUMP_ARM);
+
+    Bytes data;
+    for(uint32_t offset = 0; offset < samples; offset += chunk ? chunk : samples) {
+        uint32_t length = chunk ? std::min((uint32_t) chunk, samples - offset) : samples;
+        Bytes part(length + (chunk ? 4 : 0));
+        if(sump.read(&part[0], part.size(), 10000) != part.size())
+            return -1;
+        if(chunk) {
+            const uint8_t *c = &part[length];
+            if(sumpCrc32(&part[0], length) != (uint32_t) ((c[0] << 24) | (c[1] << 16) | (c[2] << 8) | c[3]))
+                return -1;
+        }
+        data.insert(data.end(), part.begin(), part.begin() + length);
+    }
+    return seedOf(data);
+}
+
+static bool query(SumpClient &sump)
+{
+    uint8_t id[4];
+    sump.command(SUMP_QUERY);
+    return sump.read(id, 4, 2000) == 4 && !memcmp(id, "1ALS", 4);
+}
+
+static bool metadata(SumpClient &sump)
+{
+    uint8_t key;
+    while(sump.read(&key, 1, 2000) == 1 && key != 0x00) {
+        uint8_t v[4];
+        if(key < 0x20) {
+            while(sump.read(v, 1, 2000) == 1 && v[0] != 0);
+        }else if(sump.read(v, key < 0x40 ? 4 : 1, 2000) != (key < 0x40 ? 4u : 1u))
+            return false;
+    }
+    return key == 0x00;
+}
+
+static bool readWindow(SumpClient &sump, uint32_t samples)
+{
+    sump.command(SUMP_SET_READ_WINDOW, 0);
+    sump.command(SUMP_READ_WINDOW, 1 | (WINDOW_RLE << 16));
+
+    uint8_t h[4];
+    if(sump.read(h, 4, 5000) != 4)
+        return false;
+    Bytes rle((h[0] << 24) | (h[1] << 16) | (h[2] << 8) | h[3]);
+    if(!rle.empty() && sump.read(&rle[0], rle.size(), 5000) != rle.size())
+        return false;
+
+    Bytes data;
+    for(size_t i = 0; i + 1 < rle.size(); i += 2)
+        data.insert(data.end(), rle[i + 1] + 1, rle[i]);
+    return data.size() == samples && seedOf(data) >= 0;
+}
+
+struct Timing {
+    const char *name;
+    std::vector<double> direct;
+    std::vector<double> bridged;
+};
+
+static double median(std::vector<double> v)
+{
+    if(v.empty())
+        return 0;
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2] * 1e3;
+}
+
+static int failures;
+
+static void check(bool ok, const char *what)
+{
+    if(!ok) {
+        if(failures++ < 10)
+            printf("FAIL %s\n", what);
+    }
+}
+
+//Each timed operation once, appended to the direct or the bridged column
+static void measure(SumpClient &sump, std::vector<Timing> &t, bool bridged, uint32_t samples)
+{
+    double t0 = sumpNow();
+    check(query(sump), "ID query");
+    double t1 = sumpNow();
+    sump.command(SUMP_GET_METADATA);
+    check(metadata(sump), "metadata");
+    double t2 = sumpNow();
+    check(capture(sump, samples, 0) >= 0, "capture");
+    double t3 = sumpNow();
+    check(readWindow(sump, samples), "window readback");
+    double t4 = sumpNow();
+
+    //Five commands back to back, then their replies
+    for(int i = 0; i < 4; i++)
+        sump.command(SUMP_QUERY);
+    sump.command(SUMP_GET_METADATA);
+    for(int i = 0; i < 4; i++) {
+        uint8_t id[4];
+        check(sump.read(id, 4, 2000) == 4, "pipelined ID query");
+    }
+    check(metadata(sump), "pipelined metadata");
+    double t5 = sumpNow();
+
+    double d[] = {t1 - t0, t2 - t1, t3 - t2, t4 - t3, t5 - t4};
+    for(size_t i = 0; i < t.size(); i++)
+        (bridged ? t[i].bridged : t[i].direct).push_back(d[i]);
+}
+
+static pid_t startBridge(const char *self, const char *device, int baud, int port)
+{
+    std::string path(self);
+    size_t slash = path.rfind('/');
+    path = (slash == std::string::npos ? std::string(".") : path.substr(0, slash)) + "/sumpbridge";
+
+    std::string b = std::to_string(baud);
+    std::string p = std::to_string(port);
+
+    pid_t pid = fork();
+    if(pid == 0) {
+        execl(path.c_str(), path.c_str(), "-b", b.c_str(), "-p", p.c_str(), device, (char *) NULL);
+        perror(path.c_str());
+        _exit(1);
+    }
+    return pid;
+}
+
+static bool connect(SumpClient &sump, int port)
+{
+    std::string address = "tcp:127.0.0.1:" + std::to_string(port);
+    for(int i = 0; i < 50; i++) {
+        if(sump.open(address.c_str(), 0))
+            return true;
+        usleep(100000);
+    }
+    return false;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: bridgebench [-n runs] [-b baud] [-s samples] [-c clients] [-p port]\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int runs = 10;
+    int baud = 921600;
+    uint32_t samples = 4096;
+    int clients = 4;
+    int port = 5556;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-b") && i + 1 < argc)
+            baud = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-s") && i + 1 < argc)
+            samples = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-c") && i + 1 < argc)
+            clients = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-p") && i + 1 < argc)
+            port = atoi(argv[++i]);
+        else
+            usage();
+    }
+
+    if(runs <= 0 || baud <= 0 || samples < 4 || samples > SIM_MAX_SAMPLES || clients <= 0)
+        usage();
+
+    int master, slave;
+    char name[64];
+    if(openpty(&master, &slave, name, NULL, NULL) != 0) {
+        perror("openpty");
+        return 1;
+    }
+
+    struct termios tio;
+    tcgetattr(master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(master, TCSANOW, &tio);
+
+    SimBoard board(master, baud);
+    samples &= ~3;
+
+    std::vector<Timing> t(5);
+    t[0].name = "ID query";
+    t[1].name = "metadata";
+    t[2].name = "capture";
+    t[3].name = "window readback";
+    t[4].name = "5 pipelined commands";
+
+    SumpClient direct;
+    if(!direct.open(name, baud)) {
+        perror(name);
+        return 1;
+    }
+    direct.reset();
+    for(int r = 0; r < runs; r++)
+        measure(direct, t, false, samples);
+    direct.close();
+
+    pid_t bridge = startBridge(argv[0], name, baud, port);
+    SumpClient bridged;
+    if(!connect(bridged, port)) {
+        fprintf(stderr, "no bridge on port %d\n", port);
+        kill(bridge, SIGTERM);
+        return 1;
+    }
+    for(int r = 0; r < runs; r++)
+        measure(bridged, t, true, samples);
+
+    printf("%u samples at %d baud, median of %d runs\n", samples, baud, runs);
+    printf("operation              direct ms   bridged ms\n");
+    for(size_t i = 0; i < t.size(); i++)
+        printf("%-22s %10.2f %12.2f\n", t[i].name, median(t[i].direct), median(t[i].bridged));
+
+    //Different configurations at once, each reply must fit its own
+    uint32_t before = board.captures;
+    double t0 = sumpNow();
+    std::vector<std::thread> threads;
+    std::atomic<int> bad(0);
+    for(int c = 0; c < clients; c++) {
+        threads.push_back(std::thread([&, c] {
+            SumpClient s;
+            if(!connect(s, port)) {
+                bad++;
+                return;
+            }
+            for(int r = 0; r < runs; r++) {
+                uint32_t n = std::min((uint32_t) SIM_MAX_SAMPLES, samples / (c + 1) & ~3);
+                if(capture(s, n, c % 2 ? 512 : 0) < 0 || !readWindow(s, n))
+                    bad++;
+            }
+        }));
+    }
+    for(size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    threads.clear();
+    check(bad == 0, "concurrent clients");
+    printf("%d clients, different configurations: %d captures in %.0f ms, %u on the board, %d bad\n",
+           clients, clients * runs, (sumpNow() - t0) * 1e3, board.captures - before, (int) bad);
+
+    //Same configuration at once: captures are shared
+    before = board.captures;
+    t0 = sumpNow();
+    std::vector<std::set<int> > seeds(runs);
+    std::mutex seedsMutex;
+    for(int c = 0; c < clients; c++) {
+        threads.push_back(std::thread([&] {
+            SumpClient s;
+            if(!connect(s, port)) {
+                bad++;
+                return;
+            }
+            for(int r = 0; r < runs; r++) {
+                int seed = capture(s, samples, 0);
+                if(seed < 0)
+                    bad++;
+                std::lock_guard<std::mutex> lock(seedsMutex);
+                seeds[r].insert(seed);
+            }
+        }));
+    }
+    for(size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    check(bad == 0, "shared captures");
+    printf("%d clients, same configuration: %d captures in %.0f ms, %u on the board, %d bad\n",
+           clients, clients * runs, (sumpNow() - t0) * 1e3, board.captures - before, (int) bad);
+
+    bridged.close();
+    kill(bridge, SIGTERM);
+    waitpid(bridge, NULL, 0);
+    board.stop();
+
+    check(board.overruns == 0, "command ring overrun");
+    printf("command ring overruns: %u\n", (uint32_t) board.overruns);
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 2 : 0;
+}
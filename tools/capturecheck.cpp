@@ -0,0 +1,260 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+/*
+ Captures once and reads the capture back as RLE and delta + LZ
+ windows, checks that both decode to the capture, and compares the
+ three against a golden file (-g) or writes one (-o). Meant for the
+ host build replaying a VCD, where the same input gives the same bytes
+ on every run:
+
+   host/nucleosim -i bug.vcd -r 4000000 -l /tmp/ttySIM &
+   capturecheck -r 4000000 -n 4096 -t 0x01:0x01 -g bug.golden /tmp/ttySIM
+
+   capturecheck [-b baud] [-r rate] [-n samples] [-t mask:value]
+                [-x opcode:parameter]... [-o out | -g golden] device
+
+ -t sets a parallel trigger on stage 0. -x sends any other long
+ command before the capture, for example a protocol trigger (0xA0).
+ The golden file holds tagged sections: a 4 byte tag, a little endian
+ uint32 length and the bytes.
+*/
+
+#include "../src/CaptureCodec.h"
+#include "SumpClient.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#define SUMP_SET_TRIGGER_MASK 0xC0
+#define SUMP_SET_TRIGGER_VALUES 0xC1
+#define SUMP_SET_TRIGGER_CONF 0xC2
+#define SUMP_TRIGGER_START 0x08000000
+#define SUMP_SET_READ_WINDOW 0xA8
+#define SUMP_READ_WINDOW 0xA9
+
+#define WINDOW_RLE 1
+#define WINDOW_LZ 2
+
+#define CHECK_TIMEOUT 30000
+
+typedef std::vector<uint8_t> Bytes;
+
+struct Section {
+    char tag[5];
+    Bytes data;
+};
+
+static bool readWindow(SumpClient &sump, uint8_t mode, Bytes &out)
+{
+    uint8_t size[4];
+
+    if(!sump.command(SUMP_READ_WINDOW, mode << 16) || sump.read(size, 4, CHECK_TIMEOUT) != 4)
+        return false;
+
+    out.resize((size[0] << 24) | (size[1] << 16) | (size[2] << 8) | size[3]);
+    return out.empty() || sump.read(&out[0], out.size(), CHECK_TIMEOUT) == out.size();
+}
+
+//(value, run length - 1) pairs
+static Bytes expandRle(const Bytes &in)
+{
+    Bytes out;
+    for(size_t i = 0; i + 1 < in.size(); i += 2)
+        out.insert(out.end(), in[i + 1] + 1, in[i]);
+    return out;
+}
+
+static bool save(const char *path, const std::vector<Section> &sections)
+{
+    FILE *f = fopen(path, "wb");
+    if(f == NULL)
+        return false;
+
+    for(size_t i = 0; i < sections.size(); i++) {
+        uint32_t n = sections[i].data.size();
+        uint8_t length[4] = {(uint8_t) n, (uint8_t) (n >> 8), (uint8_t) (n >> 16), (uint8_t) (n >> 24)};
+        fwrite(sections[i].tag, 1, 4, f);
+        fwrite(length, 1, 4, f);
+        fwrite(sections[i].data.data(), 1, n, f);
+    }
+    return fclose(f) == 0;
+}
+
+static bool load(const char *path, std::vector<Section> &sections)
+{
+    FILE *f = fopen(path, "rb");
+    if(f == NULL)
+        return false;
+
+    Section s;
+    uint8_t length[4];
+    s.tag[4] = 0;
+    while(fread(s.tag, 1, 4, f) == 4 && fread(length, 1, 4, f) == 4) {
+        s.data.resize(length[0] | (length[1] << 8) | (length[2] << 16) | ((uint32_t) length[3] << 24));
+        if(fread(s.data.data(), 1, s.data.size(), f) != s.data.size())
+            break;
+        sections.push_back(s);
+    }
+    fclose(f);
+    return true;
+}
+
+static int compare(const std::vector<Section> &actual, const std::vector<Section> &golden)
+{
+    int failed = 0;
+
+    for(size_t i = 0; i < actual.size(); i++) {
+        const Section *g = NULL;
+        for(size_t j = 0; j < golden.size(); j++)
+            if(!memcmp(golden[j].tag, actual[i].tag, 4))
+                g = &golden[j];
+
+        const Bytes &a = actual[i].data;
+        if(g == NULL) {
+            printf("%-4s missing from the golden file\n", actual[i].tag);
+            failed++;
+        } else if(a != g->data) {
+            size_t n = std::min(a.size(), g->data.size());
+            size_t at = std::mismatch(a.begin(), a.begin() + n, g->data.begin()).first - a.begin();
+            printf("%-4s differs at byte %zu (%zu bytes, golden %zu)\n", actual[i].tag, at, a.size(), g->data.size());
+            failed++;
+        } else {
+            printf("%-4s %6zu bytes match\n", actual[i].tag, a.size());
+        }
+    }
+    return failed;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: capturecheck [-b baud] [-r rate] [-n samples] [-t mask:value] [-x opcode:parameter]...\n"
+                    "                    [-o out | -g golden] device\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int baud = 115200;
+    uint32_t rate = 1000000;
+    uint32_t samples = 32768;
+    const char *device = NULL;
+    const char *output = NULL;
+    const char *golden = NULL;
+    bool trigger = false;
+    uint32_t mask = 0;
+    uint32_t value = 0;
+    std::vector<std::pair<uint8_t, uint32_t> > extra;
+
+    for(int i = 1; i < argc; i++) {
+        char *end;
+        if(!strcmp(argv[i], "-b") && i + 1 < argc)
+            baud = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-r") && i + 1 < argc)
+            rate = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            samples = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-t") && i + 1 < argc) {
+            mask = strtoul(argv[++i], &end, 0);
+            if(*end != ':')
+                usage();
+            value = strtoul(end + 1, NULL, 0);
+            trigger = true;
+        } else if(!strcmp(argv[i], "-x") && i + 1 < argc) {
+            uint8_t op = strtoul(argv[++i], &end, 16);
+            if(*end != ':' || !(op & 0x80))
+                usage();
+            extra.push_back(std::make_pair(op, (uint32_t) strtoul(end + 1, NULL, 0)));
+        } else if(!strcmp(argv[i], "-o") && i + 1 < argc)
+            output = argv[++i];
+        else if(!strcmp(argv[i], "-g") && i + 1 < argc)
+            golden = argv[++i];
+        else if(argv[i][0] == '-')
+            usage();
+        else
+            device = argv[i];
+    }
+
+    if(device == NULL || rate == 0 || samples < 4 || (output && golden))
+        usage();
+
+    SumpClient sump;
+    if(!sump.open(device, baud)) {
+        perror(device);
+        return 1;
+    }
+
+    sump.reset();
+    sump.setRate(rate);
+    sump.setSampleNumber(samples);
+    if(trigger) {
+        sump.command(SUMP_SET_TRIGGER_MASK, mask);
+        sump.command(SUMP_SET_TRIGGER_VALUES, value);
+        sump.command(SUMP_SET_TRIGGER_CONF, SUMP_TRIGGER_START);
+    }
+    for(size_t i = 0; i < extra.size(); i++)
+        sump.command(extra[i].first, extra[i].second);
+
+    std::vector<Section> sections(3);
+    strcpy(sections[0].tag, "CAPT");
+    strcpy(sections[1].tag, "RLE ");
+    strcpy(sections[2].tag, "LZ  ");
+
+    if(!sump.capture(SUMP_ARM, samples, sections[0].data, CHECK_TIMEOUT)) {
+        fprintf(stderr, "Timeout waiting for %u samples\n", samples);
+        return 1;
+    }
+
+    sump.command(SUMP_SET_READ_WINDOW, 0);
+    if(!readWindow(sump, WINDOW_RLE, sections[1].data) || !readWindow(sump, WINDOW_LZ, sections[2].data)) {
+        fprintf(stderr, "Timeout waiting for the window readback\n");
+        return 1;
+    }
+
+    //Windows come in the upload order, newest sample first
+    Bytes uploaded(sections[0].data.rbegin(), sections[0].data.rend());
+    Bytes lz(samples);
+    uint32_t decoded = CaptureCodec::decode(sections[2].data.data(), sections[2].data.size(), lz.data(), lz.size());
+
+    int failed = 0;
+    if(expandRle(sections[1].data) != uploaded) {
+        printf("RLE window does not decode to the capture\n");
+        failed++;
+    }
+    if(decoded != samples || lz != uploaded) {
+        printf("delta + LZ window does not decode to the capture\n");
+        failed++;
+    }
+
+    if(output && !save(output, sections)) {
+        perror(output);
+        return 1;
+    }
+
+    if(golden) {
+        std::vector<Section> expected;
+        if(!load(golden, expected)) {
+            perror(golden);
+            return 1;
+        }
+        failed += compare(sections, expected);
+    }
+
+    printf("%u samples, RLE %zu bytes, delta + LZ %zu bytes, %s\n", samples, sections[1].data.size(),
+           sections[2].data.size(), failed ? "FAILED" : "ok");
+    return failed ? 2 : 0;
+}
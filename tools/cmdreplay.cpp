@@ -0,0 +1,350 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+/*
+ Replays client command streams through the firmware command reader
+ (src/CommandReader.cpp, built for the host), in the time of the board.
+ The client sends at the line rate, with random pauses between commands.
+ The RX DMA puts every byte into the ring as it arrives, and the main
+ loop wakes when the line goes idle or half the ring is filled, then
+ takes the commands, staying busy for as long as each one runs on the
+ board: captures, uploads and replies at the line rate. Every run must
+ give the same commands as a plain sequential parse of the stream,
+ without a single byte lost to a full ring.
+
+   cmdreplay [-n runs] [-v] [stream files...]
+
+ Stream files are raw bytes as sent by a client, for example recorded
+ with `socat -x` or `interceptty`. Without files, built-in streams of
+ the PulseView (sigrok ols driver) and sumptest sessions are used.
+*/
+
+#include "../src/CommandReader.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#define SUMP_SET_PATTERN 0xA1
+
+#define LINE_BAUD 115200
+#define BYTE_TIME (10 * 1e6 / LINE_BAUD)    // us per byte on the wire, both ways
+#define COMMAND_TIME 5                      // us to decode and run a configuration command
+#define METADATA_LENGTH 50
+#define COUNTER_REPLY_LENGTH 33
+#define BUFFER_SIZE 32768
+
+typedef std::vector<uint8_t> Bytes;
+
+static void append(Bytes &s, uint8_t op, uint32_t parameter)
+{
+    s.push_back(op);
+    for(int i = 0; i < 4; i++)
+        s.push_back(parameter >> (8 * i));
+}
+
+//Reset, identify, metadata, 4 trigger stages, divider, counts, flags, arm
+static Bytes pulseview()
+{
+    Bytes s(5, 0x00);
+    s.push_back(0x02);
+    s.push_back(0x04);
+
+    for(uint8_t stage = 0; stage < 4; stage++) {
+        append(s, 0xC0 + stage * 4, stage ? 0 : 0x01);
+        append(s, 0xC1 + stage * 4, stage ? 0 : 0x01);
+        append(s, 0xC2 + stage * 4, stage ? 0 : 0x08000000);
+    }
+    append(s, 0x80, 99);
+    append(s, 0x81, 0x07FF07FF);
+    append(s, 0x82, 0x02);
+    s.push_back(0x01);
+    return s;
+}
+
+//Pattern upload with its payload, test capture, frequency counter
+static Bytes sumptest()
+{
+    Bytes s(5, 0x00);
+    append(s, SUMP_SET_PATTERN, 300 | (1 << 16));
+    for(int i = 0; i < 300; i++)
+        s.push_back(i * 7);
+    append(s, 0xA2, 9);
+    s.push_back(0x06);
+    append(s, 0x80, 99);
+    append(s, 0x81, 0x1FFF1FFF);
+    s.push_back(0x03);
+    append(s, 0xA3, 100);
+    s.push_back(0x0B);
+    s.push_back(0x07);
+    return s;
+}
+
+//The pattern payload is read raw after its command, as the generator does
+static uint32_t payload(const uint8_t *command)
+{
+    return command[0] == SUMP_SET_PATTERN ? command[1] | (command[2] << 8) : 0;
+}
+
+static std::vector<Bytes> reference(const Bytes &s)
+{
+    std::vector<Bytes> out;
+    size_t i = 0;
+
+    while(i < s.size()) {
+        uint8_t len = CommandReader::length(s[i]);
+        if(i + len > s.size())
+            break;
+
+        Bytes command(COMMAND_LONG_LENGTH, 0);
+        std::copy(s.begin() + i, s.begin() + i + len, command.begin());
+        i += len;
+
+        uint32_t extra = payload(&command[0]);
+        command.insert(command.end(), s.begin() + i, s.begin() + std::min(s.size(), i + extra));
+        i += extra;
+        out.push_back(command);
+    }
+    return out;
+}
+
+//What the board was configured with, the time of the long commands depends on it
+struct Board{
+    uint32_t divider;
+    uint32_t count;
+    uint32_t gate;
+};
+
+/* Main loop time of a command on the board, in us. Captures are taken
+   as triggered at once and upload one byte per sample (8 probes). */
+static double busy(const Bytes &command, Board &board)
+{
+    uint32_t parameter = command[1] | (command[2] << 8) | (command[3] << 16) | ((uint32_t) command[4] << 24);
+
+    switch(command[0]) {
+        case 0x80: board.divider = parameter & 0xFFFFFF; break;
+        case 0x81: board.count = parameter; break;
+        case 0xA3: board.gate = parameter; break;
+        case 0x02: return COMMAND_TIME + 4 * BYTE_TIME;
+        case 0x04: return COMMAND_TIME + METADATA_LENGTH * BYTE_TIME;
+        case 0x0B: return board.gate * 1000.0 + COUNTER_REPLY_LENGTH * BYTE_TIME;
+        case 0x01:
+        case 0x03: {
+            double samples = std::min(((board.count & 0xFFFF) + 1) * 4, (uint32_t) BUFFER_SIZE);
+            return samples * (board.divider + 1) / 100 + samples * BYTE_TIME;
+        }
+    }
+    return COMMAND_TIME;
+}
+
+/* Arrival time of every byte, in us. Up to maxPause between commands,
+   from a client that does not wait for the replies. */
+static std::vector<double> arrivals(const Bytes &s, const std::vector<Bytes> &commands, uint32_t maxPause)
+{
+    std::vector<double> t;
+    double now = 0;
+
+    for(size_t c = 0; c < commands.size(); c++) {
+        if(maxPause && rand() % 4 == 0)
+            now += rand() % maxPause;
+
+        size_t length = CommandReader::length(commands[c][0]) + commands[c].size() - COMMAND_LONG_LENGTH;
+        for(size_t i = 0; i < length; i++) {
+            now += BYTE_TIME;
+            t.push_back(now);
+        }
+    }
+
+    //A truncated command at the end
+    while(t.size() < s.size()) {
+        now += BYTE_TIME;
+        t.push_back(now);
+    }
+    return t;
+}
+
+/* The DMA wakes the main loop at the ring halves, the IDLE interrupt one
+   byte time after the last byte of a burst. */
+static double wakeup(const std::vector<double> &t, size_t fed)
+{
+    for(size_t i = fed; i < t.size(); i++) {
+        if((i + 1) % (COMMAND_RX_SIZE / 2) == 0)
+            return t[i];
+        if(i + 1 == t.size() || t[i + 1] - t[i] > BYTE_TIME * 1.5)
+            return t[i] + BYTE_TIME;
+    }
+    return t.back();
+}
+
+/* One run, with up to maxPause us between commands. Returns the
+   commands taken, the largest backlog seen and the bytes lost. */
+static std::vector<Bytes> replay(const Bytes &s, const std::vector<Bytes> &expected, uint32_t maxPause,
+                                 uint32_t &backlog, uint32_t &lost)
+{
+    std::vector<Bytes> out;
+    std::vector<double> t = arrivals(s, expected, maxPause);
+    CommandReader reader;
+    Board board = {0, 0, 0};
+    size_t fed = 0;
+    size_t taken = 0;
+    uint32_t pendingPayload = 0;
+    uint8_t command[COMMAND_LONG_LENGTH];
+    double now = 0;
+
+    backlog = 0;
+
+    while(true) {
+        //What the DMA wrote while the main loop was busy or asleep
+        for(; fed < s.size() && t[fed] <= now; fed++)
+            reader.push(s[fed]);
+        backlog = std::max(backlog, (uint32_t) (fed - taken));
+
+        //Payload bytes are waited for one at a time, as the generator does
+        if(pendingPayload > 0) {
+            uint8_t v;
+            if(reader.read(v)) {
+                out.back().push_back(v);
+                pendingPayload--;
+                taken++;
+            } else if(fed < s.size())
+                now = t[fed];
+            else
+                break;
+            continue;
+        }
+
+        if(reader.next(command)) {
+            out.push_back(Bytes(command, command + COMMAND_LONG_LENGTH));
+            taken += CommandReader::length(command[0]);
+            pendingPayload = payload(command);
+            now += busy(out.back(), board);
+            continue;
+        }
+
+        if(fed == s.size())
+            break;
+        now = std::max(now, wakeup(t, fed));
+    }
+
+    lost = reader.getOverruns();
+    return out;
+}
+
+static const char *name(uint8_t op)
+{
+    switch(op) {
+        case 0x00: return "reset";
+        case 0x01: return "arm";
+        case 0x02: return "query id";
+        case 0x03: return "test";
+        case 0x04: return "metadata";
+        case 0x80: return "divider";
+        case 0x81: return "read/delay count";
+        case 0x82: return "flags";
+        case SUMP_SET_PATTERN: return "pattern upload";
+    }
+    if((op & 0xF0) == 0xC0)
+        return (op & 3) == 0 ? "trigger mask" : (op & 3) == 1 ? "trigger values" : "trigger configuration";
+    return op & 0x80 ? "long vendor command" : "vendor command";
+}
+
+static int check(const char *label, const Bytes &s, int runs, bool verbose)
+{
+    std::vector<Bytes> expected = reference(s);
+    int failed = 0;
+    uint32_t largest = 0;
+
+    if(verbose) {
+        for(size_t i = 0; i < expected.size(); i++) {
+            const Bytes &c = expected[i];
+            printf("  %02X %-22s", c[0], name(c[0]));
+            if(c[0] & 0x80)
+                printf(" %02X %02X %02X %02X", c[1], c[2], c[3], c[4]);
+            if(c.size() > COMMAND_LONG_LENGTH)
+                printf(" + %zu bytes", c.size() - COMMAND_LONG_LENGTH);
+            printf("\n");
+        }
+    }
+
+    for(int r = 0; r < runs; r++) {
+        uint32_t maxPause = (r % 8) * 500;
+        uint32_t backlog, lost;
+        std::vector<Bytes> actual = replay(s, expected, maxPause, backlog, lost);
+        largest = std::max(largest, backlog);
+
+        //Any byte lost or command misframed is a failure, the ring must hold the client
+        if(lost || actual != expected) {
+            if(failed++ == 0)
+                printf("FAIL %s: run %d (pauses up to %uus) lost %u bytes, gave %zu commands, expected %zu\n",
+                       label, r, maxPause, lost, actual.size(), expected.size());
+        }
+    }
+
+    printf("%-12s %5zu bytes %4zu commands  %d runs  backlog %u/%u  %s\n", label, s.size(),
+           expected.size(), runs, largest, COMMAND_RX_SIZE, failed ? "FAILED" : "ok");
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    int runs = 2000;
+    bool verbose = false;
+    std::vector<const char *> files;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-v"))
+            verbose = true;
+        else if(argv[i][0] == '-') {
+            fprintf(stderr, "usage: cmdreplay [-n runs] [-v] [stream files...]\n");
+            return 1;
+        } else
+            files.push_back(argv[i]);
+    }
+
+    int failed = 0;
+
+    if(files.empty()) {
+        failed += check("pulseview", pulseview(), runs, verbose);
+        failed += check("sumptest", sumptest(), runs, verbose);
+
+        //Back to back sessions, as a client retrying after a timeout would send
+        Bytes burst;
+        for(int i = 0; i < 8; i++) {
+            Bytes p = pulseview();
+            burst.insert(burst.end(), p.begin(), p.end());
+        }
+        failed += check("pulseview x8", burst, runs, verbose);
+    }
+
+    for(size_t f = 0; f < files.size(); f++) {
+        FILE *in = fopen(files[f], "rb");
+        if(in == NULL) {
+            perror(files[f]);
+            return 1;
+        }
+
+        Bytes s;
+        int c;
+        while((c = fgetc(in)) != EOF)
+            s.push_back(c);
+        fclose(in);
+
+        failed += check(files[f], s, runs, verbose);
+    }
+
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,228 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+/*
+ Compares the upload encodings of the window readback on a corpus of
+ captures: raw, RLE (value, run - 1 pairs) and the delta + LZ codec of
+ the firmware (src/CaptureCodec.cpp, built for the host). Every capture
+ is decoded again and checked, and the host encode and decode speeds
+ are reported.
+
+   codecbench [-n runs] [-d device [-b baud] [-r rate] [-s samples]] [capture files...]
+
+ Capture files are raw samples, one byte each. Without files, synthetic
+ 32768 sample captures of an idle bus, UART, SPI, I2C, a counter and
+ noise are used. With a device, it also runs a test capture, reads it
+ back raw and delta + LZ coded, checks that both match, and reports the
+ encoder cycles per sample measured on the target (diagnostics 0x26).
+*/
+
+#include "../src/CaptureCodec.h"
+#include "SumpClient.h"
+#include "CaptureCorpus.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define SUMP_RUN_TEST 0x03
+#define SUMP_GET_DIAGNOSTICS 0x09
+#define SUMP_SET_READ_WINDOW 0xA8
+#define SUMP_READ_WINDOW 0xA9
+
+#define WINDOW_RAW 0
+#define WINDOW_LZ 2
+
+#define DIAG_KERNEL 0x40
+#define DIAG_CODEC_SAMPLES 0x24
+#define DIAG_CODEC_BYTES 0x25
+#define DIAG_CODEC_CYCLES 0x26
+
+static void collect(void *context, uint8_t v)
+{
+    ((Bytes *) context)->push_back(v);
+}
+
+static CaptureCodec codec;
+
+static bool measure(const Capture &c, int runs)
+{
+    const Bytes &s = c.samples;
+    Bytes r, rd, lz;
+    Bytes ld(s.size());
+
+    double t0 = sumpNow();
+    for(int i = 0; i < runs; i++)
+        rleEncode(s, r);
+    double t1 = sumpNow();
+    for(int i = 0; i < runs; i++)
+        rleDecode(r, rd);
+    double t2 = sumpNow();
+    uint32_t size = 0;
+    for(int i = 0; i < runs; i++) {
+        lz.clear();
+        size = codec.encode(s.data(), s.size(), 1, collect, &lz);
+    }
+    double t3 = sumpNow();
+    uint32_t decoded = 0;
+    for(int i = 0; i < runs; i++)
+        decoded = CaptureCodec::decode(lz.data(), lz.size(), ld.data(), ld.size());
+    double t4 = sumpNow();
+
+    bool ok = rd == s && size == lz.size() && decoded == s.size() && ld == s;
+    double mb = (double) s.size() * runs / 1e6;
+
+    printf("%-16s %7zu %7zu %6.2f %7zu %6.2f %8.0f %8.0f %8.0f %8.0f  %s\n", c.name.c_str(), s.size(),
+           r.size(), (double) s.size() / r.size(), lz.size(), (double) s.size() / lz.size(),
+           mb / (t1 - t0), mb / (t2 - t1), mb / (t3 - t2), mb / (t4 - t3), ok ? "ok" : "FAILED");
+    return ok;
+}
+
+static bool readWindow(SumpClient &sump, uint8_t mode, Bytes &out, double &seconds)
+{
+    uint8_t header[4];
+
+    double t0 = sumpNow();
+    sump.command(SUMP_SET_READ_WINDOW, 0);
+    sump.command(SUMP_READ_WINDOW, 1 | (mode << 16));
+    if(sump.read(header, sizeof(header), 2000) != sizeof(header))
+        return false;
+
+    out.resize((header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3]);
+    if(!out.empty() && sump.read(&out[0], out.size(), 10000) != out.size())
+        return false;
+    seconds = sumpNow() - t0;
+    return true;
+}
+
+//Returns the value of a diagnostics key, skipping the kernel groups
+static bool diagnostic(SumpClient &sump, uint8_t wanted, uint32_t &value)
+{
+    bool found = false;
+    uint8_t key;
+
+    sump.command(SUMP_GET_DIAGNOSTICS);
+    while(sump.read(&key, 1, 1000) == 1 && key != 0x00) {
+        uint8_t v[4];
+        if(sump.read(v, key == DIAG_KERNEL ? 1 : 4, 1000) != (key == DIAG_KERNEL ? 1u : 4u))
+            return false;
+        if(key == wanted) {
+            value = (v[0] << 24) | (v[1] << 16) | (v[2] << 8) | v[3];
+            found = true;
+        }
+    }
+    return found;
+}
+
+static int device(const char *path, int baud, uint32_t rate, uint32_t samples)
+{
+    SumpClient sump;
+    if(!sump.open(path, baud)) {
+        perror(path);
+        return 1;
+    }
+
+    sump.reset();
+    sump.setRate(rate);
+    sump.setSampleNumber(samples);
+
+    Bytes captured, raw, lz;
+    double rawTime, lzTime;
+    if(!sump.capture(SUMP_RUN_TEST, samples, captured, 10000) ||
+       !readWindow(sump, WINDOW_RAW, raw, rawTime) || !readWindow(sump, WINDOW_LZ, lz, lzTime)) {
+        fprintf(stderr, "%s: no reply\n", path);
+        return 1;
+    }
+
+    Bytes decoded(raw.size());
+    decoded.resize(CaptureCodec::decode(lz.data(), lz.size(), decoded.data(), decoded.size()));
+
+    printf("device: %u samples, raw %zu bytes in %.0f ms, delta + LZ %zu bytes in %.0f ms (%.2fx)\n",
+           samples, raw.size(), rawTime * 1e3, lz.size(), lzTime * 1e3, (double) raw.size() / lz.size());
+
+    uint32_t cycles;
+    if(diagnostic(sump, DIAG_CODEC_CYCLES, cycles))
+        printf("device: encoder %u cycles, %.1f cycles per sample\n", cycles, (double) cycles / samples);
+
+    if(decoded != raw) {
+        printf("FAILED: the delta + LZ readback does not match the raw one\n");
+        return 2;
+    }
+    return 0;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: codecbench [-n runs] [-d device [-b baud] [-r rate] [-s samples]] [capture files...]\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int runs = 20;
+    const char *path = NULL;
+    int baud = 115200;
+    uint32_t rate = 1000000;
+    uint32_t samples = 8192;
+    std::vector<Capture> captures;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-d") && i + 1 < argc)
+            path = argv[++i];
+        else if(!strcmp(argv[i], "-b") && i + 1 < argc)
+            baud = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-r") && i + 1 < argc)
+            rate = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-s") && i + 1 < argc)
+            samples = atoi(argv[++i]);
+        else if(argv[i][0] == '-')
+            usage();
+        else {
+            FILE *in = fopen(argv[i], "rb");
+            if(in == NULL) {
+                perror(argv[i]);
+                return 1;
+            }
+
+            Capture c;
+            c.name = argv[i];
+            int v;
+            while((v = fgetc(in)) != EOF)
+                c.samples.push_back(v);
+            fclose(in);
+            captures.push_back(c);
+        }
+    }
+
+    if(runs <= 0 || rate == 0 || samples == 0)
+        usage();
+
+    if(captures.empty())
+        captureCorpus(captures);
+
+    printf("                                 RLE            delta + LZ     RLE MB/s          LZ MB/s\n");
+    printf("capture          samples   bytes  ratio   bytes  ratio   encode   decode   encode   decode\n");
+
+    int failed = 0;
+    for(size_t i = 0; i < captures.size(); i++)
+        failed += !measure(captures[i], runs);
+
+    if(path)
+        failed += device(path, baud, rate, samples) != 0;
+
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,225 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+/*
+ Conformance and fuzz checks of the firmware command decoder
+ (src/CommandDecoder.cpp, built for the host), with a table of the SUMP
+ commands whose handlers record what they were called with:
+
+ - command lengths of every opcode, known or not
+ - little endian parameters at every buffer alignment
+ - batches decoded in one call and in random chunks give the same calls
+ - random buffers never make it read past the end or stop early
+
+ Buffers are allocated with their exact size, so building with
+ -fsanitize=address also catches reads past the end.
+
+   decodecheck [-n fuzz runs]
+*/
+
+#include "../src/CommandDecoder.h"
+#include "SumpClient.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+struct Call {
+    uint8_t opcode;
+    uint32_t parameter;
+
+    bool operator==(const Call &o) const { return opcode == o.opcode && parameter == o.parameter; }
+};
+
+static std::vector<Call> calls;
+
+template<uint8_t OPCODE> static void shortCommand(const uint8_t *)
+{
+    Call c = {OPCODE, 0};
+    calls.push_back(c);
+}
+
+template<uint8_t OPCODE> static void longCommand(const uint8_t *parameters)
+{
+    Call c = {OPCODE, loadUInt32(parameters)};
+    calls.push_back(c);
+}
+
+static const CommandEntry table[] = {
+    {0x00, 1, shortCommand<0x00>, 0},
+    {0x01, 1, shortCommand<0x01>, 0},
+    {0x02, 1, shortCommand<0x02>, 0},
+    {0x04, 1, shortCommand<0x04>, 0},
+    {0x11, 1, shortCommand<0x11>, 0},
+    {0x13, 1, shortCommand<0x13>, 0},
+    {0x80, 5, longCommand<0x80>, 0},
+    {0x81, 5, longCommand<0x81>, 0},
+    {0x82, 5, longCommand<0x82>, 0},
+    {0xC0, 5, longCommand<0xC0>, 0},
+    {0xC1, 5, longCommand<0xC1>, 0},
+    {0xC2, 5, longCommand<0xC2>, 0},
+    {0xA0, 5, longCommand<0xA0>, 0},
+};
+
+#define TABLE_SIZE (sizeof(table) / sizeof(table[0]))
+
+static int failed = 0;
+
+static void expect(bool ok, const char *what)
+{
+    if(!ok && failed++ < 10)
+        printf("FAIL %s\n", what);
+}
+
+//Reference: a plain sequential walk with the SUMP length rule
+static void reference(const std::vector<uint8_t> &s, CommandDecoder &decoder, std::vector<Call> &out, uint32_t &used)
+{
+    out.clear();
+    used = 0;
+    while(used < s.size()) {
+        uint8_t len = (s[used] & 0x80) ? 5 : 1;
+        if(used + len > s.size())
+            break;
+
+        if(decoder.find(s[used])) {
+            Call c = {s[used], len == 5 ? (uint32_t) (s[used + 1] | s[used + 2] << 8 | s[used + 3] << 16 | (uint32_t) s[used + 4] << 24) : 0};
+            out.push_back(c);
+        }
+        used += len;
+    }
+}
+
+//Exact size copy, so that reading past the end is an error under ASan
+static uint32_t decodeExact(CommandDecoder &decoder, const uint8_t *data, uint32_t count)
+{
+    uint8_t *copy = (uint8_t *) malloc(count ? count : 1);
+    if(count)
+        memcpy(copy, data, count);
+    uint32_t used = decoder.decode(copy, count);
+    free(copy);
+    return used;
+}
+
+//Random chunks with the undecoded remainder carried over, as a receive buffer
+static void decodeChunks(CommandDecoder &decoder, const std::vector<uint8_t> &s)
+{
+    std::vector<uint8_t> pending;
+    size_t i = 0;
+
+    while(i < s.size()) {
+        size_t n = std::min(s.size() - i, (size_t) (1 + rand() % 16));
+        pending.insert(pending.end(), s.begin() + i, s.begin() + i + n);
+        i += n;
+
+        uint32_t used = decodeExact(decoder, &pending[0], pending.size());
+        pending.erase(pending.begin(), pending.begin() + used);
+    }
+}
+
+static std::vector<uint8_t> randomCommands(uint32_t commands)
+{
+    std::vector<uint8_t> s;
+    for(uint32_t c = 0; c < commands; c++) {
+        uint8_t op = rand() % 4 ? table[rand() % TABLE_SIZE].opcode : rand();
+        s.push_back(op);
+        if(op & 0x80)
+            for(int b = 0; b < 4; b++)
+                s.push_back(rand());
+    }
+    return s;
+}
+
+int main(int argc, char **argv)
+{
+    int runs = 100000;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: decodecheck [-n fuzz runs]\n");
+            return 1;
+        }
+    }
+
+    CommandDecoder decoder(table, TABLE_SIZE);
+
+    //Lengths: the table for known opcodes, bit 7 for the others
+    for(uint32_t op = 0; op < 256; op++) {
+        const CommandEntry *e = decoder.find(op);
+        expect(decoder.length(op) == ((op & 0x80) ? 5 : 1), "length of an opcode");
+        expect(e == NULL || e->opcode == op, "table lookup");
+    }
+
+    //Parameters at every alignment
+    for(uint32_t offset = 0; offset < 8; offset++) {
+        uint8_t buffer[16] = {0};
+        const uint8_t command[5] = {0x80, 0x78, 0x56, 0x34, 0xF2};
+        memcpy(buffer + offset, command, sizeof(command));
+
+        calls.clear();
+        uint32_t used = decodeExact(decoder, buffer + offset, sizeof(command));
+        expect(used == 5 && calls.size() == 1 && calls[0].parameter == 0xF2345678, "unaligned parameter");
+    }
+
+    //Partial long command waits for the rest
+    const uint8_t partial[] = {0x02, 0x80, 0x01, 0x02};
+    calls.clear();
+    expect(decodeExact(decoder, partial, sizeof(partial)) == 1 && calls.size() == 1, "partial command");
+
+    //Batches, whole and in chunks
+    std::vector<Call> expected;
+    uint32_t expectedUsed;
+    for(int r = 0; r < 1000; r++) {
+        std::vector<uint8_t> s = randomCommands(1 + rand() % 64);
+        reference(s, decoder, expected, expectedUsed);
+
+        calls.clear();
+        uint32_t used = decodeExact(decoder, &s[0], s.size());
+        expect(used == s.size() && calls == expected, "batch in one call");
+
+        calls.clear();
+        decodeChunks(decoder, s);
+        expect(calls == expected, "batch in chunks");
+    }
+
+    //Fuzz: random bytes and lengths
+    for(int r = 0; r < runs; r++) {
+        std::vector<uint8_t> s(rand() % 40);
+        for(size_t i = 0; i < s.size(); i++)
+            s[i] = rand();
+        reference(s, decoder, expected, expectedUsed);
+
+        calls.clear();
+        uint32_t used = decodeExact(decoder, s.empty() ? NULL : &s[0], s.size());
+        expect(used == expectedUsed && calls == expected, "random buffer");
+        expect(s.size() - used < 5, "stopped early");
+    }
+
+    //Cost of a typical configuration batch
+    std::vector<uint8_t> batch = randomCommands(4096);
+    double t0 = sumpNow();
+    uint32_t commands = 0;
+    for(int r = 0; r < 200; r++) {
+        calls.clear();
+        decoder.decode(&batch[0], batch.size());
+        commands += 4096;
+    }
+    double t1 = sumpNow();
+
+    printf("%.1f ns per command\n", (t1 - t0) * 1e9 / commands);
+    printf("%s\n", failed ? "FAILED" : "decoder conforms");
+    return failed ? 2 : 0;
+}
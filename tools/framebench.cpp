@@ -0,0 +1,141 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+/*
+ Throughput of the framed protocol against the plain SUMP path. Every
+ run configures, captures and reads the whole capture, with:
+
+   sump     SUMP commands and arm, raw upload
+   stream   framed configuration batch and stream, broken chunks read again
+   read     framed configuration batch, capture, then chunk by chunk reads
+
+   framebench [-b baud] [-r rate] [-n samples] [-c chunk] [-k runs] device
+
+ The framed paths check every chunk, so their samples are also compared
+ with a final chunked read of the same capture.
+*/
+
+#include "FrameClient.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static void usage()
+{
+    fprintf(stderr, "usage: framebench [-b baud] [-r rate] [-n samples] [-c chunk] [-k runs] device\n");
+    exit(1);
+}
+
+static void report(const char *name, uint32_t samples, int runs, double seconds, uint32_t retransmissions)
+{
+    printf("%-8s %8.1f ms per capture %10.0f samples/s %6u retransmissions\n", name,
+           seconds * 1e3 / runs, samples * runs / seconds, retransmissions);
+}
+
+int main(int argc, char **argv)
+{
+    int baud = 115200;
+    uint32_t rate = 1000000;
+    uint32_t samples = 8192;
+    uint32_t chunk = FRAME_MAX_SAMPLES;
+    int runs = 3;
+    const char *device = NULL;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-b") && i + 1 < argc)
+            baud = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-r") && i + 1 < argc)
+            rate = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            samples = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-c") && i + 1 < argc)
+            chunk = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-k") && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if(argv[i][0] == '-')
+            usage();
+        else
+            device = argv[i];
+    }
+
+    if(device == NULL || rate == 0 || samples < 4 || chunk == 0 || runs <= 0)
+        usage();
+
+    SumpClient sump;
+    if(!sump.open(device, baud)) {
+        perror(device);
+        return 1;
+    }
+
+    //Capture time is not known, wait up to the slowest rate
+    int captureTimeout = 10000 + samples * 1000ull / rate;
+    std::vector<uint8_t> data, check;
+
+    double t0 = sumpNow();
+    for(int r = 0; r < runs; r++) {
+        sump.reset();
+        sump.setRate(rate);
+        sump.setSampleNumber(samples);
+        if(!sump.capture(SUMP_ARM, samples, data, captureTimeout)) {
+            fprintf(stderr, "SUMP capture timed out\n");
+            return 1;
+        }
+    }
+    report("sump", samples, runs, sumpNow() - t0, 0);
+
+    FrameClient frames(&sump);
+    sump.reset();
+    if(!frames.enter()) {
+        fprintf(stderr, "The device did not enter the framed protocol\n");
+        return 1;
+    }
+
+    std::vector<uint8_t> batch;
+    FrameClient::append(batch, SUMP_SET_DIVIDER, SUMP_ORIGINAL_FREQ / rate - 1);
+    FrameClient::append(batch, SUMP_SET_READ_DELAY_COUNT, (samples / 4 - 1) & 0xFFFF);
+
+    int failed = 0;
+    const char *names[] = {"stream", "read"};
+
+    for(int mode = 0; mode < 2; mode++) {
+        uint32_t before = frames.getRetransmissions();
+
+        t0 = sumpNow();
+        for(int r = 0; r < runs; r++) {
+            uint32_t captured;
+            bool ok = frames.configure(batch);
+
+            if(ok && mode == 0)
+                ok = frames.stream(samples, chunk, data, captureTimeout);
+            else if(ok)
+                ok = frames.capture(captured, captureTimeout) && frames.readAll(captured, chunk, data);
+
+            if(!ok) {
+                fprintf(stderr, "%s failed\n", names[mode]);
+                return 1;
+            }
+        }
+        report(names[mode], samples, runs, sumpNow() - t0, frames.getRetransmissions() - before);
+
+        if(!frames.readAll(samples, chunk, check) || check != data) {
+            printf("%s: samples differ from a chunked read of the same capture\n", names[mode]);
+            failed++;
+        }
+    }
+
+    printf("%u broken frames received\n", frames.getBadFrames());
+    frames.leave();
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,242 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+/*
+ Checks the compiled sampling kernels against a Cortex-M4 cycle model.
+ Reads a demangled disassembly of the firmware and, for every
+ flashKernel<CYCLES, UNROLL> and ramKernel<CYCLES, UNROLL>, finds the
+ sampling loop, adds up the cycles of its instructions and checks that
+ every sample slot (the distance between two port reads) is exactly
+ CYCLES. Also prints the achieved rate of every kernel at common core
+ clocks.
+
+   arm-none-eabi-objdump -D -C src/Sampler.o | kernelcheck [-p refill]
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <sstream>
+
+struct Instruction {
+    unsigned long address;
+    std::string mnemonic;
+    std::string operands;
+};
+
+struct Kernel {
+    std::string name;
+    int cycles;
+    int unroll;
+    std::vector<Instruction> code;
+};
+
+static int refill = 2;
+
+static const double coreClocks[] = {84e6, 100e6, 180e6};
+
+static std::string baseMnemonic(const std::string &m)
+{
+    size_t dot = m.find('.');
+    return dot == std::string::npos ? m : m.substr(0, dot);
+}
+
+static bool isBranch(const std::string &m)
+{
+    if(m == "bl" || m == "blx" || m == "bx" || m == "bic" || m == "bics" || m == "bfi" || m == "bfc")
+        return false;
+    return m[0] == 'b' || m == "cbz" || m == "cbnz";
+}
+
+//Word loads are the port reads
+static bool isPortRead(const std::string &m)
+{
+    return m == "ldr";
+}
+
+/* Cortex-M4 instruction timings (TRM, zero wait state memory). Loads
+   take 2 cycles, a store right after a load pipelines into 1 cycle, a
+   taken branch costs 1 + P and a branch not taken 1. */
+static int cost(const Instruction &i, const Instruction *previous, bool taken)
+{
+    std::string m = baseMnemonic(i.mnemonic);
+
+    if(isBranch(m))
+        return taken ? 1 + refill : 1;
+
+    if(m.compare(0, 3, "ldr") == 0 || m.compare(0, 3, "ldm") == 0 || m == "pop")
+        return 2;
+
+    if(m.compare(0, 3, "str") == 0) {
+        if(previous && baseMnemonic(previous->mnemonic).compare(0, 3, "ldr") == 0)
+            return 1;
+        return 2;
+    }
+
+    if(m == "mul" || m == "mla" || m == "nop")
+        return 1;
+
+    if(m == "sdiv" || m == "udiv")
+        return 12;
+
+    return 1;
+}
+
+static bool parseKernelName(const std::string &name, Kernel &k)
+{
+    const char *variants[] = {"flashKernel<", "ramKernel<"};
+
+    for(size_t v = 0; v < 2; v++) {
+        size_t pos = name.find(variants[v]);
+        if(pos == std::string::npos)
+            continue;
+
+        k.name = std::string(variants[v], strlen(variants[v]) - 1);
+        return sscanf(name.c_str() + pos + strlen(variants[v]), "%d, %d", &k.cycles, &k.unroll) == 2;
+    }
+    return false;
+}
+
+static bool check(const Kernel &k)
+{
+    const std::vector<Instruction> &code = k.code;
+    int loopStart = -1;
+    int loopEnd = -1;
+
+    //The sampling loop ends with the backward branch that covers the most instructions
+    for(size_t i = 0; i < code.size(); i++) {
+        if(!isBranch(baseMnemonic(code[i].mnemonic)))
+            continue;
+
+        unsigned long target = strtoul(code[i].operands.c_str(), NULL, 16);
+        if(target > code[i].address)
+            continue;
+
+        for(size_t j = 0; j <= i; j++) {
+            if(code[j].address == target && (loopEnd - loopStart) < (int)(i - j)) {
+                loopStart = j;
+                loopEnd = i;
+            }
+        }
+    }
+
+    printf("%s<%d, %d> ", k.name.c_str(), k.cycles, k.unroll);
+
+    if(loopStart < 0) {
+        printf("no loop found\n");
+        return false;
+    }
+
+    //Cycle offset of every port read within one iteration
+    std::vector<int> reads;
+    int total = 0;
+
+    for(int i = loopStart; i <= loopEnd; i++) {
+        if(isPortRead(baseMnemonic(code[i].mnemonic)))
+            reads.push_back(total);
+        total += cost(code[i], i > loopStart ? &code[i - 1] : NULL, i == loopEnd);
+    }
+
+    bool ok = (int) reads.size() == k.unroll && total == k.cycles * k.unroll;
+    int minSlot = 0x7FFFFFFF;
+    int maxSlot = 0;
+
+    for(size_t r = 0; r < reads.size(); r++) {
+        int next = r + 1 < reads.size() ? reads[r + 1] : reads[0] + total;
+        int slot = next - reads[r];
+
+        minSlot = slot < minSlot ? slot : minSlot;
+        maxSlot = slot > maxSlot ? slot : maxSlot;
+        if(slot != k.cycles)
+            ok = false;
+    }
+
+    printf("loop %d/%d cycles, %d reads, slots %d-%d", total, k.cycles * k.unroll, (int) reads.size(), minSlot, maxSlot);
+    for(size_t c = 0; c < sizeof(coreClocks) / sizeof(coreClocks[0]); c++)
+        printf(", %.0fMHz: %.3f MSPS", coreClocks[c] / 1e6, coreClocks[c] / k.cycles / 1e6);
+    printf(" %s\n", ok ? "OK" : "FAIL");
+
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-p") && i + 1 < argc) {
+            refill = atoi(argv[++i]);
+        }else {
+            fprintf(stderr, "usage: objdump -D -C Sampler.o | kernelcheck [-p refill]\n");
+            return 1;
+        }
+    }
+
+    std::vector<Kernel> kernels;
+    Kernel *current = NULL;
+    std::string line;
+
+    while(std::getline(std::cin, line)) {
+        unsigned long address;
+        char name[1024];
+
+        //Symbol: "00000000 <name>:"
+        if(sscanf(line.c_str(), "%lx <%1023[^\n]", &address, name) == 2 && line[line.size() - 1] == ':') {
+            Kernel k;
+            current = NULL;
+            if(parseKernelName(name, k)) {
+                kernels.push_back(k);
+                current = &kernels.back();
+            }
+            continue;
+        }
+
+        if(current == NULL)
+            continue;
+
+        //Instruction: "   8:	6803      	ldr	r3, [r0, #0]"
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        std::string field;
+        while(std::getline(ss, field, '\t'))
+            fields.push_back(field);
+
+        if(fields.size() < 3 || fields[0].empty() || fields[0][fields[0].size() - 1] != ':')
+            continue;
+
+        Instruction ins;
+        ins.address = strtoul(fields[0].c_str(), NULL, 16);
+        ins.mnemonic = fields[2];
+        ins.operands = fields.size() > 3 ? fields[3] : "";
+
+        while(!ins.mnemonic.empty() && ins.mnemonic[ins.mnemonic.size() - 1] == ' ')
+            ins.mnemonic.erase(ins.mnemonic.size() - 1);
+
+        current->code.push_back(ins);
+    }
+
+    if(kernels.empty()) {
+        fprintf(stderr, "No sampling kernels found\n");
+        return 1;
+    }
+
+    int failed = 0;
+    for(size_t i = 0; i < kernels.size(); i++)
+        if(!check(kernels[i]))
+            failed++;
+
+    printf("%d kernels, %d failed\n", (int) kernels.size(), failed);
+    return failed ? 2 : 0;
+}
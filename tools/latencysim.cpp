@@ -0,0 +1,136 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+/*
+ Simulates the time from the trigger to the last sample received by the
+ host, for the normal arm (capture, then upload) and the streaming arm
+ (0x12, upload between samples), over a range of sampling rates. The
+ model follows Sampler::armStreaming(): a byte is only written when the
+ UART data register is empty and more than the send margin is left
+ before the next sample, and the UART shifts one byte while it holds the
+ next one.
+
+   latencysim [-b baud] [-n samples] [-m margin cycles] [-s send cycles]
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <algorithm>
+
+#define CORE_CLOCK 84000000.0
+#define GENERIC_MAX_RATE 1000000
+
+struct Uart {
+    double byteCycles;
+    double dataFree;    // The data register takes the next byte
+    double shiftEnd;    // The last byte has left the pin
+
+    void put(double at) {
+        double start = std::max(at, shiftEnd);
+        shiftEnd = start + byteCycles;
+        dataFree = start;
+    }
+};
+
+static double sequential(uint32_t samples, double period, double byteCycles)
+{
+    Uart uart = {byteCycles, 0, 0};
+    double now = samples * period;
+
+    for(uint32_t i = 0; i < samples; i++) {
+        now = std::max(now, uart.dataFree);
+        uart.put(now);
+    }
+    return uart.shiftEnd;
+}
+
+static double streaming(uint32_t samples, double period, double byteCycles, double margin, double sendCycles)
+{
+    Uart uart = {byteCycles, 0, 0};
+    uint32_t sent = 0;
+
+    for(uint32_t k = 0; k < samples; k++) {
+        double now = k * period;
+        double next = now + period;
+
+        while(sent <= k) {
+            double at = std::max(now, uart.dataFree);
+            if(next - at <= margin)
+                break;
+            uart.put(at);
+            now = at + sendCycles;
+            sent++;
+        }
+    }
+
+    double now = samples * period;
+    for(; sent < samples; sent++) {
+        now = std::max(now, uart.dataFree);
+        uart.put(now);
+    }
+    return uart.shiftEnd;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: latencysim [-b baud] [-n samples] [-m margin cycles] [-s send cycles]\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t baud = 115200;
+    uint32_t samples = 32768;
+    double margin = 200;
+    double sendCycles = 120;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-b") && i + 1 < argc)
+            baud = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            samples = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-m") && i + 1 < argc)
+            margin = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-s") && i + 1 < argc)
+            sendCycles = atof(argv[++i]);
+        else
+            usage();
+    }
+
+    if(baud == 0 || samples == 0)
+        usage();
+
+    static const uint32_t rates[] = {1000000, 500000, 200000, 100000, 50000, 20000, 11520,
+                                     10000, 5000, 2000, 1000, 500, 200, 100};
+
+    double byteCycles = 10 * CORE_CLOCK / baud;
+
+    printf("%u samples, %u baud (upload %.0f ms)\n", samples, baud, samples * byteCycles / CORE_CLOCK * 1e3);
+    printf("    rate   capture ms  arm ms   streaming ms  saved\n");
+
+    for(size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        double period = CORE_CLOCK / rates[r];
+        double capture = samples * period;
+        double normal = sequential(samples, period, byteCycles);
+
+        //Faster rates run the exact-cycle kernels, which cannot stream
+        double stream = rates[r] < GENERIC_MAX_RATE ? streaming(samples, period, byteCycles, margin, sendCycles) : normal;
+
+        printf("%8u %12.1f %7.1f %14.1f %5.0f%%\n", rates[r], capture / CORE_CLOCK * 1e3,
+               normal / CORE_CLOCK * 1e3, stream / CORE_CLOCK * 1e3, (1 - stream / normal) * 100);
+    }
+    return 0;
+}
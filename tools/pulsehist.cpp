@@ -0,0 +1,212 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+/*
+ Pulse width histogram, computed on the device and cross-checked with a
+ plain reference implementation on the host.
+
+   pulsehist [-b baud] [-r rate] [-n samples] [-c channel] [-k bins] [-s subbins] device
+
+ Captures GPIOB, asks the device for the histogram of the capture and
+ compares it with the one computed here from the uploaded samples. With
+ -i file.bin (raw samples, one byte each) only the reference histogram
+ of the file is printed.
+*/
+
+#include "SumpClient.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#define SUMP_GET_HISTOGRAM 0x0E
+#define SUMP_SET_HISTOGRAM 0xA5
+
+struct Histogram {
+    std::vector<uint32_t> high;
+    std::vector<uint32_t> low;
+};
+
+//Octave m is split in 2^s equal bins: [2^m (1 + k / 2^s), 2^m (1 + (k + 1) / 2^s))
+static int binOf(uint32_t length, int bins, int s)
+{
+    int m = 0;
+    while((length >> (m + 1)) != 0)
+        m++;
+
+    uint64_t base = 1ull << m;
+    int k = (int) (((uint64_t) (length - base) << s) / base);
+    int bin = (m << s) + k;
+
+    return bin < bins ? bin : bins - 1;
+}
+
+//Scalar scan in time order, partial first and last runs are dropped
+static Histogram reference(const std::vector<uint8_t> &data, int channel, int bins, int s)
+{
+    Histogram h;
+    h.high.assign(bins, 0);
+    h.low.assign(bins, 0);
+
+    long lastEdge = -1;
+    for(size_t i = 1; i < data.size(); i++) {
+        int level = (data[i] >> channel) & 1;
+        if(level == ((data[i - 1] >> channel) & 1))
+            continue;
+
+        if(lastEdge >= 0) {
+            int bin = binOf(i - lastEdge, bins, s);
+            if(level)
+                h.low[bin]++;
+            else
+                h.high[bin]++;
+        }
+        lastEdge = i;
+    }
+    return h;
+}
+
+static void print(const Histogram &h, int s)
+{
+    printf("bin       from       high        low\n");
+    for(size_t b = 0; b < h.high.size(); b++) {
+        int m = b >> s;
+        int k = b & ((1 << s) - 1);
+        double from = (1u << m) * (1.0 + (double) k / (1 << s));
+        printf("%3zu %10.2f %10u %10u\n", b, from, h.high[b], h.low[b]);
+    }
+}
+
+static bool readDevice(SumpClient &sump, int bins, Histogram &h)
+{
+    uint8_t count;
+
+    sump.command(SUMP_GET_HISTOGRAM);
+    if(sump.read(&count, 1, 5000) != 1 || count != bins)
+        return false;
+
+    std::vector<uint8_t> reply(bins * 8);
+    if(sump.read(&reply[0], reply.size(), 5000) != reply.size())
+        return false;
+
+    h.high.resize(bins);
+    h.low.resize(bins);
+    for(int i = 0; i < bins * 2; i++) {
+        const uint8_t *v = &reply[i * 4];
+        uint32_t n = (v[0] << 24) | (v[1] << 16) | (v[2] << 8) | v[3];
+        if(i < bins)
+            h.high[i] = n;
+        else
+            h.low[i - bins] = n;
+    }
+    return true;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: pulsehist [-b baud] [-r rate] [-n samples] [-c channel] [-k bins] [-s subbins] (-i file | device)\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int baud = 115200;
+    uint32_t rate = 1000000;
+    uint32_t samples = 32768;
+    int channel = 0;
+    int bins = 16;
+    int s = 0;
+    const char *device = NULL;
+    const char *input = NULL;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-b") && i + 1 < argc)
+            baud = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-r") && i + 1 < argc)
+            rate = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            samples = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-c") && i + 1 < argc)
+            channel = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-k") && i + 1 < argc)
+            bins = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-s") && i + 1 < argc)
+            s = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-i") && i + 1 < argc)
+            input = argv[++i];
+        else if(argv[i][0] == '-')
+            usage();
+        else
+            device = argv[i];
+    }
+
+    //Same limits as the firmware
+    if((device == NULL && input == NULL) || rate == 0 || samples < 4 || channel < 0 || channel > 7 ||
+       bins < 1 || bins > 32 || s < 0 || s > 3)
+        usage();
+
+    if(input) {
+        FILE *f = fopen(input, "rb");
+        if(f == NULL) {
+            perror(input);
+            return 1;
+        }
+
+        std::vector<uint8_t> data;
+        int c;
+        while((c = fgetc(f)) != EOF)
+            data.push_back(c);
+        fclose(f);
+
+        print(reference(data, channel, bins, s), s);
+        return 0;
+    }
+
+    SumpClient sump;
+    if(!sump.open(device, baud)) {
+        perror(device);
+        return 1;
+    }
+
+    sump.reset();
+    sump.setRate(rate);
+    sump.setSampleNumber(samples);
+
+    std::vector<uint8_t> data;
+    if(!sump.capture(SUMP_ARM, samples, data, 5000)) {
+        fprintf(stderr, "Timeout waiting for %u samples\n", samples);
+        return 1;
+    }
+
+    Histogram deviceHist;
+    sump.command(SUMP_SET_HISTOGRAM, channel | (bins << 8) | (s << 16));
+    if(!readDevice(sump, bins, deviceHist)) {
+        fprintf(stderr, "Bad histogram reply\n");
+        return 1;
+    }
+
+    Histogram hostHist = reference(data, channel, bins, s);
+    print(deviceHist, s);
+
+    int mismatches = 0;
+    for(int b = 0; b < bins; b++) {
+        if(deviceHist.high[b] != hostHist.high[b] || deviceHist.low[b] != hostHist.low[b]) {
+            fprintf(stderr, "bin %d: device %u/%u, host %u/%u\n", b, deviceHist.high[b], deviceHist.low[b], hostHist.high[b], hostHist.low[b]);
+            mismatches++;
+        }
+    }
+
+    printf("%s\n", mismatches ? "MISMATCH" : "host reference OK");
+    return mismatches ? 2 : 0;
+}
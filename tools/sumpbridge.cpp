@@ -0,0 +1,786 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+/*
+ Owns the serial link to the board and serves SUMP to several clients
+ on a local TCP port.
+
+   sumpbridge [-b baud] [-p port] [-t timeout s] [-v] device
+
+ Each client keeps its own configuration (the configuration commands,
+ 0x80-0x82, 0xC0-0xCF, 0xA0, 0xA2, 0xA3, 0xA5, 0xA6, 0xA8, 0xAB). The
+ bridge holds it and, before the next command of that client, sends the
+ board only the values that differ from what the board has. Commands
+ are written without waiting for the replies of the earlier ones, up to
+ half the firmware command ring, and the replies are split by their
+ known format. An arm or test capture asked with the same configuration
+ while another one has not started its reply shares that reply.
+
+ The ID query is answered by the bridge, and so is the window readback
+ (0xA8, 0xA9) of the last capture of each client, which the bridge keeps.
+ A client with earlier requests pending gets them in order. The framed
+ protocol (0xAA) and XON/XOFF are not passed to the board.
+
+ Clients that only open serial ports can use socat:
+   socat pty,link=/tmp/ttySUMP,raw tcp:localhost:5555
+*/
+
+#include "../src/CaptureCodec.h"
+#include "SumpClient.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define BRIDGE_PORT 5555
+#define BRIDGE_WINDOW 512       // Command bytes in flight, half of COMMAND_RX_SIZE
+#define BRIDGE_SAMPLES 0x07FF07FF
+
+#define MAX_SAMPLES 32768
+#define UPLOAD_MAX_CHUNK 4096
+#define COUNTER_CHANNELS 8
+
+#define SUMP_XON 0x11
+#define SUMP_XOFF 0x13
+#define SUMP_SELF_TEST 0x08
+#define SUMP_GET_DIAGNOSTICS 0x09
+#define SUMP_KERNEL_BENCHMARK 0x0A
+#define SUMP_COUNT_FREQUENCY 0x0B
+#define SUMP_MONITOR_QUERY 0x0D
+#define SUMP_GET_HISTOGRAM 0x0E
+#define SUMP_GET_SKEW 0x0F
+#define SUMP_ARM_PROGRESSIVE 0x10
+#define SUMP_ARM_STREAMING 0x12
+#define SUMP_RUN_BENCHMARK 0x14
+#define SUMP_SET_PATTERN 0xA1
+#define SUMP_GET_OVERVIEW 0xA7
+#define SUMP_SET_READ_WINDOW 0xA8
+#define SUMP_READ_WINDOW 0xA9
+#define SUMP_ENTER_FRAMED 0xAA
+
+#define WINDOW_RLE 1
+#define WINDOW_LZ 2
+
+typedef std::vector<uint8_t> Bytes;
+typedef std::map<uint8_t, uint32_t> Config;
+
+enum ReplyKind {
+    REPLY_NONE,
+    REPLY_FIXED,        // A known number of bytes
+    REPLY_TOKENS,       // Metadata format, up to the 0x00 key
+    REPLY_TEXT,         // Up to a zero byte
+    REPLY_SIZED,        // uint32 size, then the payload
+    REPLY_OVERVIEW,     // Bin size and bins (uint32), then two bytes per bin
+    REPLY_HISTOGRAM     // Bin count (byte), then two uint32 per bin
+};
+
+/* Finds the end of a reply as its bytes arrive. */
+struct Reply {
+    ReplyKind kind;
+    uint32_t remaining;
+    uint8_t header[8];
+    uint8_t headerLength;
+    uint8_t got;
+    bool inString;
+
+    Reply(ReplyKind k = REPLY_NONE, uint32_t length = 0) {
+        kind = length == 0 && k == REPLY_FIXED ? REPLY_NONE : k;
+        remaining = length;
+        headerLength = k == REPLY_SIZED ? 4 : k == REPLY_OVERVIEW ? 8 : k == REPLY_HISTOGRAM ? 1 : 0;
+        got = 0;
+        inString = false;
+    }
+
+    //Returns true on the last byte
+    bool feed(uint8_t v) {
+        switch(kind) {
+            case REPLY_NONE:
+                return true;
+            case REPLY_FIXED:
+                return --remaining == 0;
+            case REPLY_TEXT:
+                return v == 0;
+            case REPLY_TOKENS:
+                if(remaining > 0) {
+                    remaining--;
+                    return false;
+                }
+                if(inString) {
+                    inString = v != 0;
+                    return false;
+                }
+                if(v == 0)
+                    return true;
+                if(v < 0x20)
+                    inString = true;
+                else
+                    remaining = v >= 0x40 && v < 0x60 ? 1 : 4;
+                return false;
+            default:
+                break;
+        }
+
+        if(got < headerLength) {
+            header[got++] = v;
+            if(got < headerLength)
+                return false;
+
+            const uint8_t *h = kind == REPLY_OVERVIEW ? header + 4 : header;
+            uint32_t value = (h[0] << 24) | (h[1] << 16) | (h[2] << 8) | h[3];
+            remaining = kind == REPLY_SIZED ? value : kind == REPLY_OVERVIEW ? 2 * value : 8 * header[0];
+            return remaining == 0;
+        }
+        return --remaining == 0;
+    }
+};
+
+struct Request {
+    std::vector<int> clients;
+    Bytes command;
+    Config config;
+    Reply reply;
+    uint32_t written;       // Bytes on the link, with the configuration sent before it
+    uint32_t received;
+    Bytes samples;          // Capture replies, kept for the cache
+    uint32_t readCount;
+    uint16_t chunk;
+    double last;
+    bool local;             // Answered by the bridge when it reaches the link
+};
+
+struct Cache {
+    bool valid;
+    Bytes samples;          // Newest first, as the board keeps them
+    uint32_t readCount;
+};
+
+struct Client {
+    int fd;
+    Bytes rx;
+    Bytes tx;
+    Config config;
+    Cache cache;            // Its last capture
+};
+
+static SumpClient serial;
+static Config device;
+static std::map<int, Client> clients;
+static std::deque<Request> queue;
+static std::deque<Request> inflight;
+static uint32_t inflightBytes;
+static CaptureCodec codec;
+static uint8_t deviceId[4];
+static double timeout = 30;
+static bool verbose;
+static int nextId;
+
+static uint32_t loadUInt32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void append(Bytes &out, uint8_t op, uint32_t param)
+{
+    out.push_back(op);
+    for(int i = 0; i < 4; i++)
+        out.push_back(param >> (8 * i));
+}
+
+static void appendBigEndian(Bytes &out, uint32_t v)
+{
+    for(int shift = 24; shift >= 0; shift -= 8)
+        out.push_back(v >> shift);
+}
+
+//Same list as the COMMAND_CONFIGURATION entries of the firmware
+static bool configuration(uint8_t op)
+{
+    switch(op) {
+        case SUMP_SET_DIVIDER:
+        case SUMP_SET_READ_DELAY_COUNT:
+        case SUMP_SET_FLAGS:
+        case 0xA0:
+        case 0xA2:
+        case 0xA3:
+        case 0xA5:
+        case 0xA6:
+        case SUMP_SET_READ_WINDOW:
+        case SUMP_SET_UPLOAD_CHUNK:
+            return true;
+    }
+    return (op & 0xF0) == 0xC0;
+}
+
+static uint32_t sampleNumber(uint32_t readCount)
+{
+    return std::min((uint32_t) MAX_SAMPLES, 4 * (1 + (readCount & 0xFFFF)));
+}
+
+static uint16_t chunkSize(uint32_t param)
+{
+    return std::min((uint32_t) UPLOAD_MAX_CHUNK, param & 0xFFFF) & ~3;
+}
+
+//The configuration the board holds when this is sent
+static Reply replyOf(const Request &r)
+{
+    uint32_t param = r.command.size() >= 5 ? loadUInt32(&r.command[1]) : 0;
+    uint32_t samples = sampleNumber(r.readCount);
+
+    switch(r.command[0]) {
+        case SUMP_ARM:
+        case SUMP_TEST:
+        case SUMP_ARM_STREAMING:
+            return Reply(REPLY_FIXED, samples + (r.chunk ? 4 * ((samples + r.chunk - 1) / r.chunk) : 0));
+        case SUMP_RESEND_CHUNK: {
+            uint32_t offset = (param & 0xFFFF) * r.chunk;
+            return Reply(REPLY_FIXED, r.chunk && offset < samples ? std::min((uint32_t) r.chunk, samples - offset) + 4 : 0);
+        }
+        case SUMP_QUERY:
+            return Reply(REPLY_FIXED, 4);
+        case SUMP_COUNT_FREQUENCY:
+            return Reply(REPLY_FIXED, 4 * COUNTER_CHANNELS + 1);
+        case SUMP_GET_METADATA:
+        case SUMP_GET_DIAGNOSTICS:
+        case SUMP_MONITOR_QUERY:
+        case SUMP_GET_SKEW:
+        case SUMP_RUN_BENCHMARK:
+            return Reply(REPLY_TOKENS);
+        case SUMP_SELF_TEST:
+        case SUMP_KERNEL_BENCHMARK:
+            return Reply(REPLY_TEXT);
+        case SUMP_GET_HISTOGRAM:
+            return Reply(REPLY_HISTOGRAM);
+        case SUMP_ARM_PROGRESSIVE:
+        case SUMP_GET_OVERVIEW:
+            return Reply(REPLY_OVERVIEW);
+        case SUMP_READ_WINDOW:
+            return Reply(REPLY_SIZED);
+    }
+    return Reply(REPLY_NONE);
+}
+
+//Commands that refill the sample buffer
+static bool captures(uint8_t op)
+{
+    return op == SUMP_ARM || op == SUMP_TEST || op == SUMP_ARM_STREAMING || op == SUMP_ARM_PROGRESSIVE ||
+           op == SUMP_SELF_TEST || op == SUMP_KERNEL_BENCHMARK || op == SUMP_RUN_BENCHMARK;
+}
+
+static void send(int id, const uint8_t *data, size_t length)
+{
+    std::map<int, Client>::iterator c = clients.find(id);
+    if(c != clients.end())
+        c->second.tx.insert(c->second.tx.end(), data, data + length);
+}
+
+static void closeClient(int id)
+{
+    std::map<int, Client>::iterator c = clients.find(id);
+    if(c == clients.end())
+        return;
+
+    if(verbose)
+        fprintf(stderr, "client %d closed\n", id);
+    close(c->second.fd);
+    clients.erase(c);
+}
+
+//Window readback of a cached capture, as Sampler::uploadWindow() does it
+static void window(int id, const Cache &cache, uint32_t readWindow, uint32_t param)
+{
+    const Bytes &s = cache.samples;
+    uint32_t n = s.size();
+    uint32_t from = std::min(readWindow & 0xFFFF, n);
+    uint32_t to = std::min(from + ((readWindow >> 16) ? (readWindow >> 16) : n), n);
+    uint32_t step = std::max((uint32_t) 1, param & 0xFFFF);
+    uint8_t mode = param >> 16;
+    Bytes body;
+
+    if(mode == WINDOW_LZ) {
+        struct Collect {
+            static void put(void *context, uint8_t v) { ((Bytes *) context)->push_back(v); }
+        };
+        codec.encode(s.data() + from, (to - from + step - 1) / step, step, Collect::put, &body);
+    }else if(mode == WINDOW_RLE) {
+        for(uint32_t i = from; i < to; ) {
+            uint32_t run = 1;
+            while(run < 256 && i + run * step < to && s[i + run * step] == s[i])
+                run++;
+            body.push_back(s[i]);
+            body.push_back(run - 1);
+            i += run * step;
+        }
+    }else {
+        for(uint32_t i = from; i < to; i += step)
+            body.push_back(s[i]);
+    }
+
+    Bytes out;
+    appendBigEndian(out, body.size());
+    out.insert(out.end(), body.begin(), body.end());
+    send(id, &out[0], out.size());
+}
+
+//Requests of the client that are queued or in flight
+static bool pending(int id, const std::deque<Request> &list)
+{
+    for(size_t i = 0; i < list.size(); i++)
+        if(std::find(list[i].clients.begin(), list[i].clients.end(), id) != list[i].clients.end())
+            return true;
+    return false;
+}
+
+//The ID query and the window readback of the client's last capture
+static bool answer(int id, const uint8_t *command, const Config &config)
+{
+    std::map<int, Client>::iterator c = clients.find(id);
+    if(c == clients.end())
+        return true;
+
+    if(command[0] == SUMP_QUERY) {
+        send(id, deviceId, sizeof(deviceId));
+        return true;
+    }
+
+    const Cache &cache = c->second.cache;
+    Config::const_iterator readCount = config.find(SUMP_SET_READ_DELAY_COUNT);
+    Config::const_iterator readWindow = config.find(SUMP_SET_READ_WINDOW);
+    if(!cache.valid || readCount == config.end() || readCount->second != cache.readCount)
+        return false;
+
+    window(id, cache, readWindow == config.end() ? 0 : readWindow->second, loadUInt32(command + 1));
+    return true;
+}
+
+static void enqueue(int id, const uint8_t *command, size_t length, const Config &config)
+{
+    uint8_t op = command[0];
+
+    //Joins a capture that has not started its reply, unless it is already in it
+    if(op == SUMP_ARM || op == SUMP_TEST) {
+        std::deque<Request> *lists[] = {&inflight, &queue};
+        for(int l = 0; l < 2; l++) {
+            for(size_t i = 0; i < lists[l]->size(); i++) {
+                Request &r = (*lists[l])[i];
+                if(r.command[0] == op && r.received == 0 && r.config == config &&
+                   std::find(r.clients.begin(), r.clients.end(), id) == r.clients.end()) {
+                    r.clients.push_back(id);
+                    if(verbose)
+                        fprintf(stderr, "client %d shares the capture of client %d\n", id, r.clients[0]);
+                    return;
+                }
+            }
+        }
+    }
+
+    Request r;
+    r.clients.push_back(id);
+    r.command.assign(command, command + length);
+    r.config = config;
+    r.written = 0;
+    r.received = 0;
+    r.readCount = 0;
+    r.chunk = 0;
+    r.last = 0;
+    r.local = op == SUMP_QUERY || op == SUMP_READ_WINDOW;
+
+    //Its reply length would depend on the rate otherwise
+    if(op == SUMP_ARM_STREAMING)
+        r.config[SUMP_SET_UPLOAD_CHUNK] = 0;
+
+    queue.push_back(r);
+}
+
+/* Writes queued commands while the ones in flight fit in the window. A
+   command with no reply stays counted until the one before it ends. A
+   request the bridge answers waits for the earlier replies of its client,
+   and goes to the board if the client has no capture for it. */
+static void pump()
+{
+    while(!queue.empty()) {
+        Request &r = queue.front();
+        Bytes out;
+
+        if(r.local) {
+            if(pending(r.clients[0], inflight))
+                break;
+            if(answer(r.clients[0], &r.command[0], r.config)) {
+                queue.pop_front();
+                continue;
+            }
+        }
+
+        for(Config::const_iterator c = r.config.begin(); c != r.config.end(); ++c) {
+            Config::const_iterator d = device.find(c->first);
+            if(d == device.end() || d->second != c->second)
+                append(out, c->first, c->second);
+        }
+        out.insert(out.end(), r.command.begin(), r.command.end());
+
+        if(!inflight.empty() && inflightBytes + out.size() > BRIDGE_WINDOW)
+            break;
+
+        if(!serial.write(&out[0], out.size())) {
+            perror("serial");
+            exit(1);
+        }
+
+        for(Config::const_iterator c = r.config.begin(); c != r.config.end(); ++c)
+            device[c->first] = c->second;
+
+        //The self-test resets the capture configuration
+        if(r.command[0] == SUMP_SELF_TEST)
+            device.clear();
+
+        r.readCount = device[SUMP_SET_READ_DELAY_COUNT];
+        r.chunk = chunkSize(device[SUMP_SET_UPLOAD_CHUNK]);
+        r.reply = replyOf(r);
+        r.written = out.size();
+        r.last = sumpNow();
+        inflightBytes += out.size();
+
+        if(verbose)
+            fprintf(stderr, "client %d: %02X, %u bytes written, %zu in flight\n", r.clients[0], r.command[0],
+                    r.written, inflight.size());
+
+        if(r.reply.kind != REPLY_NONE)
+            inflight.push_back(r);
+        else if(!inflight.empty())
+            inflight.back().written += out.size();
+        else
+            inflightBytes -= out.size();
+        queue.pop_front();
+    }
+}
+
+static void complete(Request &r)
+{
+    uint8_t op = r.command[0];
+    Cache cache;
+    cache.valid = false;
+
+    if(op == SUMP_ARM || op == SUMP_TEST || op == SUMP_ARM_STREAMING) {
+        cache.valid = true;
+        cache.readCount = r.readCount;
+
+        //Without the CRC of every chunk, a bad chunk leaves no cache
+        const Bytes &s = r.samples;
+        uint32_t chunk = r.chunk ? r.chunk : s.size();
+        for(size_t i = 0; i < s.size() && cache.valid; i += chunk + (r.chunk ? 4 : 0)) {
+            size_t length = std::min((size_t) chunk, s.size() - i - (r.chunk ? 4 : 0));
+            if(r.chunk) {
+                const uint8_t *c = &s[i + length];
+                cache.valid = sumpCrc32(&s[i], length) == (uint32_t) ((c[0] << 24) | (c[1] << 16) | (c[2] << 8) | c[3]);
+            }
+            cache.samples.insert(cache.samples.end(), s.begin() + i, s.begin() + i + length);
+        }
+
+        //The streaming arm sends the oldest sample first
+        if(op == SUMP_ARM_STREAMING)
+            std::reverse(cache.samples.begin(), cache.samples.end());
+    }
+
+    //The other captures are only on the board
+    if(captures(op))
+        for(size_t i = 0; i < r.clients.size(); i++)
+            if(clients.count(r.clients[i]))
+                clients[r.clients[i]].cache = cache;
+
+    if(verbose)
+        fprintf(stderr, "client %d: %02X done, %u bytes in %.1f ms\n", r.clients[0], op, r.received,
+                (sumpNow() - r.last) * 1e3);
+}
+
+static void receive(const uint8_t *data, size_t length)
+{
+    size_t i = 0;
+
+    while(i < length) {
+        if(inflight.empty()) {
+            if(verbose)
+                fprintf(stderr, "%zu bytes without a request\n", length - i);
+            return;
+        }
+
+        Request &r = inflight.front();
+        size_t start = i;
+        bool last = false;
+
+        while(i < length && !last)
+            last = r.reply.feed(data[i++]);
+
+        uint8_t op = r.command[0];
+        if(op == SUMP_ARM || op == SUMP_TEST || op == SUMP_ARM_STREAMING)
+            r.samples.insert(r.samples.end(), data + start, data + i);
+        for(size_t c = 0; c < r.clients.size(); c++)
+            send(r.clients[c], data + start, i - start);
+        r.received += i - start;
+
+        if(last) {
+            complete(r);
+            inflightBytes -= r.written;
+            inflight.pop_front();
+        }
+    }
+
+    if(!inflight.empty())
+        inflight.front().last = sumpNow();
+}
+
+static void handleCommand(int id, const uint8_t *command, size_t length)
+{
+    Client &c = clients[id];
+    uint8_t op = command[0];
+    uint32_t param = length >= 5 ? loadUInt32(command + 1) : 0;
+
+    if(configuration(op)) {
+        c.config[op] = param;
+        return;
+    }
+
+    switch(op) {
+        case SUMP_RESET:
+            c.config[SUMP_SET_UPLOAD_CHUNK] = 0;
+            return;
+        case SUMP_QUERY:
+        case SUMP_READ_WINDOW:
+            if(!pending(id, queue) && !pending(id, inflight) && answer(id, command, c.config))
+                return;
+            break;
+        case SUMP_XON:
+        case SUMP_XOFF:
+            return;
+        case SUMP_ENTER_FRAMED:
+            if(verbose)
+                fprintf(stderr, "client %d: the framed protocol is not bridged\n", id);
+            return;
+    }
+
+    enqueue(id, command, length, c.config);
+}
+
+//Splits the client stream into commands, the pattern upload carries its payload
+static void parse(int id)
+{
+    Bytes &rx = clients[id].rx;
+    size_t p = 0;
+
+    while(p < rx.size()) {
+        size_t length = rx[p] & 0x80 ? 5 : 1;
+        if(p + length > rx.size())
+            break;
+        if(rx[p] == SUMP_SET_PATTERN)
+            length += rx[p + 1] | (rx[p + 2] << 8);
+        if(p + length > rx.size())
+            break;
+
+        handleCommand(id, &rx[p], length);
+        p += length;
+    }
+    rx.erase(rx.begin(), rx.begin() + p);
+}
+
+static void flush(Client &c)
+{
+    while(!c.tx.empty()) {
+        ssize_t n = write(c.fd, &c.tx[0], c.tx.size());
+        if(n <= 0)
+            return;
+        c.tx.erase(c.tx.begin(), c.tx.begin() + n);
+    }
+}
+
+static int listenOn(int port)
+{
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_port = htons(port);
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if(bind(s, (struct sockaddr *) &a, sizeof(a)) != 0 || listen(s, 8) != 0) {
+        perror("listen");
+        exit(1);
+    }
+    return s;
+}
+
+static void acceptClient(int listener)
+{
+    int fd = ::accept(listener, NULL, NULL);
+    if(fd < 0)
+        return;
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    Client c;
+    c.fd = fd;
+    c.config[SUMP_SET_READ_DELAY_COUNT] = BRIDGE_SAMPLES;
+    c.config[SUMP_SET_UPLOAD_CHUNK] = 0;
+    c.cache.valid = false;
+    clients[nextId] = c;
+
+    if(verbose)
+        fprintf(stderr, "client %d connected\n", nextId);
+    nextId++;
+}
+
+//No reply for too long: the board is stuck (waiting for a trigger) or lost bytes
+static void expire()
+{
+    if(inflight.empty() || sumpNow() - inflight.front().last < timeout)
+        return;
+
+    fprintf(stderr, "no reply to %02X for %.0f s, dropping %zu requests\n", inflight.front().command[0],
+            timeout, inflight.size());
+
+    for(size_t i = 0; i < inflight.size(); i++)
+        for(size_t c = 0; c < inflight[i].clients.size(); c++)
+            closeClient(inflight[i].clients[c]);
+
+    inflight.clear();
+    inflightBytes = 0;
+    device.clear();
+    tcflush(serial.getFd(), TCIFLUSH);
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: sumpbridge [-b baud] [-p port] [-t timeout s] [-v] device\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int baud = 115200;
+    int port = BRIDGE_PORT;
+    const char *path = NULL;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-b") && i + 1 < argc)
+            baud = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-p") && i + 1 < argc)
+            port = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-t") && i + 1 < argc)
+            timeout = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-v"))
+            verbose = true;
+        else if(argv[i][0] == '-')
+            usage();
+        else
+            path = argv[i];
+    }
+
+    if(path == NULL || timeout <= 0)
+        usage();
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if(!serial.open(path, baud)) {
+        perror(path);
+        return 1;
+    }
+
+    serial.reset();
+    serial.command(SUMP_QUERY);
+    if(serial.read(deviceId, sizeof(deviceId), 2000) != sizeof(deviceId)) {
+        fprintf(stderr, "%s: no reply to the ID query\n", path);
+        return 1;
+    }
+
+    //Known starting point, so that every reply length is known
+    serial.command(SUMP_SET_READ_DELAY_COUNT, BRIDGE_SAMPLES);
+    serial.command(SUMP_SET_UPLOAD_CHUNK, 0);
+    device[SUMP_SET_READ_DELAY_COUNT] = BRIDGE_SAMPLES;
+    device[SUMP_SET_UPLOAD_CHUNK] = 0;
+
+    int listener = listenOn(port);
+    fprintf(stderr, "%s (%.4s) on port %d\n", path, deviceId, port);
+
+    while(true) {
+        std::vector<struct pollfd> fds(2);
+        std::vector<int> ids;
+
+        fds[0].fd = listener;
+        fds[0].events = POLLIN;
+        fds[1].fd = serial.getFd();
+        fds[1].events = POLLIN;
+
+        for(std::map<int, Client>::iterator c = clients.begin(); c != clients.end(); ++c) {
+            struct pollfd p;
+            p.fd = c->second.fd;
+            p.events = POLLIN | (c->second.tx.empty() ? 0 : POLLOUT);
+            fds.push_back(p);
+            ids.push_back(c->first);
+        }
+
+        if(poll(&fds[0], fds.size(), 100) < 0)
+            continue;
+
+        if(fds[0].revents & POLLIN)
+            acceptClient(listener);
+
+        if(fds[1].revents & POLLIN) {
+            uint8_t data[4096];
+            ssize_t n = read(serial.getFd(), data, sizeof(data));
+            if(n > 0)
+                receive(data, n);
+        }
+        if(fds[1].revents & (POLLHUP | POLLERR)) {
+            fprintf(stderr, "%s closed\n", path);
+            return 1;
+        }
+
+        for(size_t i = 0; i < ids.size(); i++) {
+            if(!(fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+
+            uint8_t data[4096];
+            ssize_t n = read(fds[i + 2].fd, data, sizeof(data));
+            if(n <= 0) {
+                closeClient(ids[i]);
+                continue;
+            }
+
+            Bytes &rx = clients[ids[i]].rx;
+            rx.insert(rx.end(), data, data + n);
+            parse(ids[i]);
+        }
+
+        pump();
+        expire();
+
+        for(std::map<int, Client>::iterator c = clients.begin(); c != clients.end(); ++c)
+            flush(c->second);
+    }
+    return 0;
+}
@@ -0,0 +1,279 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+/*
+ Runs the SUMP test capture and checks the received samples against the
+ firmware test pattern (a 0-255 counter followed by 8 walking ones,
+ repeated), then reports errors and upload throughput.
+
+   sumptest [-b baud] [-r rate] [-n samples] [-c chunk] /dev/ttyACM0
+
+ With -t it runs the on-device timing self-test instead and prints the
+ per-rate period error and jitter table. With -k it prints the flash vs
+ RAM kernel jitter benchmark. With -f it runs the frequency counter for
+ the given gate time (ms) and prints the frequency of every channel.
+ With -c the upload is chunked, with a CRC per chunk, and broken chunks
+ are asked for again. With -d it prints the diagnostics counters.
+*/
+
+#include "SumpClient.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <map>
+
+#define SUMP_SELF_TEST 0x08
+#define SUMP_GET_DIAGNOSTICS 0x09
+#define SUMP_KERNEL_BENCHMARK 0x0A
+#define SUMP_COUNT_FREQUENCY 0x0B
+#define SUMP_SET_COUNTER_GATE 0xA3
+
+#define DIAG_KERNEL 0x40
+#define DIAG_OPCODE 0x41
+#define DIAG_KERNEL_RATE 0x20
+#define DIAG_KERNEL_ACHIEVED_RATE 0x21
+#define DIAG_KERNEL_DEVIATION 0x22
+#define DIAG_KERNEL_CAPTURES 0x23
+#define DIAG_OPCODE_COUNT 0x20
+#define DIAG_CODEC_SAMPLES 0x24
+#define DIAG_CODEC_BYTES 0x25
+#define DIAG_CODEC_CYCLES 0x26
+#define DIAG_CAPTURES 0x27
+#define DIAG_TRIGGERS 0x28
+#define DIAG_TRIGGER_WAIT 0x29
+#define DIAG_SAMPLE_PERIOD 0x2A
+#define DIAG_UPLOADS 0x2B
+#define DIAG_UPLOAD_BYTES 0x2C
+#define DIAG_UPLOAD_CYCLES 0x2D
+#define DIAG_RX_OVERRUNS 0x2E
+#define DIAG_UNKNOWN_COMMANDS 0x2F
+#define DIAG_STACK_SIZE 0x30
+#define DIAG_STACK_USED 0x31
+#define DIAG_CORE_CLOCK 0x32
+
+#define TEST_PATTERN_LENGTH (256 + 8)
+
+static uint8_t testPattern(uint32_t i)
+{
+    i %= TEST_PATTERN_LENGTH;
+    return i < 256 ? i : 1 << (i - 256);
+}
+
+//Walking ones are also counter values, so a position is found from three samples
+static int patternIndex(const uint8_t *v)
+{
+    for(int i = 0; i < TEST_PATTERN_LENGTH; i++)
+        if(testPattern(i) == v[0] && testPattern(i + 1) == v[1] && testPattern(i + 2) == v[2])
+            return i;
+
+    return -1;
+}
+
+//The table is plain text terminated by a zero byte
+static int printTable(SumpClient &sump, uint8_t opcode)
+{
+    uint8_t c;
+
+    sump.command(opcode);
+    while(sump.read(&c, 1, 30000) == 1) {
+        if(c == 0)
+            return 0;
+        putchar(c);
+    }
+
+    fprintf(stderr, "Timeout waiting for the table\n");
+    return 1;
+}
+
+static int printFrequencies(SumpClient &sump, uint32_t gate)
+{
+    uint8_t reply[8 * 4 + 1];
+
+    sump.command(SUMP_SET_COUNTER_GATE, gate);
+    sump.command(SUMP_COUNT_FREQUENCY);
+    if(sump.read(reply, sizeof(reply), gate + 1000) != sizeof(reply)) {
+        fprintf(stderr, "Timeout waiting for the frequencies\n");
+        return 1;
+    }
+
+    //Big endian, channel 0 first, then the hardware counted channels
+    for(int c = 0; c < 8; c++) {
+        const uint8_t *v = reply + c * 4;
+        uint32_t f = (v[0] << 24) | (v[1] << 16) | (v[2] << 8) | v[3];
+        printf("ch%d %10u Hz %s\n", c, f, (reply[32] >> c) & 1 ? "timer" : "sampled");
+    }
+    return 0;
+}
+
+//Keys 0x20-0x3F are uint32 values, 0x40-0x5F start a group
+static int printDiagnostics(SumpClient &sump)
+{
+    std::map<int, std::map<uint8_t, uint32_t> > groups;
+    int group = -1;
+    uint8_t key = 0xFF;
+
+    sump.command(SUMP_GET_DIAGNOSTICS);
+    while(sump.read(&key, 1, 2000) == 1 && key != 0x00) {
+        uint8_t v[4];
+        uint32_t n = key >= 0x40 ? 1 : 4;
+        if(sump.read(v, n, 2000) != n)
+            break;
+
+        if(key >= 0x40)
+            group = key << 8 | v[0];
+        else
+            groups[group][key] = (v[0] << 24) | (v[1] << 16) | (v[2] << 8) | v[3];
+    }
+    if(key != 0x00) {
+        fprintf(stderr, "Timeout waiting for the diagnostics\n");
+        return 1;
+    }
+
+    std::map<uint8_t, uint32_t> &g = groups[-1];
+    double clock = g[DIAG_CORE_CLOCK] ? g[DIAG_CORE_CLOCK] : 1;
+
+    printf("captures       %10u\n", g[DIAG_CAPTURES]);
+    printf("triggers       %10u\n", g[DIAG_TRIGGERS]);
+    printf("trigger wait   %10u cycles, %.3f ms\n", g[DIAG_TRIGGER_WAIT], g[DIAG_TRIGGER_WAIT] / clock * 1e3);
+    printf("sample period  %10u ps%s\n", g[DIAG_SAMPLE_PERIOD], g[DIAG_SAMPLE_PERIOD] == 0xFFFFFFFF ? " or more" : "");
+    printf("uploads        %10u\n", g[DIAG_UPLOADS]);
+    printf("last upload    %10u bytes, %.3f ms\n", g[DIAG_UPLOAD_BYTES], g[DIAG_UPLOAD_CYCLES] / clock * 1e3);
+    printf("rx overruns    %10u bytes\n", g[DIAG_RX_OVERRUNS]);
+    printf("unknown        %10u commands\n", g[DIAG_UNKNOWN_COMMANDS]);
+    printf("stack          %10u of %u bytes\n", g[DIAG_STACK_USED], g[DIAG_STACK_SIZE]);
+    if(g.count(DIAG_CODEC_SAMPLES))
+        printf("codec          %10u samples, %u bytes, %u cycles\n", g[DIAG_CODEC_SAMPLES], g[DIAG_CODEC_BYTES], g[DIAG_CODEC_CYCLES]);
+
+    for(std::map<int, std::map<uint8_t, uint32_t> >::iterator i = groups.begin(); i != groups.end(); i++) {
+        std::map<uint8_t, uint32_t> &v = i->second;
+        if(i->first >> 8 == DIAG_KERNEL)
+            printf("kernel %3d     %10u Hz, achieved %u Hz, %+d ppm, %u captures\n", i->first & 0xFF, v[DIAG_KERNEL_RATE],
+                   v[DIAG_KERNEL_ACHIEVED_RATE], (int32_t) v[DIAG_KERNEL_DEVIATION], v[DIAG_KERNEL_CAPTURES]);
+        else if(i->first >> 8 == DIAG_OPCODE)
+            printf("opcode 0x%02X    %10u\n", i->first & 0xFF, v[DIAG_OPCODE_COUNT]);
+    }
+    return 0;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: sumptest [-b baud] [-r rate] [-n samples] [-c chunk] [-t|-k|-f gate|-d] device\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int baud = 115200;
+    uint32_t rate = 1000000;
+    uint32_t samples = 32768;
+    const char *device = NULL;
+    uint8_t table = 0;
+    uint32_t gate = 0;
+    uint32_t chunk = 0;
+    bool diagnostics = false;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-b") && i + 1 < argc)
+            baud = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-r") && i + 1 < argc)
+            rate = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            samples = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-t"))
+            table = SUMP_SELF_TEST;
+        else if(!strcmp(argv[i], "-k"))
+            table = SUMP_KERNEL_BENCHMARK;
+        else if(!strcmp(argv[i], "-f") && i + 1 < argc)
+            gate = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-d"))
+            diagnostics = true;
+        else if(!strcmp(argv[i], "-c") && i + 1 < argc)
+            chunk = atoi(argv[++i]);
+        else if(argv[i][0] == '-')
+            usage();
+        else
+            device = argv[i];
+    }
+
+    if(device == NULL || rate == 0 || samples < 4)
+        usage();
+
+    SumpClient sump;
+    if(!sump.open(device, baud)) {
+        perror(device);
+        return 1;
+    }
+
+    sump.reset();
+
+    if(diagnostics)
+        return printDiagnostics(sump);
+
+    if(table)
+        return printTable(sump, table);
+
+    if(gate)
+        return printFrequencies(sump, gate);
+
+    sump.setRate(rate);
+    sump.setSampleNumber(samples);
+
+    std::vector<uint8_t> data;
+    uint32_t resent = 0;
+    double t0 = sumpNow();
+    bool ok = chunk ? sump.captureChunked(SUMP_TEST, samples, chunk, data, 5000, resent)
+                    : sump.capture(SUMP_TEST, samples, data, 5000);
+    double elapsed = sumpNow() - t0;
+
+    if(!ok) {
+        fprintf(stderr, "Timeout waiting for %u samples\n", samples);
+        return 1;
+    }
+
+    /* The generator and the kernel run at the same nominal rate, so every
+       sample should advance the pattern by one. Repeats and skips count
+       as timing errors and the pattern is resynchronised after each. */
+    uint32_t repeats = 0;
+    uint32_t skips = 0;
+    int index = patternIndex(&data[0]);
+
+    for(uint32_t i = 1; i < samples; i++) {
+        int expected = (index + 1) % TEST_PATTERN_LENGTH;
+
+        if(index >= 0 && data[i] == testPattern(expected)) {
+            index = expected;
+            continue;
+        }
+
+        if(data[i] == data[i - 1])
+            repeats++;
+        else
+            skips++;
+
+        if(i + 2 < samples)
+            index = patternIndex(&data[i]);
+    }
+
+    printf("rate        %u Hz\n", rate);
+    printf("samples     %u\n", samples);
+    printf("repeats     %u\n", repeats);
+    printf("skips       %u\n", skips);
+    if(chunk)
+        printf("resent      %u chunks of %u\n", resent, chunk);
+    printf("time        %.3f s\n", elapsed);
+    printf("throughput  %.0f bytes/s (%.1f%% of %d baud)\n", samples / elapsed, 100.0 * samples * 10 / elapsed / baud, baud);
+
+    return (repeats + skips) == 0 ? 0 : 2;
+}
@@ -0,0 +1,233 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+/*
+ Terminal viewer for the progressive upload. Captures with the
+ progressive arm command, which returns an overview of the capture
+ (OR/AND of every bin) instead of the samples, and draws it one row
+ per channel: '-' high, '_' low, 'X' changed within the bin.
+
+   sumpview [-b baud] [-r rate] [-n samples] [-w width] device
+
+ Then it reads navigation commands from stdin, one per line, and fetches
+ only the samples in view with the window readback command (RLE coded):
+
+   i / o       zoom in / out 2x
+   h / l       move half a screen left / right
+   g sample    center on a sample
+   a           whole capture (overview)
+   q           quit
+*/
+
+#include "SumpClient.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#define SUMP_ARM_PROGRESSIVE 0x10
+#define SUMP_GET_OVERVIEW 0xA7
+#define SUMP_SET_READ_WINDOW 0xA8
+#define SUMP_READ_WINDOW 0xA9
+
+#define WINDOW_RLE 1
+
+struct Overview {
+    uint32_t binSize;
+    std::vector<uint8_t> orValues;    // Oldest bin first
+    std::vector<uint8_t> andValues;
+};
+
+static uint32_t readUInt(const uint8_t *v)
+{
+    return (v[0] << 24) | (v[1] << 16) | (v[2] << 8) | v[3];
+}
+
+static bool readOverview(SumpClient &sump, Overview &o, int timeoutMs)
+{
+    uint8_t header[8];
+    if(sump.read(header, sizeof(header), timeoutMs) != sizeof(header))
+        return false;
+
+    o.binSize = readUInt(header);
+    uint32_t bins = readUInt(header + 4);
+
+    std::vector<uint8_t> data(bins * 2);
+    if(bins == 0 || sump.read(&data[0], data.size(), timeoutMs) != data.size())
+        return false;
+
+    //Bins arrive newest first, like the samples
+    o.orValues.resize(bins);
+    o.andValues.resize(bins);
+    for(uint32_t i = 0; i < bins; i++) {
+        o.orValues[bins - 1 - i] = data[i * 2];
+        o.andValues[bins - 1 - i] = data[i * 2 + 1];
+    }
+    return true;
+}
+
+//Column c covers bins [c * bins / columns, (c + 1) * bins / columns)
+static void draw(const std::vector<uint8_t> &orValues, const std::vector<uint8_t> &andValues, uint32_t width)
+{
+    uint32_t bins = orValues.size();
+    uint32_t columns = bins < width ? bins : width;
+
+    for(int c = 7; c >= 0; c--) {
+        printf("ch%d ", c);
+        for(uint32_t col = 0; col < columns; col++) {
+            uint8_t orValue = 0;
+            uint8_t andValue = 0xFF;
+
+            for(uint32_t b = col * bins / columns; b < (col + 1) * bins / columns; b++) {
+                orValue |= orValues[b];
+                andValue &= andValues[b];
+            }
+
+            uint8_t high = (orValue >> c) & 1;
+            uint8_t low = !((andValue >> c) & 1);
+            putchar(high && low ? 'X' : high ? '-' : '_');
+        }
+        putchar('\n');
+    }
+}
+
+/* Reads samples [start, start + span) in time order. The window offsets
+   count in the upload order, which is newest first. */
+static bool readWindow(SumpClient &sump, uint32_t samples, uint32_t start, uint32_t span, std::vector<uint8_t> &out)
+{
+    uint32_t offset = samples - (start + span);
+    sump.command(SUMP_SET_READ_WINDOW, (offset & 0xFFFF) | (span << 16));
+    sump.command(SUMP_READ_WINDOW, 1 | (WINDOW_RLE << 16));
+
+    uint8_t header[4];
+    if(sump.read(header, sizeof(header), 2000) != sizeof(header))
+        return false;
+
+    std::vector<uint8_t> rle(readUInt(header));
+    if(!rle.empty() && sump.read(&rle[0], rle.size(), 5000) != rle.size())
+        return false;
+
+    out.clear();
+    for(size_t i = 0; i + 1 < rle.size(); i += 2)
+        out.insert(out.end(), rle[i + 1] + 1, rle[i]);
+
+    std::reverse(out.begin(), out.end());
+    return out.size() == span;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: sumpview [-b baud] [-r rate] [-n samples] [-w width] device\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int baud = 115200;
+    uint32_t rate = 1000000;
+    uint32_t samples = 32768;
+    uint32_t width = 128;
+    const char *device = NULL;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-b") && i + 1 < argc)
+            baud = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-r") && i + 1 < argc)
+            rate = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            samples = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-w") && i + 1 < argc)
+            width = atoi(argv[++i]);
+        else if(argv[i][0] == '-')
+            usage();
+        else
+            device = argv[i];
+    }
+
+    if(device == NULL || rate == 0 || samples < 4 || width == 0)
+        usage();
+
+    SumpClient sump;
+    if(!sump.open(device, baud)) {
+        perror(device);
+        return 1;
+    }
+
+    sump.reset();
+    sump.setRate(rate);
+    sump.setSampleNumber(samples);
+
+    //Capture time is not known, wait up to the slowest rate
+    Overview overview;
+    double t0 = sumpNow();
+    sump.command(SUMP_ARM_PROGRESSIVE);
+    if(!readOverview(sump, overview, 10000)) {
+        fprintf(stderr, "Timeout waiting for the overview\n");
+        return 1;
+    }
+
+    draw(overview.orValues, overview.andValues, width);
+    printf("    %u samples per column, overview after %.0f ms (capture %.0f ms)\n",
+           overview.binSize * (uint32_t) overview.orValues.size() / std::min(width, (uint32_t) overview.orValues.size()),
+           (sumpNow() - t0) * 1e3, samples * 1e3 / rate);
+
+    uint32_t center = samples / 2;
+    uint32_t span = samples;
+    char line[128];
+
+    while(fgets(line, sizeof(line), stdin)) {
+        if(line[0] == 'q')
+            break;
+        else if(line[0] == 'i')
+            span = std::max(width, span / 2);
+        else if(line[0] == 'o')
+            span = std::min(samples, span * 2);
+        else if(line[0] == 'h')
+            center = center > span / 2 ? center - span / 2 : 0;
+        else if(line[0] == 'l')
+            center += span / 2;
+        else if(line[0] == 'g')
+            center = strtoul(line + 1, NULL, 0);
+        else if(line[0] == 'a')
+            span = samples;
+        else
+            continue;
+
+        //Short captures can be narrower than the terminal
+        span = std::min(span, samples);
+        center = std::min(center, samples - 1);
+        uint32_t start = center > span / 2 ? center - span / 2 : 0;
+        start = std::min(start, samples - span);
+
+        //The whole capture is already known from the overview
+        if(span == samples) {
+            draw(overview.orValues, overview.andValues, width);
+            printf("    samples 0-%u\n", samples - 1);
+            continue;
+        }
+
+        std::vector<uint8_t> data;
+        double t1 = sumpNow();
+        if(!readWindow(sump, samples, start, span, data)) {
+            fprintf(stderr, "Window readback failed\n");
+            return 1;
+        }
+
+        draw(data, data, width);
+        printf("    samples %u-%u, %.2f per column, %.0f ms\n", start, start + span - 1,
+               (double) span / std::min(width, span), (sumpNow() - t1) * 1e3);
+    }
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+/*
+ Checks the firmware transition index (src/TransitionIndex.cpp, built
+ for the host) against a scalar reference on buffers with different
+ edge densities, lengths and start offsets, then reports its speed in
+ ns and TSC cycles per byte next to the scalar loop.
+
+   transitionbench [-n runs]
+*/
+
+#include "../src/TransitionIndex.h"
+#include "SumpClient.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static uint64_t cycles() { return __rdtsc(); }
+#else
+static uint64_t cycles() { return 0; }
+#endif
+
+#define BUFFER_SIZE 32768
+
+struct Entry {
+    uint32_t position;
+    uint8_t mask;
+};
+
+static void reference(const uint8_t *samples, uint32_t count, std::vector<Entry> &out)
+{
+    out.clear();
+    for(uint32_t p = 1; p < count; p++) {
+        uint8_t t = samples[p] ^ samples[p - 1];
+        if(t) {
+            Entry e = {p, t};
+            out.push_back(e);
+        }
+    }
+}
+
+static TransitionIndex transitions;
+
+static void indexed(const uint8_t *samples, uint32_t count, uint32_t from, std::vector<Entry> &out)
+{
+    out.clear();
+    while(from < count) {
+        uint32_t next = transitions.build(samples, count, from);
+        for(uint32_t i = 0; i < transitions.size(); i++) {
+            Entry e = {transitions.position(i), transitions.mask(i)};
+            out.push_back(e);
+        }
+
+        if(next <= from && transitions.size() == 0) {
+            fprintf(stderr, "no progress at %u\n", from);
+            exit(2);
+        }
+        from = next;
+    }
+}
+
+//Every sample changes with probability 1 / period
+static void fill(uint8_t *samples, uint32_t count, uint32_t period)
+{
+    uint8_t v = 0;
+    for(uint32_t i = 0; i < count; i++) {
+        if(period && rand() % period == 0)
+            v ^= 1 << (rand() % 8) | (rand() % 4 == 0 ? rand() : 0);
+        samples[i] = v;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int runs = 200;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: transitionbench [-n runs]\n");
+            return 1;
+        }
+    }
+
+    static uint8_t buffer[BUFFER_SIZE] __attribute__((aligned(4)));
+    static const uint32_t periods[] = {0, 1000, 100, 10, 2, 1};
+    std::vector<Entry> expected, actual;
+    int failed = 0;
+
+    //Correctness: odd lengths and offsets exercise the head and tail paths
+    for(size_t d = 0; d < sizeof(periods) / sizeof(periods[0]); d++) {
+        for(uint32_t count = 1; count <= BUFFER_SIZE; count = count * 3 + 1) {
+            fill(buffer, count, periods[d]);
+            reference(buffer, count, expected);
+
+            for(uint32_t from = 1; from <= 5; from++) {
+                indexed(buffer, count, from, actual);
+
+                std::vector<Entry> tail;
+                for(size_t i = 0; i < expected.size(); i++)
+                    if(expected[i].position >= from)
+                        tail.push_back(expected[i]);
+
+                bool same = tail.size() == actual.size();
+                for(size_t i = 0; same && i < tail.size(); i++)
+                    same = tail[i].position == actual[i].position && tail[i].mask == actual[i].mask;
+
+                if(!same) {
+                    printf("FAIL period %u count %u from %u: %zu vs %zu entries\n",
+                           periods[d], count, from, actual.size(), tail.size());
+                    failed++;
+                }
+            }
+        }
+    }
+
+    printf("density      edges   index ns/B  cyc/B   scalar ns/B  cyc/B\n");
+
+    for(size_t d = 0; d < sizeof(periods) / sizeof(periods[0]); d++) {
+        fill(buffer, BUFFER_SIZE, periods[d]);
+
+        double t0 = sumpNow();
+        uint64_t c0 = cycles();
+        for(int r = 0; r < runs; r++)
+            indexed(buffer, BUFFER_SIZE, 1, actual);
+        uint64_t c1 = cycles();
+        double t1 = sumpNow();
+        for(int r = 0; r < runs; r++)
+            reference(buffer, BUFFER_SIZE, expected);
+        uint64_t c2 = cycles();
+        double t2 = sumpNow();
+
+        double bytes = (double) runs * BUFFER_SIZE;
+        char density[16];
+        snprintf(density, sizeof(density), periods[d] ? "1/%u" : "idle", periods[d]);
+        printf("%-10s %8zu %12.3f %6.2f %13.3f %6.2f\n", density, expected.size(),
+               (t1 - t0) * 1e9 / bytes, (c1 - c0) / bytes, (t2 - t1) * 1e9 / bytes, (c2 - c1) / bytes);
+    }
+
+    printf("%s\n", failed ? "FAILED" : "index matches the scalar reference");
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,264 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ Author: Joao Paulo Barraca <jpbarraca@gmail.com>
+*/
+
+/*
+ Compiles a VCD file (or raw bytes) into the pattern generator upload
+ format. The output can be sent as is to the board:
+
+   vcd2pattern -r 1000000 -l -s capture.vcd > /dev/ttyACM0
+
+ Signals are mapped to PC0-PC7 in declaration order, or explicitly
+ with -m name=bit.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <iostream>
+
+#define SUMP_PATTERN_START 0x06
+#define SUMP_SET_PATTERN 0xA1
+#define SUMP_SET_PATTERN_DIVIDER 0xA2
+
+#define SUMP_ORIGINAL_FREQ  (100000000)
+#define PATTERN_SIZE 16384
+#define PATTERN_FLAGS_LOOP 0x01
+
+struct Signal {
+    int bit;
+    int width;
+};
+
+static void usage()
+{
+    fprintf(stderr, "usage: vcd2pattern [-r rate] [-l] [-s] [-m name=bit]... [-o out] input.vcd|input.bin\n"
+                    "  -r rate   output rate in Hz (default 1000000)\n"
+                    "  -l        loop the pattern\n"
+                    "  -s        start the generator after the upload\n"
+                    "  -m n=b    map signal n to bit b (default: declaration order)\n"
+                    "  -o out    output file (default: stdout)\n");
+    exit(1);
+}
+
+static double parseTimescale(const std::string &ts)
+{
+    char *end;
+    double v = strtod(ts.c_str(), &end);
+    std::string unit(end);
+
+    if(v == 0)
+        v = 1;
+
+    if(unit == "s")  return v;
+    if(unit == "ms") return v * 1e-3;
+    if(unit == "us") return v * 1e-6;
+    if(unit == "ns") return v * 1e-9;
+    if(unit == "ps") return v * 1e-12;
+    if(unit == "fs") return v * 1e-15;
+
+    fprintf(stderr, "Unknown timescale %s, assuming 1ns\n", ts.c_str());
+    return 1e-9;
+}
+
+static bool readVCD(std::istream &in, double period, std::map<std::string, int> &mapping, std::vector<uint8_t> &out)
+{
+    std::map<std::string, Signal> signals;
+    std::string token;
+    double timescale = 1e-9;
+    int nextBit = 0;
+    uint8_t state = 0;
+    uint64_t sample = 0;
+    bool haveTime = false;
+
+    while(in >> token) {
+        if(token == "$timescale") {
+            std::string ts;
+            while(in >> token && token != "$end")
+                ts += token;
+            timescale = parseTimescale(ts);
+        }else if(token == "$var") {
+            std::string type, width, id, name;
+            in >> type >> width >> id >> name;
+            while(in >> token && token != "$end");
+
+            Signal s;
+            s.width = atoi(width.c_str());
+            s.bit = -1;
+
+            if(mapping.empty()) {
+                s.bit = nextBit;
+                nextBit += s.width;
+            }else if(mapping.count(name)) {
+                s.bit = mapping[name];
+            }
+
+            if(s.bit >= 8)
+                s.bit = -1;
+
+            if(s.bit >= 0)
+                fprintf(stderr, "%s -> PC%d%s\n", name.c_str(), s.bit, s.width > 1 ? "+" : "");
+            signals[id] = s;
+        }else if(token[0] == '$') {
+            //Other declarations and $dumpvars/$end markers carry no timing
+            if(token != "$dumpvars" && token != "$dumpon" && token != "$dumpoff" && token != "$dumpall" && token != "$end")
+                while(in >> token && token != "$end");
+        }else if(token[0] == '#') {
+            double t = strtod(token.c_str() + 1, NULL) * timescale;
+
+            //Every sample before this timestamp sees the current state
+            while(out.size() < PATTERN_SIZE && sample * period < t) {
+                out.push_back(state);
+                sample++;
+            }
+            haveTime = true;
+
+            if(out.size() >= PATTERN_SIZE)
+                return true;
+        }else if(token[0] == 'b' || token[0] == 'B' || token[0] == 'r' || token[0] == 'R') {
+            std::string id;
+            in >> id;
+
+            if(token[0] == 'r' || token[0] == 'R' || !signals.count(id))
+                continue;
+
+            Signal &s = signals[id];
+            if(s.bit < 0)
+                continue;
+
+            //Vector values are MSB first and may be shorter than the width
+            std::string v = token.substr(1);
+            for(int i = 0; i < s.width && s.bit + i < 8; i++) {
+                int pos = (int) v.size() - 1 - i;
+                uint8_t mask = 1 << (s.bit + i);
+
+                if(pos >= 0 && v[pos] == '1')
+                    state |= mask;
+                else
+                    state &= ~mask;
+            }
+        }else {
+            std::string id = token.substr(1);
+            if(!signals.count(id) || signals[id].bit < 0)
+                continue;
+
+            uint8_t mask = 1 << signals[id].bit;
+            if(token[0] == '1')
+                state |= mask;
+            else
+                state &= ~mask;
+        }
+    }
+
+    //Hold the last state for one more sample
+    if(haveTime && out.size() < PATTERN_SIZE)
+        out.push_back(state);
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    double rate = 1000000;
+    bool loop = false;
+    bool start = false;
+    const char *output = NULL;
+    const char *input = NULL;
+    std::map<std::string, int> mapping;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-r") && i + 1 < argc) {
+            rate = atof(argv[++i]);
+        }else if(!strcmp(argv[i], "-l")) {
+            loop = true;
+        }else if(!strcmp(argv[i], "-s")) {
+            start = true;
+        }else if(!strcmp(argv[i], "-m") && i + 1 < argc) {
+            std::string m(argv[++i]);
+            size_t eq = m.find('=');
+            if(eq == std::string::npos)
+                usage();
+            mapping[m.substr(0, eq)] = atoi(m.c_str() + eq + 1);
+        }else if(!strcmp(argv[i], "-o") && i + 1 < argc) {
+            output = argv[++i];
+        }else if(argv[i][0] == '-') {
+            usage();
+        }else {
+            input = argv[i];
+        }
+    }
+
+    if(input == NULL || rate <= 0)
+        usage();
+
+    std::ifstream in(input, std::ios::binary);
+    if(!in) {
+        perror(input);
+        return 1;
+    }
+
+    std::vector<uint8_t> pattern;
+    size_t len = strlen(input);
+
+    if(len > 4 && !strcmp(input + len - 4, ".bin")) {
+        char c;
+        while(pattern.size() < PATTERN_SIZE && in.get(c))
+            pattern.push_back((uint8_t) c);
+    }else {
+        readVCD(in, 1.0 / rate, mapping, pattern);
+    }
+
+    if(pattern.empty()) {
+        fprintf(stderr, "%s: no samples\n", input);
+        return 1;
+    }
+
+    uint32_t divider = (uint32_t) lround(SUMP_ORIGINAL_FREQ / rate) - 1;
+
+    FILE *f = output ? fopen(output, "wb") : stdout;
+    if(f == NULL) {
+        perror(output);
+        return 1;
+    }
+
+    uint8_t cmd[5];
+    cmd[0] = SUMP_SET_PATTERN_DIVIDER;
+    cmd[1] = divider & 0xFF;
+    cmd[2] = (divider >> 8) & 0xFF;
+    cmd[3] = (divider >> 16) & 0xFF;
+    cmd[4] = (divider >> 24) & 0xFF;
+    fwrite(cmd, 1, sizeof(cmd), f);
+
+    cmd[0] = SUMP_SET_PATTERN;
+    cmd[1] = pattern.size() & 0xFF;
+    cmd[2] = (pattern.size() >> 8) & 0xFF;
+    cmd[3] = loop ? PATTERN_FLAGS_LOOP : 0;
+    cmd[4] = 0;
+    fwrite(cmd, 1, sizeof(cmd), f);
+    fwrite(&pattern[0], 1, pattern.size(), f);
+
+    if(start)
+        fputc(SUMP_PATTERN_START, f);
+
+    if(f != stdout)
+        fclose(f);
+
+    fprintf(stderr, "%u samples at %.0f Hz (divider %u)%s\n", (unsigned) pattern.size(), SUMP_ORIGINAL_FREQ / (divider + 1.0), divider, loop ? ", loop" : "");
+    return 0;
+}